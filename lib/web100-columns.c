@@ -0,0 +1,733 @@
+/*
+ * Copyright (c) 2001 Carnegie Mellon University,
+ *                    The Board of Trustees of the University of Illinois,
+ *                    and University Corporation for Atmospheric Research.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ *
+ * Columnar files: the records of logs turned on their side, for tools
+ * that want a few variables of every record rather than every variable
+ * of a few.
+ *
+ * web100_columns_export reads the records of a merge (see web100-merge.c)
+ * and writes each variable's values over all of them as one array, the
+ * wall-clock and monotonic times of the records first, as if variables
+ * "time_wall" and "time_mono".  The rows are grouped by connection, in
+ * time order within each, and a table of the connections gives the first
+ * row of each and how many it has.  After the arrays comes a footer, a
+ * head, one entry for each column with its name, type, encoding, offset
+ * and length, and the connection table, and after it a tail with the
+ * footer's offset, so a reader finds it from the end of the file.
+ *
+ * A column is written as it is, or, with WEB100_COLUMNS_DELTA, for the
+ * integer types, as the zigzag varint of each value's change from the
+ * row before.  The counters, and the many variables that never move,
+ * so shrink to a byte or two a row.
+ *
+ * The records can be many more than fit in memory.  They are spilled as
+ * they are read to an unnamed file beside the one written, and then
+ * copied, in connection order, to a second, which is mapped; each column
+ * is read from that in one pass and written out a chunk at a time.
+ *
+ * web100_columns_open maps the file and reads the footer only.  A raw
+ * column is handed out where it lies in the mapping, so only its pages
+ * are ever read in; a varint column is decoded the first time it is
+ * asked for and kept until the file is closed.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "web100-int.h"
+
+#define ALIGN8(x)  (((x) + 7) & ~(size_t)7)
+
+#define ZIGZAG(d)    (((u_int64_t)(d) << 1) ^ (u_int64_t)((int64_t)(d) >> 63))
+#define UNZIGZAG(v)  ((int64_t)((v) >> 1) ^ -(int64_t)((v) & 1))
+
+#define VARINT_MAX   10
+
+#define COLUMNS_CHUNK  4096        /* rows of a column encoded at a time */
+
+static const char zeros[8];
+
+/* A record as spilled by export, followed by its data, 8-aligned */
+struct columns_slot {
+    u_int64_t  time_mono;
+    u_int64_t  time_wall;
+    u_int32_t  conn;
+    u_int32_t  pad;
+};
+
+
+/* Varints, as in web100-log.c */
+static unsigned char*
+put_varint(unsigned char *p, u_int64_t v)
+{
+    while (v >= 0x80) {
+        *p++ = (v & 0x7f) | 0x80;
+        v >>= 7;
+    }
+    *p++ = v;
+    return p;
+}
+
+
+static int
+get_varint(const unsigned char **pp, const unsigned char *end, u_int64_t *vp)
+{
+    const unsigned char *p = *pp;
+    u_int64_t v = 0;
+    int shift;
+
+    for (shift = 0; p < end && shift < 64; shift += 7) {
+        v |= (u_int64_t)(*p & 0x7f) << shift;
+        if ((*p++ & 0x80) == 0) {
+            *pp = p;
+            *vp = v;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+
+/* The types whose changes are worth writing in place of their values */
+static int
+columns_integer(int type, int size)
+{
+    switch (type) {
+    case WEB100_TYPE_INTEGER:
+    case WEB100_TYPE_INTEGER32:
+    case WEB100_TYPE_COUNTER32:
+    case WEB100_TYPE_GAUGE32:
+    case WEB100_TYPE_UNSIGNED32:
+    case WEB100_TYPE_TIME_TICKS:
+    case WEB100_TYPE_COUNTER64:
+        return size == 4 || size == 8;
+    default:
+        return 0;
+    }
+}
+
+
+static void
+columns_conn_rec(struct web100_wire_record *rec, web100_connection *conn)
+{
+    memset(rec, 0, sizeof (*rec));
+    rec->cid = conn->cid;
+    rec->addrtype = conn->addrtype;
+    if (conn->addrtype != WEB100_ADDRTYPE_IPV6) {
+        memcpy(rec->local_addr, &conn->spec.src_addr, 4);
+        memcpy(rec->rem_addr, &conn->spec.dst_addr, 4);
+        rec->local_port = conn->spec.src_port;
+        rec->rem_port = conn->spec.dst_port;
+    } else {
+        memcpy(rec->local_addr, conn->spec_v6.src_addr, 16);
+        memcpy(rec->rem_addr, conn->spec_v6.dst_addr, 16);
+        rec->local_port = conn->spec_v6.src_port;
+        rec->rem_port = conn->spec_v6.dst_port;
+    }
+}
+
+
+/*
+ * columns_temp - Open an unnamed file beside filename, to spill to.
+ */
+static int
+columns_temp(const char *filename)
+{
+    char path[PATH_MAX];
+    int fd;
+
+    snprintf(path, sizeof (path), "%s.XXXXXX", filename);
+    if ((fd = mkstemp(path)) < 0) {
+        web100_errno = WEB100_ERR_FILE;
+        return -1;
+    }
+    unlink(path);
+    return fd;
+}
+
+
+/*
+ * columns_write - Write a column's values, taken size bytes at at, in
+ * each row of stride bytes from base, raw or as varints of their changes, encoding
+ * COLUMNS_CHUNK rows at a time into buf.  Returns the bytes written,
+ * before the padding to 8, or 0 on error (there being at least one row).
+ */
+static size_t
+columns_write(FILE *fp, unsigned char *buf, const char *base, size_t stride,
+              size_t at, u_int64_t rows, int size, int encoding)
+{
+    unsigned char *p = buf;
+    u_int64_t prev = 0, cur = 0, r;
+    u_int32_t w;
+    int64_t d;
+    size_t len = 0;
+
+    for (r = 0; r < rows; r++) {
+        const char *v = base + r * stride + at;
+
+        if (encoding == WEB100_COLUMNS_RAW) {
+            memcpy(p, v, size);
+            p += size;
+        } else if (size == 4) {
+            memcpy(&w, v, 4);
+            d = (int32_t)(w - (u_int32_t)prev);
+            p = put_varint(p, ZIGZAG(d));
+            prev = w;
+        } else {
+            memcpy(&cur, v, 8);
+            d = (int64_t)(cur - prev);
+            p = put_varint(p, ZIGZAG(d));
+            prev = cur;
+        }
+        if ((r + 1) % COLUMNS_CHUNK == 0 || r + 1 == rows) {
+            if (fwrite(buf, p - buf, 1, fp) != 1)
+                return 0;
+            len += p - buf;
+            p = buf;
+        }
+    }
+
+    if (ALIGN8(len) > len && fwrite(zeros, ALIGN8(len) - len, 1, fp) != 1)
+        return 0;
+    return len;
+}
+
+
+/*@
+web100_columns_export - write the records of a merge as a columnar file
+@*/
+int
+web100_columns_export(web100_log_merge *merge, char *filename, int flags)
+{
+    struct web100_columns_head head;
+    struct web100_columns_col *cols = NULL;
+    struct web100_columns_connrec *conns = NULL;
+    struct web100_columns_tail tail;
+    struct columns_slot rec;
+    web100_group *group;
+    web100_snapshot snap;
+    web100_accessor acc;
+    web100_var *var;
+    FILE *fp = NULL, *spill = NULL;
+    char *in = NULL, *sorted = NULL, *p;
+    u_int64_t *counts = NULL, *first = NULL;
+    unsigned char *buf = NULL;
+    u_int64_t rows = 0, r, off;
+    size_t stride, slot, maplen = 0, width, len;
+    int ncols, nconns, ncounts = 0, i, fd, err;
+
+    if (merge == NULL || filename == NULL) {
+        web100_errno = WEB100_ERR_INVAL;
+        return -WEB100_ERR_INVAL;
+    }
+    group = web100_get_log_merge_group(merge);
+    stride = ALIGN8(group->size);
+    slot = sizeof (rec) + stride;
+
+    //
+    // Every record, with its times and connection, spilled as it is read,
+    // and how many each connection has
+    //
+    if ((fd = columns_temp(filename)) < 0)
+        goto Cleanup;
+    if ((spill = fdopen(fd, "w+")) == NULL) {
+        close(fd);
+        web100_errno = WEB100_ERR_FILE;
+        goto Cleanup;
+    }
+    memset(&rec, 0, sizeof (rec));
+    while ((err = web100_log_merge_read(merge, &snap)) == WEB100_ERR_SUCCESS) {
+        rec.time_mono = snap.time_mono;
+        rec.time_wall = snap.time_wall;
+        rec.conn = _web100_log_merge_conn(merge);
+        if ((int)rec.conn >= ncounts) {
+            if ((p = realloc(counts, merge->nconns * sizeof (u_int64_t))) == NULL) {
+                web100_errno = WEB100_ERR_NOMEM;
+                goto Cleanup;
+            }
+            counts = (u_int64_t *)p;
+            memset(counts + ncounts, 0, (merge->nconns - ncounts) * sizeof (u_int64_t));
+            ncounts = merge->nconns;
+        }
+        /* As many as can be mapped */
+        if (rows == SIZE_MAX / slot) {
+            web100_errno = WEB100_ERR_NOMEM;
+            goto Cleanup;
+        }
+        if (fwrite(&rec, sizeof (rec), 1, spill) != 1 ||
+            fwrite(snap.data, group->size, 1, spill) != 1 ||
+            (stride > (size_t)group->size &&
+             fwrite(zeros, stride - group->size, 1, spill) != 1)) {
+            web100_errno = WEB100_ERR_FILE;
+            goto Cleanup;
+        }
+        counts[rec.conn]++;
+        rows++;
+    }
+    if (err != EOF || !web100_log_merge_eof(merge))
+        goto Cleanup;
+    if (fflush(spill) != 0) {
+        web100_errno = WEB100_ERR_FILE;
+        goto Cleanup;
+    }
+
+    //
+    // Rows in order of connection, and of time within each: each record
+    // copied to its place in a second file, keeping the merge's order
+    //
+    nconns = merge->nconns;
+    if ((conns = calloc(nconns + 1, sizeof (*conns))) == NULL ||
+        (first = calloc(nconns + 1, sizeof (u_int64_t))) == NULL) {
+        web100_errno = WEB100_ERR_NOMEM;
+        goto Cleanup;
+    }
+    for (i = 0; i < nconns; i++) {
+        columns_conn_rec(&conns[i].rec, merge->conns[i]);
+        conns[i].first = first[i];
+        conns[i].rows = i < ncounts ? counts[i] : 0;
+        first[i + 1] = first[i] + conns[i].rows;
+    }
+    if (rows > 0) {
+        maplen = rows * slot;
+        if ((in = mmap(NULL, maplen, PROT_READ, MAP_SHARED, fileno(spill), 0)) == MAP_FAILED) {
+            in = NULL;
+            web100_errno = WEB100_ERR_FILE;
+            goto Cleanup;
+        }
+        madvise(in, maplen, MADV_SEQUENTIAL);
+        if ((fd = columns_temp(filename)) < 0)
+            goto Cleanup;
+        if (posix_fallocate(fd, 0, maplen) != 0 ||
+            (sorted = mmap(NULL, maplen, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+            sorted = NULL;
+            close(fd);
+            web100_errno = WEB100_ERR_FILE;
+            goto Cleanup;
+        }
+        close(fd);
+
+        for (r = 0; r < rows; r++) {
+            memcpy(&rec, in + r * slot, sizeof (rec));
+            i = rec.conn;
+            if (conns[i].first == first[i]) {
+                conns[i].rec.time_mono = rec.time_mono;
+                conns[i].rec.time_wall = rec.time_wall;
+            }
+            memcpy(sorted + first[i]++ * slot, in + r * slot, slot);
+        }
+        munmap(in, maplen);
+        in = NULL;
+        fclose(spill);
+        spill = NULL;
+        madvise(sorted, maplen, MADV_SEQUENTIAL);
+    }
+
+    //
+    // The columns: the two times, and then the group's variables
+    //
+    ncols = 2;
+    width = VARINT_MAX;
+    for (var = web100_var_head(group); var; var = web100_var_next(var)) {
+        if (web100_accessor_init(&acc, var) != WEB100_ERR_SUCCESS)
+            goto Cleanup;
+        if ((size_t)acc.size > width)
+            width = acc.size;
+        ncols++;
+    }
+    if ((cols = calloc(ncols, sizeof (*cols))) == NULL ||
+        (buf = malloc(COLUMNS_CHUNK * width)) == NULL) {
+        web100_errno = WEB100_ERR_NOMEM;
+        goto Cleanup;
+    }
+    if ((fp = fopen(filename, "w")) == NULL) {
+        web100_errno = WEB100_ERR_FILE;
+        goto Cleanup;
+    }
+
+    off = 0;
+    for (i = 0, var = NULL; i < ncols; i++) {
+        size_t at;
+
+        if (i < 2) {
+            strcpy(cols[i].name, i == 0 ? "time_wall" : "time_mono");
+            cols[i].type = WEB100_TYPE_COUNTER64;
+            cols[i].size = 8;
+            at = i == 0 ? offsetof(struct columns_slot, time_wall) :
+                          offsetof(struct columns_slot, time_mono);
+        } else {
+            var = var ? web100_var_next(var) : web100_var_head(group);
+            web100_accessor_init(&acc, var);
+            strncpy(cols[i].name, web100_get_var_name(var), WEB100_VARNAME_LEN_MAX - 1);
+            cols[i].type = acc.type;
+            cols[i].size = acc.size;
+            at = sizeof (rec) + acc.offset;
+        }
+        if ((flags & WEB100_COLUMNS_DELTA) && columns_integer(cols[i].type, cols[i].size))
+            cols[i].encoding = WEB100_COLUMNS_VARINT;
+        else
+            cols[i].encoding = WEB100_COLUMNS_RAW;
+
+        if (rows == 0) {
+            len = 0;
+        } else if ((len = columns_write(fp, buf, sorted, slot, at, rows,
+                                        cols[i].size, cols[i].encoding)) == 0) {
+            web100_errno = WEB100_ERR_FILE;
+            goto Cleanup;
+        }
+        cols[i].offset = off;
+        cols[i].length = len;
+        off += ALIGN8(len);
+    }
+
+    //
+    // The footer, and the tail that finds it
+    //
+    memset(&head, 0, sizeof (head));
+    head.magic = WEB100_COLUMNS_MAGIC;
+    head.version = WEB100_COLUMNS_VERSION;
+    head.rows = rows;
+    head.ncols = ncols;
+    head.nconns = nconns;
+    head.schema = merge->agent->info.local.image->hash;
+    len = strlen(group->name);
+    memcpy(head.group, group->name,
+           len < sizeof (head.group) - 1 ? len : sizeof (head.group) - 1);
+
+    tail.footer = off;
+    tail.magic = WEB100_COLUMNS_MAGIC;
+    tail.length = sizeof (head) + ncols * sizeof (*cols) + nconns * sizeof (*conns);
+    if (fwrite(&head, sizeof (head), 1, fp) != 1 ||
+        fwrite(cols, sizeof (*cols), ncols, fp) != (size_t)ncols ||
+        (nconns && fwrite(conns, sizeof (*conns), nconns, fp) != (size_t)nconns) ||
+        fwrite(&tail, sizeof (tail), 1, fp) != 1) {
+        web100_errno = WEB100_ERR_FILE;
+        goto Cleanup;
+    }
+    err = fclose(fp);
+    fp = NULL;
+    if (err != 0) {
+        web100_errno = WEB100_ERR_FILE;
+        goto Cleanup;
+    }
+
+    web100_errno = WEB100_ERR_SUCCESS;
+
+ Cleanup:
+    if (fp)
+        fclose(fp);
+    if (spill)
+        fclose(spill);
+    if (in)
+        munmap(in, maplen);
+    if (sorted)
+        munmap(sorted, maplen);
+    free(counts);
+    free(first);
+    free(conns);
+    free(cols);
+    free(buf);
+
+    return -web100_errno;
+}
+
+
+/*
+ * columns_map - Map a columnar file, or read it all in if it cannot be
+ * mapped; as log_map, but without the advice to read it in order.
+ */
+static int
+columns_map(web100_columns *cols, const char *filename)
+{
+    struct stat st;
+    void *map;
+    int fd;
+
+    if ((fd = open(filename, O_RDONLY)) < 0) {
+        web100_errno = WEB100_ERR_FILE;
+        return -WEB100_ERR_FILE;
+    }
+
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 &&
+        (map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) != MAP_FAILED) {
+        madvise(map, st.st_size, MADV_RANDOM);
+        cols->map = map;
+        cols->maplen = st.st_size;
+        cols->mapped = 1;
+    } else {
+        cols->map = _web100_read_all(fd, &cols->maplen);
+    }
+    close(fd);
+
+    return cols->map ? WEB100_ERR_SUCCESS : -web100_errno;
+}
+
+
+/*@
+web100_columns_open - open a columnar file to read its columns
+@*/
+web100_columns*
+web100_columns_open(char *filename)
+{
+    struct web100_columns_tail tail;
+    struct web100_columns_connrec rec;
+    web100_columns *cols = NULL;
+    const char *footer;
+    u_int64_t i, size;
+
+    if (filename == NULL) {
+        web100_errno = WEB100_ERR_INVAL;
+        return NULL;
+    }
+
+    if ((cols = calloc(1, sizeof (web100_columns))) == NULL) {
+        web100_errno = WEB100_ERR_NOMEM;
+        return NULL;
+    }
+    if (columns_map(cols, filename) != WEB100_ERR_SUCCESS)
+        goto Cleanup;
+
+    //
+    // The tail, the footer it points at, and the columns in range
+    //
+    if (cols->maplen < sizeof (tail) + sizeof (cols->head)) {
+        web100_errno = WEB100_ERR_FILE;
+        goto Cleanup;
+    }
+    memcpy(&tail, cols->map + cols->maplen - sizeof (tail), sizeof (tail));
+    if (tail.magic != WEB100_COLUMNS_MAGIC || tail.length < sizeof (cols->head) ||
+        tail.length > cols->maplen - sizeof (tail) || tail.footer % 8 != 0 ||
+        tail.footer > cols->maplen - sizeof (tail) - tail.length) {
+        web100_errno = WEB100_ERR_FILE;
+        goto Cleanup;
+    }
+    footer = cols->map + tail.footer;
+    memcpy(&cols->head, footer, sizeof (cols->head));
+    if (cols->head.magic != WEB100_COLUMNS_MAGIC) {
+        web100_errno = WEB100_ERR_FILE;
+        goto Cleanup;
+    }
+    if (cols->head.version != WEB100_COLUMNS_VERSION) {
+        web100_errno = WEB100_ERR_INVAL;
+        goto Cleanup;
+    }
+    if (tail.length != sizeof (cols->head) +
+        (u_int64_t)cols->head.ncols * sizeof (struct web100_columns_col) +
+        (u_int64_t)cols->head.nconns * sizeof (rec)) {
+        web100_errno = WEB100_ERR_FILE;
+        goto Cleanup;
+    }
+
+    cols->cols = (const struct web100_columns_col *)(footer + sizeof (cols->head));
+    for (i = 0; i < cols->head.ncols; i++) {
+        const struct web100_columns_col *c = &cols->cols[i];
+
+        size = (u_int64_t)c->size * cols->head.rows;
+        if (c->offset % 8 != 0 || c->offset > tail.footer ||
+            c->length > tail.footer - c->offset ||
+            (c->encoding == WEB100_COLUMNS_RAW && c->length != size) ||
+            (c->encoding == WEB100_COLUMNS_VARINT && c->size != 4 && c->size != 8) ||
+            c->encoding > WEB100_COLUMNS_VARINT ||
+            memchr(c->name, '\0', WEB100_VARNAME_LEN_MAX) == NULL) {
+            web100_errno = WEB100_ERR_FILE;
+            goto Cleanup;
+        }
+    }
+
+    //
+    // The connections
+    //
+    if ((cols->decoded = calloc(cols->head.ncols + 1, sizeof (void *))) == NULL ||
+        (cols->conns = calloc(cols->head.nconns + 1, sizeof (*cols->conns))) == NULL) {
+        web100_errno = WEB100_ERR_NOMEM;
+        goto Cleanup;
+    }
+    footer += sizeof (cols->head) + cols->head.ncols * sizeof (struct web100_columns_col);
+    for (i = 0; i < cols->head.nconns; i++) {
+        struct web100_columns_conn *cc = &cols->conns[i];
+
+        memcpy(&rec, footer + i * sizeof (rec), sizeof (rec));
+        if (rec.first > cols->head.rows || rec.rows > cols->head.rows - rec.first) {
+            web100_errno = WEB100_ERR_FILE;
+            goto Cleanup;
+        }
+        cc->cid = rec.rec.cid;
+        cc->addrtype = rec.rec.addrtype;
+        if (rec.rec.addrtype != WEB100_ADDRTYPE_IPV6) {
+            memcpy(&cc->spec.src_addr, rec.rec.local_addr, 4);
+            memcpy(&cc->spec.dst_addr, rec.rec.rem_addr, 4);
+            cc->spec.src_port = rec.rec.local_port;
+            cc->spec.dst_port = rec.rec.rem_port;
+        } else {
+            memcpy(cc->spec_v6.src_addr, rec.rec.local_addr, 16);
+            memcpy(cc->spec_v6.dst_addr, rec.rec.rem_addr, 16);
+            cc->spec_v6.src_port = rec.rec.local_port;
+            cc->spec_v6.dst_port = rec.rec.rem_port;
+        }
+        cc->first = rec.first;
+        cc->rows = rec.rows;
+    }
+
+    web100_errno = WEB100_ERR_SUCCESS;
+    return cols;
+
+ Cleanup:
+    web100_columns_close(cols);
+    return NULL;
+}
+
+
+/*@
+web100_columns_close - close a columnar file
+@*/
+int
+web100_columns_close(web100_columns *cols)
+{
+    u_int32_t i;
+
+    if (cols) {
+        if (cols->decoded) {
+            for (i = 0; i < cols->head.ncols; i++)
+                free(cols->decoded[i]);
+            free(cols->decoded);
+        }
+        if (cols->mapped)
+            munmap(cols->map, cols->maplen);
+        else
+            free(cols->map);
+        free(cols->conns);
+        free(cols);
+    }
+
+    return WEB100_ERR_SUCCESS;
+}
+
+
+/*
+ * columns_decode - A varint column's values, summed back up from their
+ * changes.
+ */
+static void*
+columns_decode(web100_columns *cols, const struct web100_columns_col *c)
+{
+    const unsigned char *p = (const unsigned char *)cols->map + c->offset;
+    const unsigned char *end = p + c->length;
+    u_int64_t rows = cols->head.rows, r, v, sum = 0;
+    u_int32_t *w;
+    u_int64_t *q;
+    void *out;
+
+    if ((out = malloc(rows * c->size + 1)) == NULL) {
+        web100_errno = WEB100_ERR_NOMEM;
+        return NULL;
+    }
+    w = out;
+    q = out;
+
+    for (r = 0; r < rows; r++) {
+        if (get_varint(&p, end, &v) != 0) {
+            free(out);
+            web100_errno = WEB100_ERR_FILE;
+            return NULL;
+        }
+        sum += UNZIGZAG(v);
+        if (c->size == 4)
+            w[r] = (u_int32_t)sum;
+        else
+            q[r] = sum;
+    }
+
+    return out;
+}
+
+
+/*@
+web100_columns_get - the values of one column of a columnar file
+@*/
+const void*
+web100_columns_get(web100_columns *cols, const char *name, int *type)
+{
+    const struct web100_columns_col *c;
+    u_int32_t i;
+
+    if (cols == NULL || name == NULL) {
+        web100_errno = WEB100_ERR_INVAL;
+        return NULL;
+    }
+
+    for (i = 0; i < cols->head.ncols; i++)
+        if (strcmp(cols->cols[i].name, name) == 0)
+            break;
+    if (i == cols->head.ncols) {
+        web100_errno = WEB100_ERR_NOVAR;
+        return NULL;
+    }
+    c = &cols->cols[i];
+    if (type)
+        *type = c->type;
+
+    web100_errno = WEB100_ERR_SUCCESS;
+    if (c->encoding == WEB100_COLUMNS_RAW) {
+        if (cols->mapped && c->length > 0)
+            madvise(cols->map + (c->offset & ~(u_int64_t)(getpagesize() - 1)),
+                    c->length + (c->offset & (getpagesize() - 1)), MADV_WILLNEED);
+        return cols->map + c->offset;
+    }
+
+    if (cols->decoded[i] == NULL)
+        cols->decoded[i] = columns_decode(cols, c);
+    return cols->decoded[i];
+}
+
+
+u_int64_t
+web100_get_columns_rows(web100_columns *cols)
+{
+    return cols->head.rows;
+}
+
+int
+web100_get_columns_count(web100_columns *cols)
+{
+    return cols->head.ncols;
+}
+
+const char*
+web100_get_columns_name(web100_columns *cols, int index)
+{
+    if (index < 0 || (u_int32_t)index >= cols->head.ncols)
+        return NULL;
+    return cols->cols[index].name;
+}
+
+int
+web100_get_columns_conns(web100_columns *cols, const struct web100_columns_conn **conns)
+{
+    *conns = cols->conns;
+    return cols->head.nconns;
+}
@@ -0,0 +1,201 @@
+/*
+ * Copyright (c) 2001 Carnegie Mellon University,
+ *                    The Board of Trustees of the University of Illinois,
+ *                    and University Corporation for Atmospheric Research.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ *
+ * 64-bit totals of a connection's counters.
+ *
+ * A COUNTER32 wraps every 4G, which on a fast connection is a matter of
+ * seconds.  Fed every snapshot of the connection, the extension adds each
+ * 32-bit difference to a 64-bit total, so the total stays exact for as
+ * long as no counter wraps twice between two updates.  The first update
+ * starts each total at the counter's value.  COUNTER64s are copied as is.
+ *
+ * Totals are kept at the variable's index (web100_var_at), like the rates
+ * of web100_snapshot_rates(), and the counter runs of the group are worked
+ * through the same way.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "web100-int.h"
+
+
+/*
+ * ext32 - t[i] += (u_int32_t)(a[i] - b[i]) over n counters.  In the SIMD
+ * path the four 32-bit differences are zero-extended two at a time.
+ */
+static void
+ext32(u_int64_t *t, const char *a, const char *b, int n)
+{
+    u_int32_t x, y;
+    int i = 0;
+
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+
+    for (; i + 4 <= n; i += 4) {
+        __m128i va = _mm_loadu_si128((const __m128i *)(a + 4 * i));
+        __m128i vb = _mm_loadu_si128((const __m128i *)(b + 4 * i));
+        __m128i d = _mm_sub_epi32(va, vb);
+        __m128i lo = _mm_loadu_si128((const __m128i *)(t + i));
+        __m128i hi = _mm_loadu_si128((const __m128i *)(t + i + 2));
+
+        lo = _mm_add_epi64(lo, _mm_unpacklo_epi32(d, zero));
+        hi = _mm_add_epi64(hi, _mm_unpackhi_epi32(d, zero));
+        _mm_storeu_si128((__m128i *)(t + i), lo);
+        _mm_storeu_si128((__m128i *)(t + i + 2), hi);
+    }
+#endif
+    for (; i < n; i++) {
+        memcpy(&x, a + 4 * i, 4);
+        memcpy(&y, b + 4 * i, 4);
+        t[i] += (u_int32_t)(x - y);
+    }
+}
+
+
+/* The first update: each total starts at the counter's value */
+static void
+start32(u_int64_t *t, const char *a, int n)
+{
+    u_int32_t x;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        memcpy(&x, a + 4 * i, 4);
+        t[i] = x;
+    }
+}
+
+
+/*@
+web100_counters_alloc - allocate 64-bit counter totals for a connection
+@*/
+web100_counters*
+web100_counters_alloc(web100_group *group)
+{
+    web100_counters *ctr;
+
+    if ((ctr = calloc(1, sizeof (web100_counters))) == NULL ||
+        (ctr->prev = malloc(group->size)) == NULL ||
+        (ctr->totals = calloc(group->nlive ? group->nlive : 1,
+                              sizeof (u_int64_t))) == NULL) {
+        web100_counters_free(ctr);
+        web100_errno = WEB100_ERR_NOMEM;
+        return NULL;
+    }
+    ctr->group = group;
+    ctr->cid = -1;
+
+    web100_errno = WEB100_ERR_SUCCESS;
+    return ctr;
+}
+
+
+/*@
+web100_counters_free - deallocate counter totals
+@*/
+void
+web100_counters_free(web100_counters *ctr)
+{
+    if (ctr == NULL)
+        return;
+
+    free(ctr->prev);
+    free(ctr->totals);
+    free(ctr);
+}
+
+
+/*@
+web100_counters_update - add the counters of a new snapshot to their totals
+@*/
+int
+web100_counters_update(web100_counters *ctr, web100_snapshot *snap)
+{
+    web100_group *group = ctr->group;
+    web100_connection *conn = snap->connection;
+    const char *a = snap->data;
+    const int *run;
+    int cid, i;
+
+    /* A cid the kernel has since given to a new connection is not ours */
+    cid = conn ? conn->cid : -1;
+    if (snap->group != group ||
+        (ctr->started && (cid != ctr->cid ||
+                          (conn && !_web100_same_connection(conn, &ctr->conn))))) {
+        web100_errno = WEB100_ERR_INVAL;
+        return -WEB100_ERR_INVAL;
+    }
+
+    run = GROUP_DELTA_RUNS(group);
+    for (i = 0; i < group->ndelta32; i++, run += 3) {
+        if (ctr->started)
+            ext32(ctr->totals + run[2], a + run[0], ctr->prev + run[0], run[1]);
+        else
+            start32(ctr->totals + run[2], a + run[0], run[1]);
+    }
+    for (i = 0; i < group->ndelta64; i++, run += 3)
+        memcpy(ctr->totals + run[2], a + run[0], 8 * run[1]);
+
+    memcpy(ctr->prev, a, group->size);
+    if (!ctr->started && conn)
+        ctr->conn = *conn;
+    ctr->cid = cid;
+    ctr->started = 1;
+
+    web100_errno = WEB100_ERR_SUCCESS;
+    return WEB100_ERR_SUCCESS;
+}
+
+
+/*@
+web100_counters_get - return the 64-bit total of a counter
+@*/
+u_int64_t
+web100_counters_get(web100_counters *ctr, web100_var *var)
+{
+    web100_var *vars = GROUP_VAR_ARRAY(ctr->group);
+
+    if (VAR_GROUP(var) != ctr->group || var - vars >= ctr->group->nlive ||
+        (var->type != WEB100_TYPE_COUNTER32 &&
+         var->type != WEB100_TYPE_COUNTER64)) {
+        web100_errno = WEB100_ERR_INVAL;
+        return 0;
+    }
+
+    web100_errno = WEB100_ERR_SUCCESS;
+    return ctr->totals[var - vars];
+}
+
+
+/*@
+web100_counters_totals - return the 64-bit totals of all counters of a group
+@*/
+const u_int64_t*
+web100_counters_totals(web100_counters *ctr)
+{
+    return ctr->totals;
+}
@@ -0,0 +1,297 @@
+/*
+ * Copyright (c) 2001 Carnegie Mellon University,
+ *                    The Board of Trustees of the University of Illinois,
+ *                    and University Corporation for Atmospheric Research.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ *
+ * Whole-snapshot arithmetic.
+ *
+ * The header compiler records, for every group, the runs of counters that
+ * sit back to back in the group's data (see counter_runs() in
+ * web100-header.c).  Working a run at a time lets the subtraction go
+ * several counters per instruction.  Unsigned subtraction at the counter's
+ * own width is exactly the wrapped difference, so no special case is needed
+ * for counters that have rolled over.
+ *
+ * Rates are the same differences scaled by the time between the two
+ * snapshots.  Each rate lands at its variable's index (web100_var_at), so
+ * the output is laid out like the group; entries for other variables are
+ * set to 0.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "web100-int.h"
+
+
+/*
+ * sub32, sub64 - d[i] = a[i] - b[i] over n counters of the given width.
+ * The data of a snapshot has no particular alignment, so loads and stores
+ * are unaligned.  d may be a.
+ */
+static void
+sub32(char *d, const char *a, const char *b, int n)
+{
+    u_int32_t x, y;
+    int i = 0;
+
+#ifdef __SSE2__
+    for (; i + 4 <= n; i += 4) {
+        __m128i va = _mm_loadu_si128((const __m128i *)(a + 4 * i));
+        __m128i vb = _mm_loadu_si128((const __m128i *)(b + 4 * i));
+        _mm_storeu_si128((__m128i *)(d + 4 * i), _mm_sub_epi32(va, vb));
+    }
+#endif
+    for (; i < n; i++) {
+        memcpy(&x, a + 4 * i, 4);
+        memcpy(&y, b + 4 * i, 4);
+        x -= y;
+        memcpy(d + 4 * i, &x, 4);
+    }
+}
+
+
+static void
+sub64(char *d, const char *a, const char *b, int n)
+{
+    u_int64_t x, y;
+    int i = 0;
+
+#ifdef __SSE2__
+    for (; i + 2 <= n; i += 2) {
+        __m128i va = _mm_loadu_si128((const __m128i *)(a + 8 * i));
+        __m128i vb = _mm_loadu_si128((const __m128i *)(b + 8 * i));
+        _mm_storeu_si128((__m128i *)(d + 8 * i), _mm_sub_epi64(va, vb));
+    }
+#endif
+    for (; i < n; i++) {
+        memcpy(&x, a + 8 * i, 8);
+        memcpy(&y, b + 8 * i, 8);
+        x -= y;
+        memcpy(d + 8 * i, &x, 8);
+    }
+}
+
+
+/*
+ * rate32, rate64 - r[i] = (a[i] - b[i]) * scale over n counters.  32-bit
+ * differences are converted to double exactly in the SIMD path: flipping
+ * the top bit makes them signed, and 2^31 added back afterwards undoes it.
+ */
+static void
+rate32(double *r, const char *a, const char *b, int n, double scale)
+{
+    u_int32_t x, y;
+    int i = 0;
+
+#ifdef __SSE2__
+    const __m128i flip = _mm_set1_epi32(0x80000000);
+    const __m128d bias = _mm_set1_pd(2147483648.0);
+    const __m128d vscale = _mm_set1_pd(scale);
+
+    for (; i + 4 <= n; i += 4) {
+        __m128i va = _mm_loadu_si128((const __m128i *)(a + 4 * i));
+        __m128i vb = _mm_loadu_si128((const __m128i *)(b + 4 * i));
+        __m128i d = _mm_xor_si128(_mm_sub_epi32(va, vb), flip);
+        __m128d lo = _mm_add_pd(_mm_cvtepi32_pd(d), bias);
+        __m128d hi = _mm_add_pd(_mm_cvtepi32_pd(_mm_shuffle_epi32(d, 0xee)), bias);
+        _mm_storeu_pd(r + i, _mm_mul_pd(lo, vscale));
+        _mm_storeu_pd(r + i + 2, _mm_mul_pd(hi, vscale));
+    }
+#endif
+    for (; i < n; i++) {
+        memcpy(&x, a + 4 * i, 4);
+        memcpy(&y, b + 4 * i, 4);
+        r[i] = (double)(u_int32_t)(x - y) * scale;
+    }
+}
+
+
+static void
+rate64(double *r, const char *a, const char *b, int n, double scale)
+{
+    u_int64_t x, y;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        memcpy(&x, a + 8 * i, 8);
+        memcpy(&y, b + 8 * i, 8);
+        r[i] = (double)(x - y) * scale;
+    }
+}
+
+
+/* The float versions round the double results, as a scalar cast would */
+static void
+rate32f(float *r, const char *a, const char *b, int n, double scale)
+{
+    u_int32_t x, y;
+    int i = 0;
+
+#ifdef __SSE2__
+    const __m128i flip = _mm_set1_epi32(0x80000000);
+    const __m128d bias = _mm_set1_pd(2147483648.0);
+    const __m128d vscale = _mm_set1_pd(scale);
+
+    for (; i + 4 <= n; i += 4) {
+        __m128i va = _mm_loadu_si128((const __m128i *)(a + 4 * i));
+        __m128i vb = _mm_loadu_si128((const __m128i *)(b + 4 * i));
+        __m128i d = _mm_xor_si128(_mm_sub_epi32(va, vb), flip);
+        __m128d lo = _mm_add_pd(_mm_cvtepi32_pd(d), bias);
+        __m128d hi = _mm_add_pd(_mm_cvtepi32_pd(_mm_shuffle_epi32(d, 0xee)), bias);
+        __m128 flo = _mm_cvtpd_ps(_mm_mul_pd(lo, vscale));
+        __m128 fhi = _mm_cvtpd_ps(_mm_mul_pd(hi, vscale));
+        _mm_storeu_ps(r + i, _mm_movelh_ps(flo, fhi));
+    }
+#endif
+    for (; i < n; i++) {
+        memcpy(&x, a + 4 * i, 4);
+        memcpy(&y, b + 4 * i, 4);
+        r[i] = (float)((double)(u_int32_t)(x - y) * scale);
+    }
+}
+
+
+static void
+rate64f(float *r, const char *a, const char *b, int n, double scale)
+{
+    u_int64_t x, y;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        memcpy(&x, a + 8 * i, 8);
+        memcpy(&y, b + 8 * i, 8);
+        r[i] = (float)((double)(x - y) * scale);
+    }
+}
+
+
+/*
+ * rate_scale - The factor that turns a difference between s1 and s2 into a
+ * per-second rate.  Returns 0 if the snapshots cannot be compared.
+ */
+static double
+rate_scale(const web100_snapshot *s1, const web100_snapshot *s2)
+{
+    if (s1->group != s2->group || s1->time_mono <= s2->time_mono ||
+        s2->time_mono == 0)
+        return 0;
+
+    return 1e9 / (double)(s1->time_mono - s2->time_mono);
+}
+
+
+/*@
+web100_snapshot_delta - produce the deltas of all counters between two snapshots
+@*/
+int
+web100_snapshot_delta(web100_snapshot *dst, web100_snapshot *s1,
+                      web100_snapshot *s2)
+{
+    web100_group *group = s1->group;
+    char *d, *a, *b;
+    const int *run;
+    int i;
+
+    if (s2->group != group || dst->group != group ||
+        (dst->data == s2->data && s2->data != s1->data)) {
+        web100_errno = WEB100_ERR_INVAL;
+        return -WEB100_ERR_INVAL;
+    }
+
+    d = dst->data;
+    a = s1->data;
+    b = s2->data;
+
+    /* Everything that is not a counter passes through from s1 */
+    if (d != a)
+        memcpy(d, a, group->size);
+
+    run = GROUP_DELTA_RUNS(group);
+    for (i = 0; i < group->ndelta32; i++, run += 3)
+        sub32(d + run[0], a + run[0], b + run[0], run[1]);
+    for (i = 0; i < group->ndelta64; i++, run += 3)
+        sub64(d + run[0], a + run[0], b + run[0], run[1]);
+
+    web100_errno = WEB100_ERR_SUCCESS;
+    return WEB100_ERR_SUCCESS;
+}
+
+
+/*@
+web100_snapshot_rates - per-second rates of all counters between two snapshots
+@*/
+int
+web100_snapshot_rates(web100_snapshot *s1, web100_snapshot *s2, double *rates)
+{
+    web100_group *group = s1->group;
+    const char *a = s1->data, *b = s2->data;
+    const int *run;
+    double scale;
+    int i;
+
+    if ((scale = rate_scale(s1, s2)) == 0) {
+        web100_errno = WEB100_ERR_INVAL;
+        return -WEB100_ERR_INVAL;
+    }
+
+    memset(rates, 0, group->nlive * sizeof (*rates));
+
+    run = GROUP_DELTA_RUNS(group);
+    for (i = 0; i < group->ndelta32; i++, run += 3)
+        rate32(rates + run[2], a + run[0], b + run[0], run[1], scale);
+    for (i = 0; i < group->ndelta64; i++, run += 3)
+        rate64(rates + run[2], a + run[0], b + run[0], run[1], scale);
+
+    web100_errno = WEB100_ERR_SUCCESS;
+    return WEB100_ERR_SUCCESS;
+}
+
+
+/*@
+web100_snapshot_ratesf - web100_snapshot_rates into an array of float
+@*/
+int
+web100_snapshot_ratesf(web100_snapshot *s1, web100_snapshot *s2, float *rates)
+{
+    web100_group *group = s1->group;
+    const char *a = s1->data, *b = s2->data;
+    const int *run;
+    double scale;
+    int i;
+
+    if ((scale = rate_scale(s1, s2)) == 0) {
+        web100_errno = WEB100_ERR_INVAL;
+        return -WEB100_ERR_INVAL;
+    }
+
+    memset(rates, 0, group->nlive * sizeof (*rates));
+
+    run = GROUP_DELTA_RUNS(group);
+    for (i = 0; i < group->ndelta32; i++, run += 3)
+        rate32f(rates + run[2], a + run[0], b + run[0], run[1], scale);
+    for (i = 0; i < group->ndelta64; i++, run += 3)
+        rate64f(rates + run[2], a + run[0], b + run[0], run[1], scale);
+
+    web100_errno = WEB100_ERR_SUCCESS;
+    return WEB100_ERR_SUCCESS;
+}
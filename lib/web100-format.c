@@ -0,0 +1,319 @@
+/*
+ * Copyright (c) 2001 Carnegie Mellon University,
+ *                    The Board of Trustees of the University of Illinois,
+ *                    and University Corporation for Atmospheric Research.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ *
+ * Values as text.
+ *
+ * The encoders below write straight into the caller's buffer, with no
+ * stdio and no state, so any number of threads can format at once.
+ * Decimal goes two digits at a time from a table.  IPv6 addresses are
+ * written in the RFC 5952 form: lower case, no leading zeros, and the
+ * longest run of two or more zero groups (the first, if tied) as "::".
+ * As inet_ntop(3) does, IPv4-compatible and IPv4-mapped addresses end in
+ * a dotted quad: "::1.2.3.4", "::ffff:1.2.3.4".
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "web100-int.h"
+
+/* Longest text of any value: an IPv6 address is 39, a STR32 32 */
+#define FORMAT_VALUE_MAX 40
+
+static const char digit_pairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static const char hex_digits[] = "0123456789abcdef";
+
+
+static char*
+enc_u64(char *p, u_int64_t v)
+{
+    char buf[20], *q = buf + sizeof (buf);
+    int len;
+
+    while (v >= 100) {
+        int i = (int)(v % 100) * 2;
+
+        v /= 100;
+        *--q = digit_pairs[i + 1];
+        *--q = digit_pairs[i];
+    }
+    if (v >= 10) {
+        *--q = digit_pairs[v * 2 + 1];
+        *--q = digit_pairs[v * 2];
+    } else {
+        *--q = '0' + (char)v;
+    }
+
+    len = buf + sizeof (buf) - q;
+    memcpy(p, q, len);
+    return p + len;
+}
+
+
+/* The common case, without 64-bit division */
+static char*
+enc_u32(char *p, u_int32_t v)
+{
+    char buf[10], *q = buf + sizeof (buf);
+    int len;
+
+    while (v >= 100) {
+        u_int32_t i = (v % 100) * 2;
+
+        v /= 100;
+        *--q = digit_pairs[i + 1];
+        *--q = digit_pairs[i];
+    }
+    if (v >= 10) {
+        *--q = digit_pairs[v * 2 + 1];
+        *--q = digit_pairs[v * 2];
+    } else {
+        *--q = '0' + (char)v;
+    }
+
+    len = buf + sizeof (buf) - q;
+    memcpy(p, q, len);
+    return p + len;
+}
+
+
+static char*
+enc_s32(char *p, int32_t v)
+{
+    if (v < 0) {
+        *p++ = '-';
+        return enc_u32(p, 0u - (u_int32_t)v);
+    }
+    return enc_u32(p, (u_int32_t)v);
+}
+
+
+static char*
+enc_ipv4(char *p, const unsigned char *a)
+{
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        if (i > 0)
+            *p++ = '.';
+        p = enc_u32(p, a[i]);
+    }
+    return p;
+}
+
+
+static char*
+enc_hex16(char *p, unsigned int v)
+{
+    if (v >= 0x1000)
+        *p++ = hex_digits[v >> 12];
+    if (v >= 0x100)
+        *p++ = hex_digits[(v >> 8) & 0xf];
+    if (v >= 0x10)
+        *p++ = hex_digits[(v >> 4) & 0xf];
+    *p++ = hex_digits[v & 0xf];
+    return p;
+}
+
+
+static char*
+enc_ipv6(char *p, const unsigned char *a)
+{
+    unsigned int h[8];
+    int start = -1, end = -1;
+    int i, j;
+
+    for (i = 0; i < 8; i++)
+        h[i] = a[2 * i] << 8 | a[2 * i + 1];
+
+    /* The longest run of zero groups, [start, end) */
+    for (i = 0; i < 8; i = j + 1) {
+        for (j = i; j < 8 && h[j] == 0; j++)
+            ;
+        if (j - i > end - start) {
+            start = i;
+            end = j;
+        }
+    }
+    if (end - start < 2)
+        start = end = -1;
+
+    /* IPv4-compatible or IPv4-mapped */
+    if (start == 0 && (end == 6 || (end == 5 && h[5] == 0xffff))) {
+        *p++ = ':';
+        *p++ = ':';
+        if (end == 5) {
+            memcpy(p, "ffff:", 5);
+            p += 5;
+        }
+        return enc_ipv4(p, a + 12);
+    }
+
+    for (i = 0; i < 8; i++) {
+        if (i == start) {
+            *p++ = ':';
+            *p++ = ':';
+            i = end - 1;
+            continue;
+        }
+        if (i > 0 && i != end)
+            *p++ = ':';
+        p = enc_hex16(p, h[i]);
+    }
+    return p;
+}
+
+
+/*
+ * format_value - Write the text of the value of type at buf to p, which
+ * has room for FORMAT_VALUE_MAX characters.  Returns the end of the text;
+ * nothing is terminated.
+ */
+static char*
+format_value(char *p, int type, const char *buf)
+{
+    u_int64_t u64;
+    u_int32_t u32;
+    int32_t s32;
+    u_int16_t u16;
+    const char *end;
+
+    switch (type) {
+    case WEB100_TYPE_INET_ADDRESS:
+        if (buf[16] == WEB100_ADDRTYPE_IPV4)
+            return enc_ipv4(p, (const unsigned char *)buf);
+        return enc_ipv6(p, (const unsigned char *)buf);
+    case WEB100_TYPE_INET_ADDRESS_IPV4:
+        return enc_ipv4(p, (const unsigned char *)buf);
+    case WEB100_TYPE_INET_ADDRESS_IPV6:
+        return enc_ipv6(p, (const unsigned char *)buf);
+    case WEB100_TYPE_INTEGER:
+    case WEB100_TYPE_INTEGER32:
+        memcpy(&s32, buf, 4);
+        return enc_s32(p, s32);
+    case WEB100_TYPE_COUNTER32:
+    case WEB100_TYPE_GAUGE32:
+    case WEB100_TYPE_UNSIGNED32:
+    case WEB100_TYPE_TIME_TICKS:
+        memcpy(&u32, buf, 4);
+        return enc_u32(p, u32);
+    case WEB100_TYPE_COUNTER64:
+        memcpy(&u64, buf, 8);
+        return enc_u64(p, u64);
+    case WEB100_TYPE_INET_PORT_NUMBER:
+        memcpy(&u16, buf, 2);
+        return enc_u32(p, u16);
+    case WEB100_TYPE_STR32:
+        if ((end = memchr(buf, '\0', 32)) == NULL)
+            end = buf + 32;
+        memcpy(p, buf, end - buf);
+        return p + (end - buf);
+    case WEB100_TYPE_OCTET:
+        *p++ = '0';
+        *p++ = 'x';
+        return enc_hex16(p, *(const unsigned char *)buf);
+    default:
+        memcpy(p, "unknown type", 12);
+        return p + 12;
+    }
+}
+
+
+/*@
+web100_value_to_textn - return string representation of buf
+@*/
+int
+web100_value_to_textn(char* dest, size_t size, WEB100_TYPE type, void* buf)
+{
+    char text[FORMAT_VALUE_MAX];
+    size_t len;
+
+    len = format_value(text, type, buf) - text;
+
+    if (size > 0) {
+        memcpy(dest, text, len < size ? len : size - 1);
+        dest[len < size ? len : size - 1] = '\0';
+    }
+    return len;
+}
+
+
+/*@
+web100_snapshot_format - write the values of a snapshot as text
+@*/
+int
+web100_snapshot_format(web100_snapshot *snap, const web100_accessor *accs,
+                       int nacc, int sep, char *dest, size_t size)
+{
+    const web100_var *vars = NULL;
+    const char *data = snap->data;
+    char text[FORMAT_VALUE_MAX + 1];
+    size_t pos = 0, len;
+    int i, n, type, offset;
+
+    /* Without a projection, every variable in web100_var_at order */
+    if (accs) {
+        n = nacc;
+    } else {
+        vars = GROUP_VAR_ARRAY(snap->group);
+        n = snap->group->nlive;
+    }
+
+    for (i = 0; i < n; i++) {
+        if (accs) {
+            type = accs[i].type;
+            offset = accs[i].offset;
+        } else {
+            type = vars[i].type;
+            offset = vars[i].offset;
+        }
+
+        if (pos + FORMAT_VALUE_MAX + 1 < size) {
+            if (i > 0)
+                dest[pos++] = (char)sep;
+            pos = format_value(dest + pos, type, data + offset) - dest;
+        } else {
+            /* Near the end: count all of it, keep what fits */
+            len = 0;
+            if (i > 0)
+                text[len++] = (char)sep;
+            len = format_value(text + len, type, data + offset) - text;
+            if (pos < size)
+                memcpy(dest + pos, text, pos + len < size ? len : size - pos);
+            pos += len;
+        }
+    }
+
+    if (size > 0)
+        dest[pos < size ? pos : size - 1] = '\0';
+    return pos;
+}
@@ -0,0 +1,772 @@
+/*
+ * Copyright (c) 2001 Carnegie Mellon University,
+ *                    The Board of Trustees of the University of Illinois,
+ *                    and University Corporation for Atmospheric Research.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ *
+ * Header parsing and the compiled header image cache.
+ *
+ * Parsing /proc/web100/header turns it into a web100_image (see
+ * web100-int.h).  Images are also written to the cache directory, named
+ * by a hash of the header text, so later attaches to the same kernel can
+ * simply map the file instead of parsing again.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <ctype.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "web100-int.h"
+
+
+/*
+ * A malloc'd agent is followed directly by the word that points back at
+ * it, and then by its image.
+ */
+struct agent_head {
+    web100_agent   agent;
+    web100_agent*  owner;
+};
+
+#define ALIGN8(x)  (((x) + 7) & ~(size_t)7)
+
+
+/*
+ * _web100_hash - Identifies a header for the image cache.  This is FNV-1a
+ * taken a word at a time rather than a byte at a time, since it runs over
+ * the whole header on every attach.  Cache files never leave the host, so
+ * byte order does not matter.
+ */
+u_int64_t
+_web100_hash(const void *buf, size_t len)
+{
+    const unsigned char *p = buf;
+    u_int64_t h = 0xcbf29ce484222325ULL;
+    u_int64_t w;
+
+    for (; len >= sizeof (w); p += sizeof (w), len -= sizeof (w)) {
+        memcpy(&w, p, sizeof (w));
+        h ^= w;
+        h *= 0x100000001b3ULL;
+        h ^= h >> 29;
+    }
+    while (len--) {
+        h ^= *p++;
+        h *= 0x100000001b3ULL;
+    }
+
+    return h;
+}
+
+
+/*
+ * _web100_read_all - Read everything from fd into a NUL-terminated malloc'd
+ * buffer.  Files under /proc report a size of zero, so we cannot stat
+ * first; start with a buffer that fits any header we know of and grow if
+ * needed.  Returns NULL and sets web100_errno on failure.
+ */
+char*
+_web100_read_all(int fd, size_t *lenp)
+{
+    char *buf, *nbuf;
+    size_t size = 16384, len = 0;
+    ssize_t n;
+
+    if ((buf = malloc(size)) == NULL) {
+        web100_errno = WEB100_ERR_NOMEM;
+        return NULL;
+    }
+
+    for (;;) {
+        if (len + 1 >= size) {
+            size *= 2;
+            if ((nbuf = realloc(buf, size)) == NULL) {
+                free(buf);
+                web100_errno = WEB100_ERR_NOMEM;
+                return NULL;
+            }
+            buf = nbuf;
+        }
+        n = read(fd, buf + len, size - len - 1);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            free(buf);
+            web100_errno = WEB100_ERR_FILE;
+            return NULL;
+        }
+        if (n == 0)
+            break;
+        len += n;
+    }
+
+    buf[len] = '\0';
+    *lenp = len;
+    return buf;
+}
+
+
+/*
+ * next_token - Return the next whitespace delimited token in [*pp, end),
+ * advancing *pp past it.  Returns the token length, 0 at end of input.
+ */
+static inline size_t
+next_token(const char **pp, const char *end, const char **tok)
+{
+    const char *p = *pp;
+    const char *start;
+
+    while (p < end && isspace((unsigned char)*p))
+        p++;
+    start = p;
+    while (p < end && !isspace((unsigned char)*p))
+        p++;
+
+    *tok = start;
+    *pp = p;
+    return p - start;
+}
+
+
+/*
+ * parse_int - Parse a decimal integer token.  Returns 0 on success.
+ */
+static inline int
+parse_int(const char *tok, size_t len, int *val)
+{
+    int neg = 0, v = 0;
+
+    if (len > 0 && *tok == '-') {
+        neg = 1;
+        tok++;
+        len--;
+    }
+    if (len == 0 || len > 9)
+        return -1;
+    while (len--) {
+        if (*tok < '0' || *tok > '9')
+            return -1;
+        v = v * 10 + (*tok++ - '0');
+    }
+
+    *val = neg ? -v : v;
+    return 0;
+}
+
+
+/*
+ * Name indexes are open-addressed hash tables of variable offsets, sized to
+ * a power of two at least twice the number of entries.  An empty slot is 0,
+ * which can never be the offset of a variable.
+ */
+static inline u_int32_t
+name_hash(const char *name)
+{
+    u_int32_t h = 0x811c9dc5;
+
+    while (*name) {
+        h ^= (unsigned char)*name++;
+        h *= 0x01000193;
+    }
+
+    return h;
+}
+
+
+static int
+index_size(int n)
+{
+    int size = 1;
+
+    if (n == 0)
+        return 0;
+    while (size < 2 * n)
+        size <<= 1;
+    return size;
+}
+
+
+/*
+ * index_add - Add a variable to a name index, unless one of the same name
+ * is already there.  Callers add variables in list order, so lookups find
+ * what a walk of the lists would have found first.
+ */
+static void
+index_add(char *base, int *idx, int size, web100_var *vp)
+{
+    u_int32_t h = name_hash(vp->name) & (size - 1);
+
+    while (idx[h]) {
+        if (strcmp(((web100_var *)(base + idx[h]))->name, vp->name) == 0)
+            return;
+        h = (h + 1) & (size - 1);
+    }
+    idx[h] = vp->self;
+}
+
+
+/*
+ * _web100_index_find - Look up name in a name index.  Returns NULL if it is
+ * not there.
+ */
+web100_var*
+_web100_index_find(char *base, const int *idx, int size, const char *name)
+{
+    u_int32_t h;
+    web100_var *vp;
+
+    if (size == 0)
+        return NULL;
+
+    h = name_hash(name) & (size - 1);
+    while (idx[h]) {
+        vp = (web100_var *)(base + idx[h]);
+        if (strcmp(vp->name, name) == 0)
+            return vp;
+        h = (h + 1) & (size - 1);
+    }
+
+    return NULL;
+}
+
+
+/*
+ * agent_alloc - Allocate an agent with room for an image of the given size
+ * behind it.
+ */
+static web100_agent*
+agent_alloc(size_t size)
+{
+    struct agent_head *head;
+
+    if ((head = malloc(sizeof (struct agent_head) + size)) == NULL) {
+        web100_errno = WEB100_ERR_NOMEM;
+        return NULL;
+    }
+
+    /* Zero the image too, so that cache files do not pick up junk */
+    bzero(head, sizeof (struct agent_head) + size);
+    head->owner = &head->agent;
+    head->agent.info.local.image = (struct web100_image *)(head + 1);
+
+    return &head->agent;
+}
+
+
+/*
+ * sort_vars - Order a group's vars as described in web100-int.h.  Headers
+ * normally list vars by offset already, so a stable insertion sort costs
+ * next to nothing.
+ */
+static void
+sort_vars(web100_var *vars, int n)
+{
+    web100_var tmp;
+    int i, j;
+
+#define VAR_BEFORE(a, b) \
+    (((a)->flags & WEB100_VAR_FL_DEP) != ((b)->flags & WEB100_VAR_FL_DEP) ? \
+     !((a)->flags & WEB100_VAR_FL_DEP) : (a)->offset < (b)->offset)
+
+    for (i = 1; i < n; i++) {
+        if (!VAR_BEFORE(&vars[i], &vars[i - 1]))
+            continue;
+        tmp = vars[i];
+        for (j = i; j > 0 && VAR_BEFORE(&tmp, &vars[j - 1]); j--)
+            vars[j] = vars[j - 1];
+        vars[j] = tmp;
+    }
+
+#undef VAR_BEFORE
+}
+
+
+/*
+ * counter_runs - Append to runs the (offset, count, index) triples of the
+ * group's live vars of the given counter type that sit back to back in the
+ * data; index is that of the first var of the run in the var array.
+ * Returns the number of runs.
+ */
+static int
+counter_runs(web100_group *gp, int type, int **runs)
+{
+    web100_var *vars = GROUP_VAR_ARRAY(gp);
+    int width = size_from_type(type);
+    int *run = NULL;
+    int n = 0, i;
+
+    for (i = 0; i < gp->nlive; i++) {
+        if (vars[i].type != type) {
+            run = NULL;
+            continue;
+        }
+        if (run && run[0] + run[1] * width == vars[i].offset) {
+            run[1]++;
+        } else {
+            run = *runs;
+            run[0] = vars[i].offset;
+            run[1] = 1;
+            run[2] = i;
+            *runs += 3;
+            n++;
+        }
+    }
+
+    return n;
+}
+
+
+/*
+ * compile_header - Parse the text of a header into a new agent's image.
+ * Returns NULL and sets web100_errno on failure.
+ */
+static web100_agent*
+compile_header(const char *buf, size_t len, u_int64_t hash)
+{
+    web100_agent* agent = NULL;
+    struct web100_image* image;
+    char* base;
+    web100_group* gp;
+    web100_var* vp;
+    web100_group* groups;
+    web100_var* vars;
+    web100_var* first;
+    int* idx;
+    const char *p, *end, *tok;
+    size_t toklen, vlen, size;
+    int ngroups = 0, nwords = 0, maxvars, igroup = 0, ivar = 0;
+    int fsize, vsize, fields, i, j;
+    int have_len = 0;
+
+    end = buf + len;
+
+    /* The version string is the whole of the first line */
+    for (p = buf; p < end && *p != '\n'; p++)
+        ;
+    vlen = p - buf;
+    if (vlen == 0) {
+        web100_errno = WEB100_ERR_HEADER;
+        goto Cleanup;
+    }
+    if (vlen >= WEB100_VERSTR_LEN_MAX)
+        vlen = WEB100_VERSTR_LEN_MAX - 1;
+
+    /* Size the image: every group starts with a '/' token, and every
+     * variable takes at least three tokens. */
+    while ((toklen = next_token(&p, end, &tok)) > 0) {
+        if (*tok == '/')
+            ngroups++;
+        else
+            nwords++;
+    }
+    maxvars = nwords / 3;
+
+    /* Each name index takes at most 4 slots per variable, and the counter
+     * runs at most 3 */
+    size = ALIGN8(sizeof (struct web100_image)) +
+           ngroups * sizeof (web100_group) +
+           maxvars * sizeof (web100_var) +
+           11 * maxvars * sizeof (int) + len + 1;
+    if ((agent = agent_alloc(size)) == NULL)
+        goto Cleanup;
+    image = agent->info.local.image;
+    base = (char *)image;
+    groups = (web100_group *)(base + ALIGN8(sizeof (struct web100_image)));
+    vars = (web100_var *)(groups + ngroups);
+
+    image->magic = WEB100_IMAGE_MAGIC;
+    image->layout = WEB100_IMAGE_LAYOUT;
+    image->hash = hash;
+    memcpy(image->version, buf, vlen);
+    image->version[vlen] = '\0';
+    if (strncmp(image->version, "1.", 2) != 0)
+        have_len = 1;
+    fields = have_len ? 3 : 2;
+
+    gp = NULL;
+    p = buf + vlen;
+    while ((toklen = next_token(&p, end, &tok)) > 0) {
+        if (*tok == '/') {
+            tok++;
+            toklen--;
+            if (toklen == 0 || toklen >= WEB100_GROUPNAME_LEN_MAX) {
+                web100_errno = WEB100_ERR_HEADER;
+                goto Cleanup;
+            }
+
+            gp = &groups[igroup];
+            memcpy(gp->name, tok, toklen);
+            gp->name[toklen] = '\0';
+            gp->self = (char *)gp - base;
+            gp->id = igroup++;
+            gp->var_array = (char *)&vars[ivar] - base;
+
+            IFDEBUG(printf("compile_header: new group: %s\n", gp->name));
+
+            if (strcmp(gp->name, "spec") == 0) {
+                image->spec = gp->self;
+            } else {
+                gp->next = image->group_head;
+                image->group_head = gp->self;
+            }
+        } else {
+            const char *num;
+            size_t numlen;
+            int val[3];
+
+            if (gp == NULL || ivar >= maxvars) {
+                web100_errno = WEB100_ERR_HEADER;
+                goto Cleanup;
+            }
+
+            vp = &vars[ivar];
+            vp->flags = 0;
+
+            /* Depricated variable check: strip off leading _ */
+            if (*tok == '_') {
+                vp->flags |= WEB100_VAR_FL_DEP;
+                tok++;
+                toklen--;
+            }
+            if (toklen == 0 || toklen >= WEB100_VARNAME_LEN_MAX) {
+                web100_errno = WEB100_ERR_HEADER;
+                goto Cleanup;
+            }
+            memcpy(vp->name, tok, toklen);
+            vp->name[toklen] = '\0';
+
+            for (i = 0; i < fields; i++) {
+                numlen = next_token(&p, end, &num);
+                if (parse_int(num, numlen, &val[i]) != 0) {
+                    web100_errno = WEB100_ERR_HEADER;
+                    goto Cleanup;
+                }
+            }
+            vp->offset = val[0];
+            vp->type = val[1];
+            vp->len = have_len ? val[2] : -1;
+
+            IFDEBUG(printf("compile_header: new var: %s %d %d%s\n", vp->name, vp->offset, vp->type, (vp->flags & WEB100_VAR_FL_DEP) ? " (depricated)" : ""));
+
+            /* increment group (== file) size if necessary */
+            vsize = size_from_type(vp->type);
+            fsize = vp->offset + vsize;
+            gp->size = ((gp->size < fsize) ? fsize : gp->size);
+
+            /* if size_from_type 0 (i.e., type unrecognized),
+               forgo adding the variable */
+            if (!vsize) {
+                bzero(vp, sizeof (web100_var));
+                continue;
+            }
+
+            /* Until the group is sorted, id is the position in it */
+            vp->id = gp->nvars++;
+            vp->group = gp->self;
+            if (!(vp->flags & WEB100_VAR_FL_DEP))
+                gp->nlive++;
+            ivar++;
+        }
+    }
+
+    image->ngroups = igroup;
+    image->nvars = ivar;
+
+    /* The index area is free until the indexes are built, so use it to
+     * map header positions to sorted ones while linking the lists. */
+    idx = (int *)(vars + ivar);
+
+    for (i = 0; i < igroup; i++) {
+        gp = &groups[i];
+        first = GROUP_VAR_ARRAY(gp);
+        sort_vars(first, gp->nvars);
+
+        for (j = 0; j < gp->nvars; j++) {
+            vp = &first[j];
+            idx[vp->id] = j;
+            vp->self = (char *)vp - base;
+            vp->id = vp - vars;
+        }
+        for (j = 0; j < gp->nvars; j++) {
+            vp = &first[idx[j]];
+            vp->next = gp->var_head;
+            gp->var_head = vp->self;
+        }
+    }
+    bzero(idx, ivar * sizeof (int));
+
+    /* Name indexes: one per group, then one across all listed groups */
+
+    for (i = 0; i < igroup; i++) {
+        gp = &groups[i];
+        gp->var_index = (char *)idx - base;
+        gp->nvar_index = index_size(gp->nvars);
+        for (vp = GROUP_VAR_HEAD(gp); vp; vp = VAR_NEXT(vp))
+            index_add(base, idx, gp->nvar_index, vp);
+        idx += gp->nvar_index;
+    }
+
+    image->var_index = (char *)idx - base;
+    image->nvar_index = index_size(ivar);
+    for (gp = IMAGE_PTR(base, image->group_head); gp; gp = GROUP_NEXT(gp))
+        for (vp = GROUP_VAR_HEAD(gp); vp; vp = VAR_NEXT(vp))
+            index_add(base, idx, image->nvar_index, vp);
+    idx += image->nvar_index;
+
+    /* Counter runs for web100_snapshot_delta */
+    for (i = 0; i < igroup; i++) {
+        gp = &groups[i];
+        gp->delta_runs = (char *)idx - base;
+        gp->ndelta32 = counter_runs(gp, WEB100_TYPE_COUNTER32, &idx);
+        gp->ndelta64 = counter_runs(gp, WEB100_TYPE_COUNTER64, &idx);
+    }
+
+    /* And the text it came from, to check the cached image against */
+    image->header = (char *)idx - base;
+    image->header_len = len;
+    memcpy(base + image->header, buf, len);
+    base[image->header + len] = '\0';
+
+    image->size = image->header + len + 1;
+
+    web100_errno = WEB100_ERR_SUCCESS;
+
+ Cleanup:
+    if (web100_errno != WEB100_ERR_SUCCESS) {
+        _web100_agent_free(agent);
+        agent = NULL;
+    }
+
+    return agent;
+}
+
+
+/*
+ * cache_dir - The image cache directory, or NULL if caching is disabled.
+ * WEB100_CACHE_DIR in the environment overrides the built-in location; set
+ * it to the empty string to turn the cache off.
+ */
+static const char*
+cache_dir(void)
+{
+    const char *dir;
+
+    if ((dir = getenv("WEB100_CACHE_DIR")) != NULL)
+        return dir[0] ? dir : NULL;
+    return WEB100_CACHE_DIR;
+}
+
+
+static void
+cache_path(char *path, size_t size, const char *dir, u_int64_t hash)
+{
+    snprintf(path, size, "%s/header-%016llx-%d.img", dir,
+             (unsigned long long)hash, WEB100_IMAGE_LAYOUT);
+}
+
+
+/*
+ * image_valid - Sanity check an image read from the cache, and that it
+ * was compiled from the header text buf, not just one with the same hash.
+ */
+static int
+image_valid(const struct web100_image *image, size_t size, u_int64_t hash,
+            const char *buf, size_t len)
+{
+    size_t need;
+
+    if (size < sizeof (struct web100_image) ||
+        image->magic != WEB100_IMAGE_MAGIC ||
+        image->layout != WEB100_IMAGE_LAYOUT ||
+        image->hash != hash ||
+        image->size != size ||
+        image->ngroups < 0 || image->nvars < 0 ||
+        image->nvar_index != index_size(image->nvars))
+        return 0;
+
+    need = ALIGN8(sizeof (struct web100_image)) +
+           image->ngroups * sizeof (web100_group) +
+           image->nvars * sizeof (web100_var);
+    if (need > size ||
+        image->group_head < 0 || image->group_head >= size ||
+        image->spec < 0 || image->spec >= size ||
+        image->var_index < 0 ||
+        image->var_index + image->nvar_index * sizeof (int) > size ||
+        image->header < 0 || image->header_len < 0 ||
+        (size_t)image->header + image->header_len + 1 != size ||
+        ((const char *)image)[size - 1] != '\0' ||
+        memchr(image->version, '\0', WEB100_VERSTR_LEN_MAX) == NULL)
+        return 0;
+
+    if ((size_t)image->header_len != len ||
+        memcmp((const char *)image + image->header, buf, len) != 0)
+        return 0;
+
+    return 1;
+}
+
+
+/*
+ * cache_load - Map a cached image.  The file is shared read-only; the
+ * agent itself lives in a private page mapped just in front of it.
+ * Returns NULL if there is no usable image.
+ */
+static web100_agent*
+cache_load(const char *path, u_int64_t hash, const char *buf, size_t len)
+{
+    web100_agent *agent;
+    struct stat st;
+    char *reserve, *base;
+    size_t pgsize, size;
+    int fd;
+
+    pgsize = sysconf(_SC_PAGESIZE);
+    if (sizeof (web100_agent) + sizeof (web100_agent *) > pgsize)
+        return NULL;
+
+    if ((fd = open(path, O_RDONLY)) < 0)
+        return NULL;
+
+    /* Only trust images written by us or by root */
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) ||
+        (st.st_uid != 0 && st.st_uid != geteuid()) ||
+        (st.st_mode & (S_IWGRP | S_IWOTH))) {
+        close(fd);
+        return NULL;
+    }
+    size = st.st_size;
+
+    reserve = mmap(NULL, pgsize + size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (reserve == MAP_FAILED) {
+        close(fd);
+        return NULL;
+    }
+    base = mmap(reserve + pgsize, size, PROT_READ, MAP_SHARED | MAP_FIXED,
+                fd, 0);
+    close(fd);
+    if (base == MAP_FAILED ||
+        !image_valid((struct web100_image *)base, size, hash, buf, len)) {
+        munmap(reserve, pgsize + size);
+        return NULL;
+    }
+
+    agent = (web100_agent *)reserve;
+    agent->info.local.image = (struct web100_image *)base;
+    agent->info.local.mapped = pgsize + size;
+    IMAGE_AGENT(base) = agent;
+
+    return agent;
+}
+
+
+/*
+ * cache_store - Write an image to the cache.  Failure is not an error; the
+ * next attach will just parse the header again.
+ */
+static void
+cache_store(const char *dir, const char *path, const struct web100_image *image)
+{
+    char tmp[PATH_MAX];
+    const char *p = (const char *)image;
+    size_t left = image->size;
+    ssize_t n;
+    int fd;
+
+    if (snprintf(tmp, sizeof (tmp), "%s.%d", path, (int)getpid()) >= sizeof (tmp))
+        return;
+
+    if ((fd = open(tmp, O_WRONLY | O_CREAT | O_EXCL, 0644)) < 0) {
+        if (errno != ENOENT || mkdir(dir, 0755) != 0 ||
+            (fd = open(tmp, O_WRONLY | O_CREAT | O_EXCL, 0644)) < 0)
+            return;
+    }
+
+    while (left > 0) {
+        if ((n = write(fd, p, left)) < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        p += n;
+        left -= n;
+    }
+
+    if (close(fd) != 0 || left > 0 || rename(tmp, path) != 0)
+        unlink(tmp);
+}
+
+
+/*
+ * _web100_agent_attach_header - Builds an agent from the text of a Web100
+ * header held in memory.  With cache set, the image is taken from and
+ * stored in the image cache when possible; only headers read for an
+ * attach should be, not those of logs or wire streams, which may come
+ * from anywhere.  Returns NULL and sets web100_errno on failure.
+ */
+web100_agent*
+_web100_agent_attach_header(const char *buf, size_t len, int cache)
+{
+    web100_agent *agent;
+    const char *dir = NULL;
+    char path[PATH_MAX];
+    u_int64_t hash;
+
+    hash = _web100_hash(buf, len);
+
+    if (cache && (dir = cache_dir()) != NULL) {
+        cache_path(path, sizeof (path), dir, hash);
+        if ((agent = cache_load(path, hash, buf, len)) != NULL)
+            goto Done;
+    }
+
+    if ((agent = compile_header(buf, len, hash)) == NULL)
+        return NULL;
+
+    if (dir != NULL)
+        cache_store(dir, path, agent->info.local.image);
+
+ Done:
+    strcpy(agent->version, agent->info.local.image->version);
+    web100_errno = WEB100_ERR_SUCCESS;
+    return agent;
+}
+
+
+/*
+ * _web100_agent_free - Release an agent together with its image.
+ */
+void
+_web100_agent_free(web100_agent *agent)
+{
+    if (agent == NULL)
+        return;
+
+    free(agent->info.local.dep_warned);
+
+    if (agent->info.local.mapped)
+        munmap(agent, agent->info.local.mapped);
+    else
+        free(agent);
+}
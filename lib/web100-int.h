@@ -27,6 +27,8 @@
 #ifndef _WEB100_INT_H
 #define _WEB100_INT_H
 
+#include <pthread.h>
+
 #include "web100.h"
 
 #ifdef DEBUG
@@ -47,13 +49,103 @@
 
 #define WEB100_VALUE_LEN_MAX        255	/* IPv6 addr should use <=40 */
 
+#ifndef WEB100_ROOT_DIR
 #define WEB100_ROOT_DIR     "/proc/web100/"
+#endif
 #define WEB100_HEADER_FILE  WEB100_ROOT_DIR "header"
 
+/*
+ * size_from_type - Returns the size in bytes of an object of the specified
+ * type.
+ */
+static inline int
+size_from_type(WEB100_TYPE type)
+{
+    switch (type) {
+    case WEB100_TYPE_INTEGER:
+    case WEB100_TYPE_INTEGER32:
+    case WEB100_TYPE_INET_ADDRESS_IPV4:
+    case WEB100_TYPE_COUNTER32:
+    case WEB100_TYPE_GAUGE32:
+    case WEB100_TYPE_UNSIGNED32:
+    case WEB100_TYPE_TIME_TICKS:
+        return 4;
+    case WEB100_TYPE_COUNTER64:
+        return 8;
+    case WEB100_TYPE_INET_PORT_NUMBER:
+        return 2;
+    case WEB100_TYPE_INET_ADDRESS:
+    case WEB100_TYPE_INET_ADDRESS_IPV6:
+        return 17;
+    case WEB100_TYPE_STR32:
+        return 32;
+    case WEB100_TYPE_OCTET:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+#ifndef WEB100_CACHE_DIR
+#define WEB100_CACHE_DIR    "/var/cache/web100/"
+#endif
+
+/*
+ * Groups and variables are not allocated individually.  Parsing a header
+ * compiles it into an image: one block holding a web100_image followed by
+ * all group and variable records and their name indexes.  The image holds
+ * no pointers, only byte offsets from its base, so it can be written to the
+ * cache directory and later mapped read-only and shared by many processes.
+ *
+ * Every record knows its own offset ("self"), which leads back to the base
+ * of the image.  The word just before the base is private to the process
+ * and points at the agent that owns the image.
+ *
+ * Each group's vars sit together in one array, live ones first in order of
+ * offset and deprecated ones after them.  The var_head list still runs in
+ * reverse header order, as it always has.  The header text comes last, so
+ * a cached image can be checked against the header it stands for, and an
+ * agent can hand it on (see web100-wire.c).
+ */
+#define WEB100_IMAGE_MAGIC    0x57313030      /* "W100" */
+#define WEB100_IMAGE_LAYOUT   4
+
+struct web100_image {
+    u_int32_t  magic;
+    u_int32_t  layout;            /* WEB100_IMAGE_LAYOUT */
+    u_int64_t  hash;              /* of the header text */
+    u_int32_t  size;              /* of the whole image, in bytes */
+    int        ngroups;
+    int        nvars;
+    int        group_head;        /* first group in list order */
+    int        spec;              /* the "spec" group, kept off the list */
+    int        var_index;         /* name index of all listed vars */
+    int        nvar_index;        /* slots in it */
+    int        header;            /* the header text itself, NUL-terminated */
+    int        header_len;
+    char       version[WEB100_VERSTR_LEN_MAX];
+};
+
+#define IMAGE_PTR(base, off)  ((off) ? (void *)((char *)(base) + (off)) : NULL)
+#define IMAGE_BASE(rec)       ((char *)(rec) - (rec)->self)
+#define IMAGE_AGENT(base)     (((struct web100_agent **)(base))[-1])
+
+#define GROUP_AGENT(gp)       IMAGE_AGENT(IMAGE_BASE(gp))
+#define GROUP_NEXT(gp)        ((struct web100_group *)IMAGE_PTR(IMAGE_BASE(gp), (gp)->next))
+#define GROUP_VAR_HEAD(gp)    ((struct web100_var *)IMAGE_PTR(IMAGE_BASE(gp), (gp)->var_head))
+#define GROUP_VAR_ARRAY(gp)   ((struct web100_var *)(IMAGE_BASE(gp) + (gp)->var_array))
+#define GROUP_DELTA_RUNS(gp)  ((int *)(IMAGE_BASE(gp) + (gp)->delta_runs))
+#define GROUP_INDEX(gp)       ((int *)IMAGE_PTR(IMAGE_BASE(gp), (gp)->var_index))
+#define VAR_GROUP(vp)         ((struct web100_group *)(IMAGE_BASE(vp) + (vp)->group))
+#define VAR_AGENT(vp)         GROUP_AGENT(VAR_GROUP(vp))
+#define VAR_NEXT(vp)          ((struct web100_var *)IMAGE_PTR(IMAGE_BASE(vp), (vp)->next))
+
 struct web100_agent_info_local {
-    struct web100_group*      group_head;
+    struct web100_image*      image;
     struct web100_connection* connection_head;
-    struct web100_group*      spec;
+    size_t                    mapped;     /* length of our mapping, 0 if malloc'd */
+    unsigned char*            dep_warned; /* bitmap by var id */
+    struct web100_replay*     replay;     /* of a log played back, or NULL */
 };
 
 struct web100_agent {
@@ -65,24 +157,28 @@ struct web100_agent {
     } info;
 };
 
-struct web100_group_info_local {
-    struct web100_var*   var_head;
-    struct web100_group* next;
-};
+#define AGENT_GROUP_HEAD(agent) \
+    ((struct web100_group *)IMAGE_PTR((agent)->info.local.image, (agent)->info.local.image->group_head))
+#define AGENT_SPEC(agent) \
+    ((struct web100_group *)IMAGE_PTR((agent)->info.local.image, (agent)->info.local.image->spec))
+#define AGENT_HEADER(agent) \
+    ((const char *)(agent)->info.local.image + (agent)->info.local.image->header)
 
 struct web100_group {
     char                 name[WEB100_GROUPNAME_LEN_MAX];
     int                  size;
     int                  nvars;
-    struct web100_agent* agent;
-    
-    union {
-        struct web100_group_info_local local;
-    } info;
-};
-
-struct web100_var_info_local {
-    struct web100_var*   next;
+    int                  nlive;       /* nvars less the deprecated ones */
+    int                  self;
+    int                  id;          /* position in the header */
+    int                  next;
+    int                  var_head;
+    int                  var_array;   /* the group's vars, by offset */
+    int                  var_index;   /* name index of the group's vars */
+    int                  nvar_index;  /* slots in it */
+    int                  delta_runs;  /* (offset, count, index) counter runs */
+    int                  ndelta32;    /* COUNTER32 runs, which come first */
+    int                  ndelta64;    /* COUNTER64 runs */
 };
 
 struct web100_var {
@@ -90,18 +186,17 @@ struct web100_var {
     int                  type;
     int                  offset;
     int                  len;
-    struct web100_group* group;
+    int                  self;
+    int                  id;          /* position in the image */
+    int                  group;
+    int                  next;
     int                  flags;
 #define WEB100_VAR_FL_DEP    1
-#define WEB100_VAR_FL_WARNED 2
-    
-    union {
-        struct web100_var_info_local local;
-    } info;
 };
 
 struct web100_connection_info_local {
     struct web100_connection    *next;
+    int                         index;      /* its number in a log being read */
 };
 
 struct web100_connection {
@@ -122,10 +217,220 @@ struct web100_connection {
     } info;
 };
 
-struct web100_snapshot {
-    struct web100_group*      group;
-    struct web100_connection* connection;
-    void*                     data;
+/*
+ * A snapshot of one group for every connection, taken together.  Slot i
+ * holds snaps[i], whose connection is the private copy conns[i] and whose
+ * data is the i'th group-sized piece of data.  Slots are sorted by cid.
+ */
+struct web100_snapset {
+    struct web100_group*       group;
+    int                        count;
+    int                        alloc;
+    struct web100_snapshot*    snaps;
+    struct web100_connection*  conns;
+    char*                      data;
+};
+
+/*
+ * Smoothing state for rows of nvals values, one row per connection in cid
+ * order.  ewma has count rows; ring has window slots of alloc rows each,
+ * with the next sweep going into slot head.  The s* arrays are the spare
+ * set that smoother_remap() fills and swaps in when the connections change.
+ * conns holds each row's connection, where the caller gave them, to tell a
+ * reused cid from the connection that had it.
+ * out[] holds the window statistics, indexed by WEB100_SMOOTH; out[0] is
+ * not used.
+ */
+struct web100_smoother {
+    int                        nvals;
+    float                      weight;
+    int                        window;
+    int                        head;
+
+    int                        count;
+    int                        alloc;
+    int*                       cids;
+    struct web100_connection*  conns;
+    float*                     ewma;
+    float*                     ring;
+
+    int                        salloc;
+    int*                       scids;
+    struct web100_connection*  sconns;
+    float*                     sewma;
+    float*                     sring;
+
+    int                        oalloc;
+    float*                     out[4];
+};
+
+/*
+ * Sketch buckets: bucket 0 for values under SKETCH_LOW, then SKETCH_SUB
+ * for each power of two from 2^SKETCH_EXP_MIN to 2^SKETCH_EXP_MAX.  See
+ * web100-sketch.c.
+ */
+#define SKETCH_SUB_BITS            6
+#define SKETCH_SUB                 (1 << SKETCH_SUB_BITS)
+#define SKETCH_EXP_MIN             (-16)
+#define SKETCH_EXP_MAX             63
+#define SKETCH_LOW                 (1.0 / 65536)
+#define SKETCH_NBUCKETS            (1 + (SKETCH_EXP_MAX - SKETCH_EXP_MIN + 1) * SKETCH_SUB)
+
+struct web100_sketch {
+    u_int64_t                  count;
+    double                     sum;
+    double                     min;
+    double                     max;
+    u_int64_t                  buckets[SKETCH_NBUCKETS];
+};
+
+/*
+ * 64-bit counter totals of one connection, at the variables' indexes, and
+ * the data of the snapshot they were last updated from.
+ */
+struct web100_counters {
+    struct web100_group*       group;
+    int                        cid;
+    struct web100_connection   conn;        /* of the first update, if any */
+    int                        started;
+    char*                      prev;
+    u_int64_t*                 totals;
+};
+
+/* A min-heap of count of the k largest entries offered so far */
+struct web100_topk_entry {
+    double                     value;
+    int                        cid;
+};
+
+struct web100_topk {
+    int                        k;
+    int                        count;
+    struct web100_topk_entry*  heap;
+};
+
+/*
+ * Wire frames (see web100-wire.c).  Every frame starts with a
+ * web100_wire_frame and is a multiple of 8 bytes long.  A schema frame
+ * carries a header's text; a record frame a web100_wire_record and then
+ * the group's data.
+ */
+#define WEB100_WIRE_MAGIC          0x57314600      /* "W1F\0" */
+#define WEB100_WIRE_SCHEMA         1
+#define WEB100_WIRE_RECORD         2
+
+struct web100_wire_frame {
+    u_int32_t                  magic;
+    u_int32_t                  length;      /* of the whole frame */
+    u_int32_t                  type;
+    u_int32_t                  group;       /* its id, in a record */
+    u_int64_t                  schema;      /* fingerprint of the header */
+};
+
+struct web100_wire_record {
+    int32_t                    cid;
+    u_int32_t                  addrtype;
+    u_int64_t                  time_mono;
+    u_int64_t                  time_wall;
+    u_int16_t                  local_port;
+    u_int16_t                  rem_port;
+    u_int32_t                  pad;
+    char                       local_addr[16];
+    char                       rem_addr[16];
+};
+
+/* A decoder: the headers seen so far, and the connection of the last record */
+struct web100_wire_schema {
+    u_int64_t                  id;
+    struct web100_agent*       agent;
+    struct web100_group**      groups;      /* by id */
+    int                        ngroups;
+};
+
+struct web100_wire {
+    int                        count;
+    int                        alloc;
+    struct web100_wire_schema* schemas;
+    struct web100_connection   conn;
+};
+
+/*
+ * Log frames (see web100-log.c).  A version 2 log is a schema frame, a log
+ * frame, sample and delta frames, and at close an index frame and a trailer
+ * frame; all but the schema frame name the log's group.  A log of many
+ * connections has a connection frame before the first record of each, and
+ * a table of them all ahead of the trailer.  A segment of a log after the
+ * first starts with a schema reference frame in place of the schema frame,
+ * naming the first segment, which has it.  A delta frame is varints: the
+ * connection's number, in a log of many the distance back to the frame of
+ * its record before (in units of 8 bytes), the count of changed words, the
+ * zigzag deltas of the two times, and then a gap and zigzag delta for each
+ * word.
+ */
+#define WEB100_LOG_VERSION         2
+
+#define WEB100_WIRE_LOG            3
+#define WEB100_WIRE_SAMPLE         4
+#define WEB100_WIRE_INDEX          5       /* group is the count of entries */
+#define WEB100_WIRE_TRAILER        6
+#define WEB100_WIRE_DELTA          7
+#define WEB100_WIRE_CONN           8       /* group is the connection's number */
+#define WEB100_WIRE_CONNS          9       /* group is the count of entries */
+#define WEB100_WIRE_SCHEMA_REF     10      /* group is the length of the name */
+
+#define WEB100_LOG_MULTI           0x1     /* in head.flags */
+#define WEB100_LOG_NEWCONN         0x1     /* in sample.flags, in the ring only */
+
+struct web100_log_head {
+    u_int32_t                  version;
+    u_int32_t                  flags;
+    struct web100_wire_record  conn;        /* and the times it was opened */
+};
+
+struct web100_log_sample {
+    u_int64_t                  time_mono;
+    u_int64_t                  time_wall;
+    u_int32_t                  conn;        /* its number in the log */
+    u_int32_t                  flags;
+};
+
+/* One entry for each sample frame, the keyframes of any deltas */
+struct web100_log_index {
+    u_int64_t                  offset;      /* of the sample frame */
+    u_int64_t                  record;      /* its number in the log */
+    u_int64_t                  time_mono;
+    u_int64_t                  time_wall;
+    u_int32_t                  conn;
+    u_int32_t                  pad;
+};
+
+struct web100_log_trailer {
+    u_int64_t                  index;       /* offset of the index frame */
+    u_int64_t                  count;       /* of records */
+    u_int64_t                  conns;       /* offset of the table, or 0 */
+};
+
+/*
+ * A connection of a log: as written in its connection frame, with its
+ * cid, spec and the times of its first record, and the record of it last
+ * written or read, which the next delta is from.
+ */
+struct web100_log_conn {
+    struct web100_wire_record      rec;
+    struct web100_connection*      connection;  /* of a log being read */
+    int                            seg;         /* its number in the segment, or < 0 */
+    u_int64_t                      off;         /* of its last frame written */
+    u_int64_t                      records;
+    char*                          prev;
+    const char*                    last;
+    u_int64_t                      prev_mono;
+    u_int64_t                      prev_wall;
+};
+
+/* The number the caller has given each connection written, by cid */
+struct web100_log_key {
+    struct web100_wire_record      rec;         /* without its times */
+    int                            id;          /* < 0 if empty */
 };
 
 struct web100_log {
@@ -134,6 +439,213 @@ struct web100_log {
     struct web100_connection*      connection; 
     time_t                         time;
     FILE*                          fp;
+    int                            version;
+    int                            eof;
+    u_int64_t                      offset;      /* of the next frame written */
+    u_int64_t                      records;
+    struct web100_log_index*       index;       /* of the samples written */
+    int                            count;
+    int                            alloc;
+    int                            keyint;      /* records per keyframe */
+    unsigned char*                 buf;         /* a delta frame */
+    int                            flags;       /* of the head */
+    struct web100_log_conn*        conns;
+    int                            nconns;
+    int                            conns_alloc;
+    int*                           segconns;    /* those in the segment, by number */
+    int                            nsegconns;
+    int                            segconns_alloc;
+    struct web100_log_key*         keys;        /* hashed on cid */
+    int                            nkeys;       /* connections numbered */
+    int                            keys_size;
+    int                            cur;         /* connection of the last record read */
+    int                            filter;      /* the only one read, or < 0 */
+    char*                          map;         /* of a log being read */
+    size_t                         maplen;
+    int                            mapped;
+    size_t                         pos;         /* of the next frame read */
+    size_t                         first;       /* of the first record */
+    u_int64_t                      recno;       /* of the next record read */
+    u_int64_t                      lastrec;     /* of the last */
+    int                            held;        /* the last is to be read again */
+    int                            indexed;
+    const char**                   chain;       /* deltas back to a keyframe */
+    int                            chain_alloc;
+    int                            fsync_ms;    /* < 0 never, 0 every batch */
+    int                            unsynced;
+    u_int64_t                      synced;      /* when, monotonic ns */
+
+    /* Written in segments: the log's name, its limits, and the segments */
+    char*                          name;
+    struct web100_log_head         start;       /* of each segment's log frame */
+    u_int64_t                      max_bytes;
+    int                            max_secs;
+    struct web100_log_segment*     segs;        /* those finished; names unset */
+    int                            nsegs;
+    int                            segs_alloc;
+    struct web100_log_segment      seg;         /* the one being written */
+
+    /* Written asynchronously: a ring the caller fills and a thread drains */
+    char*                          ring;
+    int                            slots;
+    int                            stride;
+    int                            policy;
+    u_int64_t                      head;        /* slots filled, by the caller */
+    u_int64_t                      tail;        /* slots drained, by the thread */
+    u_int64_t                      dropped;
+    int                            waiting;     /* the thread, for a slot to fill */
+    int                            blocked;     /* the caller, for a slot to drain */
+    int                            stop;
+    int                            error;       /* the thread's first */
+    char*                          batch;
+    size_t                         nbatch;
+    pthread_t                      thread;
+    pthread_mutex_t                lock;
+    pthread_cond_t                 nonempty;
+    pthread_cond_t                 nonfull;
+};
+
+/*
+ * A merge of logs (see web100-merge.c): the next records of each read
+ * ahead, and a heap of the logs by the time of the first of those.
+ */
+struct web100_merge_input {
+    char*                          name;
+    struct web100_log*             log;         /* or NULL, while closed */
+    u_int64_t                      recno;       /* of the next record in the file */
+    int                            eof;
+    int*                           conns;       /* the file's connections, as the merge's */
+    char*                          data;        /* records read ahead */
+    u_int64_t*                     mono;
+    u_int64_t*                     wall;
+    int*                           conn;
+    int                            next;        /* the first of them not yet merged */
+    int                            count;
+    u_int64_t                      used;        /* when last read, to close the least */
 };
 
+struct web100_log_merge {
+    struct web100_agent*           agent;       /* of the merged records */
+    struct web100_group*           group;
+    struct web100_merge_input*     inputs;
+    int                            ninputs;
+    int*                           heap;        /* of inputs, by time */
+    int                            nheap;
+    int                            last;        /* input of the record last read, or < 0 */
+    int                            eof;         /* none left to read */
+    int                            maxopen;
+    int*                           opened;      /* the inputs open */
+    int                            nopen;
+    int                            ahead;       /* records read ahead of each */
+    u_int64_t                      clock;
+    struct web100_connection**     conns;
+    int                            nconns;
+    int                            conns_alloc;
+    struct web100_log_key*         keys;        /* hashed on cid and spec */
+    int                            keys_size;
+};
+
+/*
+ * Columnar files (see web100-columns.c): each column's values back to
+ * back, 8-aligned, and then a footer of a head, the columns and the
+ * connections, found through a tail at the very end of the file.
+ */
+#define WEB100_COLUMNS_MAGIC       0x57314300      /* "W1C\0" */
+#define WEB100_COLUMNS_VERSION     1
+
+#define WEB100_COLUMNS_RAW         0               /* the values as they are */
+#define WEB100_COLUMNS_VARINT      1               /* zigzag varints of their changes */
+
+struct web100_columns_head {
+    u_int32_t                  magic;
+    u_int32_t                  version;
+    u_int64_t                  rows;
+    u_int32_t                  ncols;
+    u_int32_t                  nconns;
+    u_int64_t                  schema;      /* fingerprint of the header */
+    char                       group[WEB100_GROUPNAME_LEN_MAX];
+};
+
+struct web100_columns_col {
+    char                       name[WEB100_VARNAME_LEN_MAX];
+    u_int32_t                  type;
+    u_int32_t                  size;        /* of a value */
+    u_int32_t                  encoding;
+    u_int32_t                  pad;
+    u_int64_t                  offset;
+    u_int64_t                  length;
+};
+
+struct web100_columns_connrec {
+    struct web100_wire_record  rec;         /* with the times of its first row */
+    u_int64_t                  first;
+    u_int64_t                  rows;
+};
+
+struct web100_columns_tail {
+    u_int64_t                  footer;      /* offset */
+    u_int32_t                  magic;
+    u_int32_t                  length;      /* of the footer */
+};
+
+struct web100_columns {
+    char*                          map;
+    size_t                         maplen;
+    int                            mapped;
+    struct web100_columns_head     head;
+    const struct web100_columns_col* cols;  /* in the mapping */
+    void**                         decoded;     /* of varint columns, as read */
+    struct web100_columns_conn*    conns;
+};
+
+/*
+ * A log played back (see web100-replay.c): the latest record reached of
+ * each of its connections, by their numbers in the log, and the record
+ * read ahead, not yet reached.
+ */
+struct web100_replay_conn {
+    int                            cid;
+    int                            gone;        /* its last handed out */
+    u_int64_t                      records;     /* in the log */
+    u_int64_t                      reached;
+    u_int64_t                      time_mono;   /* of the latest */
+    u_int64_t                      time_wall;
+    char*                          data;
+};
+
+struct web100_replay {
+    struct web100_log*             log;
+    double                         speed;       /* 0: a record each snap */
+    u_int64_t                      real0;       /* CLOCK_MONOTONIC when the speed was set, or 0 */
+    u_int64_t                      virt0;       /* and the replay's time then */
+    u_int64_t                      now;         /* the replay's time, as last read */
+    web100_snapshot                next;
+    int                            next_conn;
+    int                            held;        /* the record last reached, at speed 0, not yet snapped */
+    int                            eof;
+    struct web100_replay_conn*     conns;       /* by info.local.index */
+    int                            nconns;
+};
+
+/* web100-snapset.c */
+int           _web100_same_connection(const web100_connection* _a, const web100_connection* _b);
+
+/* web100-replay.c */
+web100_agent* _web100_agent_attach_replay(const char* _logname);
+void          _web100_replay_free(web100_agent* _agent);
+int           _web100_replay_refresh(web100_agent* _agent, int _cid);
+int           _web100_replay_snap(web100_snapshot* _snap);
+int           _web100_replay_raw_read(web100_var* _var, web100_connection* _conn, void* _buf);
+
+/* web100-merge.c */
+int           _web100_log_merge_conn(web100_log_merge* _merge);
+
+/* web100-header.c */
+u_int64_t     _web100_hash(const void* _buf, size_t _len);
+char*         _web100_read_all(int _fd, size_t* _lenp);
+web100_agent* _web100_agent_attach_header(const char* _buf, size_t _len, int _cache);
+web100_var*   _web100_index_find(char* _base, const int* _idx, int _size, const char* _name);
+void          _web100_agent_free(web100_agent* _agent);
+double        _web100_get_double(const web100_snapshot* _snap, const web100_accessor* _acc);
+
 #endif /* _WEB100_INT_H */
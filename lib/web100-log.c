@@ -0,0 +1,2396 @@
+/*
+ * Copyright (c) 2001 Carnegie Mellon University,
+ *                    The Board of Trustees of the University of Illinois,
+ *                    and University Corporation for Atmospheric Research.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ *
+ * Log files: snapshots of one group, of one connection or of many, kept
+ * on disk.
+ *
+ * A version 2 log is a run of wire frames (see web100-wire.c): the schema
+ * frame of the agent's header, a log frame naming the group and the
+ * connection, one sample frame per snapshot with its times and data, and,
+ * once the log is closed, an index frame with the offset and times of every
+ * sample and a fixed-size trailer frame pointing back at the index.  A log
+ * cut short by a crash has no index, but its samples still read in order.
+ *
+ * A log opened without a connection takes snapshots of any connection of
+ * the agent, numbering each the first time it is seen: a connection frame
+ * with its cid, spec and the times of that first snapshot goes out once,
+ * ahead of its records, and every record after carries just the number.
+ * At close a table of all the connections goes ahead of the trailer, so a
+ * reader learns them without a pass over the records.
+ *
+ * With web100_log_set_rotate, the log is written as a run of segments,
+ * each a log of its own, the next begun when the one being written grows
+ * too large or spans too long.  Only the first carries the header; the
+ * others refer to it by name and fingerprint.  Connections and delta runs
+ * start afresh in each.  A manifest beside the segments, rewritten as each
+ * is begun and finished, lists them with the times they span.
+ *
+ * With web100_log_set_delta, only every so many records is written whole,
+ * as a keyframe; those between are delta frames, holding the group's data
+ * as 32-bit words that differ from the record before, each as the gap
+ * from the last changed word and the zigzag varint of its difference.
+ * Counters that move by small amounts between samples, and the many
+ * variables that do not move at all, so cost a few bytes a record.  The
+ * index lists the keyframes only.  Each connection of a log of many has
+ * its own run of keyframes and deltas, so the records of one can be read
+ * without decoding the others'; each delta also carries the distance
+ * back to its connection's frame before, so a reader that lands in the
+ * middle of a run can follow it back to its keyframe.
+ *
+ * web100_log_seek_record and web100_log_seek_time find the last keyframe
+ * before the record sought with a binary search of the index, and decode
+ * forward from it.
+ *
+ * Version 1 logs, a NUL-terminated copy of the header, a text marker, the
+ * time, group name and connection spec, and then each snapshot behind a
+ * text marker of its own, are still read.
+ *
+ * Logs are read from a private read-only mapping of the file (or a copy of
+ * it in memory, when it cannot be mapped): the header is compiled straight
+ * from it, and web100_log_read hands out snapshots whose data points into
+ * it, so scanning a log copies nothing but the words a delta changes.
+ */
+
+#define _GNU_SOURCE                 /* fallocate */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "web100-int.h"
+
+#define ALIGN8(x)  (((x) + 7) & ~(size_t)7)
+
+#define END_OF_HEADER_MARKER "----End-Of-Header---- -1 -1"
+#define BEGIN_SNAP_DATA      "----Begin-Snap-Data----"
+#define WEB100_LOG_CID      -1       /* A dummy CID  */
+
+#define WEB100_LOG_BATCH    (256 * 1024)   /* bytes written at once, when asynchronous */
+
+#define MANIFEST_MAGIC       "web100-log-manifest 1"
+
+#define ROTATING(log)        ((log)->max_bytes || (log)->max_secs)
+
+#define SAMPLE_HEAD  (sizeof (struct web100_wire_frame) + sizeof (struct web100_log_sample))
+
+static const char zeros[8];
+
+
+static u_int64_t
+log_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u_int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+static int
+write_all(int fd, const char *buf, size_t len)
+{
+    ssize_t n;
+
+    while (len > 0) {
+        if ((n = write(fd, buf, len)) < 0) {
+            if (errno == EINTR)
+                continue;
+            web100_errno = WEB100_ERR_FILE;
+            return -WEB100_ERR_FILE;
+        }
+        buf += n;
+        len -= n;
+    }
+    return WEB100_ERR_SUCCESS;
+}
+
+
+/*
+ * log_flush - Hand what has been written to a log to the kernel.
+ */
+static int
+log_flush(web100_log *log)
+{
+    int err = WEB100_ERR_SUCCESS;
+
+    if (log->fp == NULL)
+        return err;                 /* a segment could not be begun */
+    if (log->batch) {
+        err = write_all(fileno(log->fp), log->batch, log->nbatch);
+        log->nbatch = 0;
+    } else if (fflush(log->fp) != 0) {
+        web100_errno = WEB100_ERR_FILE;
+        err = -WEB100_ERR_FILE;
+    }
+    return err;
+}
+
+
+/*
+ * log_put - Write to a log being written, keeping count of its offset.  A
+ * log written asynchronously collects its writes in a batch of its own.
+ */
+static int
+log_put(web100_log *log, const void *buf, size_t len)
+{
+    if (log->batch) {
+        if (log->nbatch + len > WEB100_LOG_BATCH &&
+            log_flush(log) != WEB100_ERR_SUCCESS)
+            return -WEB100_ERR_FILE;
+        if (len > WEB100_LOG_BATCH) {
+            if (write_all(fileno(log->fp), buf, len) != WEB100_ERR_SUCCESS)
+                return -WEB100_ERR_FILE;
+        } else {
+            memcpy(log->batch + log->nbatch, buf, len);
+            log->nbatch += len;
+        }
+    } else if (len && fwrite(buf, len, 1, log->fp) != 1) {
+        web100_errno = WEB100_ERR_FILE;
+        return -WEB100_ERR_FILE;
+    }
+    log->offset += len;
+    log->unsynced = 1;
+    return WEB100_ERR_SUCCESS;
+}
+
+
+/*
+ * log_sync - fsync a log, if its policy says it is time to.
+ */
+static int
+log_sync(web100_log *log)
+{
+    int msec = __atomic_load_n(&log->fsync_ms, __ATOMIC_RELAXED);
+    u_int64_t now;
+
+    if (msec < 0 || !log->unsynced || log->fp == NULL)
+        return WEB100_ERR_SUCCESS;
+    now = log_now();
+    if (msec > 0 && now - log->synced < (u_int64_t)msec * 1000000)
+        return WEB100_ERR_SUCCESS;
+
+    if (log_flush(log) != WEB100_ERR_SUCCESS)
+        return -WEB100_ERR_FILE;
+    if (fsync(fileno(log->fp)) != 0) {
+        web100_errno = WEB100_ERR_FILE;
+        return -WEB100_ERR_FILE;
+    }
+    log->synced = now;
+    log->unsynced = 0;
+    return WEB100_ERR_SUCCESS;
+}
+
+
+/*
+ * Varints, seven bits a byte, least significant first; zigzag maps signed
+ * differences near zero onto small unsigned ones.
+ */
+static unsigned char*
+put_varint(unsigned char *p, u_int64_t v)
+{
+    while (v >= 0x80) {
+        *p++ = (v & 0x7f) | 0x80;
+        v >>= 7;
+    }
+    *p++ = v;
+    return p;
+}
+
+
+static int
+get_varint(const unsigned char **pp, const unsigned char *end, u_int64_t *vp)
+{
+    const unsigned char *p = *pp;
+    u_int64_t v = 0;
+    int shift;
+
+    for (shift = 0; p < end && shift < 64; shift += 7) {
+        v |= (u_int64_t)(*p & 0x7f) << shift;
+        if ((*p++ & 0x80) == 0) {
+            *pp = p;
+            *vp = v;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+#define ZIGZAG(d)    (((u_int64_t)(d) << 1) ^ (u_int64_t)((int64_t)(d) >> 63))
+#define UNZIGZAG(v)  ((int64_t)((v) >> 1) ^ -(int64_t)((v) & 1))
+
+
+/* The i'th 32-bit word of a group's data, a short last one padded out */
+static u_int32_t
+word_get(const char *data, int i, int size)
+{
+    u_int32_t w = 0;
+
+    if (4*i + 4 <= size)
+        memcpy(&w, data + 4*i, 4);
+    else
+        memcpy(&w, data + 4*i, size - 4*i);
+    return w;
+}
+
+
+static void
+word_put(char *data, int i, int size, u_int32_t w)
+{
+    if (4*i + 4 <= size)
+        memcpy(data + 4*i, &w, 4);
+    else
+        memcpy(data + 4*i, &w, size - 4*i);
+}
+
+
+static void
+log_frame(struct web100_wire_frame *frame, web100_log *log, int type, size_t len)
+{
+    frame->magic = WEB100_WIRE_MAGIC;
+    frame->length = len;
+    frame->type = type;
+    frame->group = log->group->id;
+    frame->schema = GROUP_AGENT(log->group)->info.local.image->hash;
+}
+
+
+/*
+ * log_conn_rec - A connection's cid and spec, as a log keeps them; and
+ * log_conn_spec, back again.
+ */
+static void
+log_conn_rec(struct web100_wire_record *rec, web100_connection *conn)
+{
+    memset(rec, 0, sizeof (*rec));
+    rec->cid = conn->cid;
+    rec->addrtype = conn->addrtype;
+    if (conn->addrtype != WEB100_ADDRTYPE_IPV6) {
+        memcpy(rec->local_addr, &conn->spec.src_addr, 4);
+        memcpy(rec->rem_addr, &conn->spec.dst_addr, 4);
+        rec->local_port = conn->spec.src_port;
+        rec->rem_port = conn->spec.dst_port;
+    } else {
+        memcpy(rec->local_addr, conn->spec_v6.src_addr, 16);
+        memcpy(rec->rem_addr, conn->spec_v6.dst_addr, 16);
+        rec->local_port = conn->spec_v6.src_port;
+        rec->rem_port = conn->spec_v6.dst_port;
+    }
+}
+
+
+static void
+log_conn_spec(web100_connection *cp, const struct web100_wire_record *rec)
+{
+    cp->cid = rec->cid;
+    cp->addrtype = rec->addrtype;
+    if (rec->addrtype != WEB100_ADDRTYPE_IPV6) {
+        memcpy(&cp->spec.src_addr, rec->local_addr, 4);
+        memcpy(&cp->spec.dst_addr, rec->rem_addr, 4);
+        cp->spec.src_port = rec->local_port;
+        cp->spec.dst_port = rec->rem_port;
+    } else {
+        memcpy(cp->spec_v6.src_addr, rec->local_addr, 16);
+        memcpy(cp->spec_v6.dst_addr, rec->rem_addr, 16);
+        cp->spec_v6.src_port = rec->local_port;
+        cp->spec_v6.dst_port = rec->rem_port;
+    }
+}
+
+
+static struct web100_log_conn*
+log_conn_new(web100_log *log)
+{
+    struct web100_log_conn *lc;
+    int n;
+
+    if (log->nconns == log->conns_alloc) {
+        n = log->conns_alloc ? 2 * log->conns_alloc : 16;
+        if ((lc = realloc(log->conns, n * sizeof (*lc))) == NULL) {
+            web100_errno = WEB100_ERR_NOMEM;
+            return NULL;
+        }
+        log->conns = lc;
+        log->conns_alloc = n;
+    }
+    lc = &log->conns[log->nconns];
+    memset(lc, 0, sizeof (*lc));
+    return lc;
+}
+
+
+/*
+ * log_addconn - Number the next connection of a log being written.
+ */
+static int
+log_addconn(web100_log *log, const struct web100_wire_record *rec)
+{
+    struct web100_log_conn *lc;
+
+    if ((lc = log_conn_new(log)) == NULL)
+        return -WEB100_ERR_NOMEM;
+    lc->rec = *rec;
+    lc->seg = -1;
+    log->nconns++;
+
+    return WEB100_ERR_SUCCESS;
+}
+
+
+/*
+ * log_declare - Number a connection in the segment being written, before
+ * its first record there, writing its connection frame if the log is of
+ * many connections.
+ */
+static int
+log_declare(web100_log *log, int id)
+{
+    struct {
+        struct web100_wire_frame frame;
+        struct web100_wire_record rec;
+    } cf;
+    struct web100_log_conn *lc = &log->conns[id];
+    int *segconns, n;
+
+    if (log->nsegconns == log->segconns_alloc) {
+        n = log->segconns_alloc ? 2 * log->segconns_alloc : 16;
+        if ((segconns = realloc(log->segconns, n * sizeof (int))) == NULL) {
+            web100_errno = WEB100_ERR_NOMEM;
+            return -WEB100_ERR_NOMEM;
+        }
+        log->segconns = segconns;
+        log->segconns_alloc = n;
+    }
+    lc->seg = log->nsegconns;
+    log->segconns[log->nsegconns++] = id;
+
+    if (log->flags & WEB100_LOG_MULTI) {
+        log_frame(&cf.frame, log, WEB100_WIRE_CONN, sizeof (cf));
+        cf.frame.group = lc->seg;
+        cf.rec = lc->rec;
+        if (log_put(log, &cf, sizeof (cf)) != WEB100_ERR_SUCCESS)
+            return -WEB100_ERR_FILE;
+    }
+
+    return WEB100_ERR_SUCCESS;
+}
+
+
+/*
+ * log_key - Find the key of a connection in a log being written, by its
+ * cid: the key numbering it, or else an empty key, or the key of an
+ * earlier connection whose cid it has been given, for it to take over.
+ */
+static struct web100_log_key*
+log_key(web100_log *log, const struct web100_wire_record *rec)
+{
+    struct web100_log_key *keys, *k;
+    int i, j, n;
+
+    if (2 * (log->nkeys + 1) > log->keys_size) {
+        n = log->keys_size ? 2 * log->keys_size : 64;
+        if ((keys = malloc(n * sizeof (*keys))) == NULL) {
+            web100_errno = WEB100_ERR_NOMEM;
+            return NULL;
+        }
+        for (i = 0; i < n; i++)
+            keys[i].id = -1;
+        for (j = 0; j < log->keys_size; j++) {
+            if (log->keys[j].id < 0)
+                continue;
+            for (i = ((u_int32_t)log->keys[j].rec.cid * 2654435761u) & (n - 1);
+                 keys[i].id >= 0; i = (i + 1) & (n - 1))
+                ;
+            keys[i] = log->keys[j];
+        }
+        free(log->keys);
+        log->keys = keys;
+        log->keys_size = n;
+    }
+
+    for (i = ((u_int32_t)rec->cid * 2654435761u) & (log->keys_size - 1);
+         ; i = (i + 1) & (log->keys_size - 1)) {
+        k = &log->keys[i];
+        if (k->id < 0 || k->rec.cid == rec->cid)
+            return k;
+    }
+}
+
+
+web100_log*
+web100_log_open_write(char *logname, web100_connection *conn,
+		      web100_group *group)
+{
+    struct {
+        struct web100_wire_frame frame;
+        struct web100_log_head head;
+    } open;
+    struct web100_wire_record *rec = &open.head.conn;
+    struct timespec ts;
+    char *schema = NULL;
+    int len;
+
+    web100_log *log = NULL;
+
+    if (conn && GROUP_AGENT(group) != conn->agent) {
+       	web100_errno = WEB100_ERR_INVAL;
+	goto Cleanup;
+    }
+
+    if ((log = (web100_log *)calloc(1, sizeof (web100_log))) == NULL) {
+        web100_errno = WEB100_ERR_NOMEM;
+	goto Cleanup;
+    }
+
+    log->group       = group;
+    log->connection  = conn;
+    log->version     = WEB100_LOG_VERSION;
+    log->flags       = conn ? 0 : WEB100_LOG_MULTI;
+    log->fsync_ms    = -1;
+
+    if ((log->name = strdup(logname)) == NULL) {
+        web100_errno = WEB100_ERR_NOMEM;
+        goto Cleanup;
+    }
+
+    if((log->fp = fopen(logname, "w")) == NULL) {
+	web100_errno = WEB100_ERR_FILE;
+	goto Cleanup;
+    }
+
+    //
+    // The header the agent was built from, as a schema frame
+    //
+    len = web100_wire_encode_schema(GROUP_AGENT(group), NULL, 0);
+    if ((schema = malloc(len)) == NULL) {
+        web100_errno = WEB100_ERR_NOMEM;
+        goto Cleanup;
+    }
+    web100_wire_encode_schema(GROUP_AGENT(group), schema, len);
+    if (log_put(log, schema, len) != WEB100_ERR_SUCCESS)
+        goto Cleanup;
+
+    //
+    // The group, the connection (none, in a log of many), and when the
+    // log was opened
+    //
+    memset(&open, 0, sizeof (open));
+    log_frame(&open.frame, log, WEB100_WIRE_LOG, sizeof (open));
+    open.head.version = WEB100_LOG_VERSION;
+    open.head.flags = log->flags;
+
+    if (conn)
+        log_conn_rec(rec, conn);
+    else
+        rec->cid = -1;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    rec->time_mono = (u_int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    rec->time_wall = (u_int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    log->time = ts.tv_sec;
+
+    if (log_put(log, &open, sizeof (open)) != WEB100_ERR_SUCCESS)
+        goto Cleanup;
+    log->start = open.head;
+    log->seg.open = 1;
+
+    /* The one connection is the log frame's, and has no frame of its own */
+    if (conn && (log_addconn(log, rec) != WEB100_ERR_SUCCESS ||
+                 log_declare(log, 0) != WEB100_ERR_SUCCESS))
+        goto Cleanup;
+
+    web100_errno = WEB100_ERR_SUCCESS;
+
+Cleanup:
+    free(schema);
+
+    if(web100_errno != WEB100_ERR_SUCCESS) {
+	if(log) {
+	    if(log->fp)
+	       	fclose(log->fp);
+	    free(log->conns);
+	    free(log->segconns);
+	    free(log->name);
+	    free(log);
+       	}
+       	return NULL;
+    }
+
+    return log;
+}
+
+/*@
+web100_log_set_delta - write a log's records as deltas between keyframes
+@*/
+int
+web100_log_set_delta(web100_log *log, int keyint)
+{
+    int size = log->group->size;
+    int len = sizeof (struct web100_wire_frame) + 5*10 + (size + 3) / 4 * 10 + 8;
+
+    if (keyint < 0 || log->ring) {
+        web100_errno = WEB100_ERR_INVAL;
+        return -WEB100_ERR_INVAL;
+    }
+
+    if (keyint > 1 && log->buf == NULL && (log->buf = malloc(len)) == NULL) {
+        web100_errno = WEB100_ERR_NOMEM;
+        return -WEB100_ERR_NOMEM;
+    }
+    log->keyint = keyint;
+
+    web100_errno = WEB100_ERR_SUCCESS;
+    return WEB100_ERR_SUCCESS;
+}
+
+
+/*
+ * Segments.  The n'th segment of a log is its name with ".n" to six
+ * digits, and its manifest the name with ".manifest".
+ */
+static void
+log_seg_name(char *buf, size_t size, const char *logname, int n)
+{
+    snprintf(buf, size, "%s.%06d", logname, n);
+}
+
+
+static const char*
+log_basename(const char *path)
+{
+    const char *p = strrchr(path, '/');
+
+    return p ? p + 1 : path;
+}
+
+
+/*
+ * log_prealloc - Reserve the space of a segment to be written, so it is
+ * laid out in one piece; the rest is given back when it is finished.
+ * Not every filesystem can, so this is only a hint.
+ */
+static void
+log_prealloc(web100_log *log)
+{
+#ifdef HAVE_FALLOCATE
+    if (log->max_bytes)
+        fallocate(fileno(log->fp), FALLOC_FL_KEEP_SIZE, 0, log->max_bytes);
+#endif
+}
+
+
+/*
+ * log_finish - End the segment being written, or the whole log, with the
+ * index of its samples, the table of its connections if it is of many,
+ * and the trailer that finds them, and close it.
+ */
+static int
+log_finish(web100_log *log)
+{
+    struct {
+        struct web100_wire_frame frame;
+        struct web100_log_trailer trailer;
+    } end;
+    struct web100_wire_frame frame, table;
+    int err = WEB100_ERR_SUCCESS;
+    int i;
+
+    memset(&end, 0, sizeof (end));
+    end.trailer.index = log->offset;
+    end.trailer.count = log->records;
+
+    log_frame(&frame, log, WEB100_WIRE_INDEX,
+              sizeof (frame) + log->count * sizeof (struct web100_log_index));
+    frame.group = log->count;
+    log_frame(&table, log, WEB100_WIRE_CONNS,
+              sizeof (table) + log->nsegconns * sizeof (struct web100_wire_record));
+    table.group = log->nsegconns;
+    if (log->flags & WEB100_LOG_MULTI)
+        end.trailer.conns = end.trailer.index + frame.length;
+    log_frame(&end.frame, log, WEB100_WIRE_TRAILER, sizeof (end));
+
+    if (log_put(log, &frame, sizeof (frame)) != WEB100_ERR_SUCCESS ||
+        log_put(log, log->index, log->count * sizeof (struct web100_log_index)) != WEB100_ERR_SUCCESS)
+        err = -WEB100_ERR_FILE;
+    if (err == WEB100_ERR_SUCCESS && (log->flags & WEB100_LOG_MULTI)) {
+        if (log_put(log, &table, sizeof (table)) != WEB100_ERR_SUCCESS)
+            err = -WEB100_ERR_FILE;
+        for (i = 0; i < log->nsegconns && err == WEB100_ERR_SUCCESS; i++)
+            if (log_put(log, &log->conns[log->segconns[i]].rec,
+                        sizeof (struct web100_wire_record)) != WEB100_ERR_SUCCESS)
+                err = -WEB100_ERR_FILE;
+    }
+    if (err != WEB100_ERR_SUCCESS ||
+        log_put(log, &end, sizeof (end)) != WEB100_ERR_SUCCESS ||
+        log_flush(log) != WEB100_ERR_SUCCESS ||
+        (log->max_bytes && ftruncate(fileno(log->fp), log->offset) != 0) ||
+        (__atomic_load_n(&log->fsync_ms, __ATOMIC_RELAXED) >= 0 && fsync(fileno(log->fp)) != 0)) {
+        web100_errno = WEB100_ERR_FILE;
+        err = -WEB100_ERR_FILE;
+    }
+
+    if(fclose(log->fp) != 0) {
+	web100_errno = WEB100_ERR_FILE;
+	err = -WEB100_ERR_FILE;
+    }
+    log->fp = NULL;
+
+    return err;
+}
+
+
+/*
+ * log_manifest_write - Replace the manifest of a log written in segments
+ * with one listing them all, and the one being written, if any, last.
+ */
+static int
+log_manifest_write(web100_log *log)
+{
+    char path[PATH_MAX], tmp[PATH_MAX], seg[PATH_MAX];
+    struct web100_log_segment *sp;
+    FILE *fp;
+    int i, err = WEB100_ERR_SUCCESS;
+
+    snprintf(path, sizeof (path), "%s.manifest", log->name);
+    snprintf(tmp, sizeof (tmp), "%s.manifest.tmp", log->name);
+    if ((fp = fopen(tmp, "w")) == NULL) {
+        web100_errno = WEB100_ERR_FILE;
+        return -WEB100_ERR_FILE;
+    }
+
+    fprintf(fp, "%s\n", MANIFEST_MAGIC);
+    for (i = 0; i < log->nsegs + log->seg.open; i++) {
+        sp = i < log->nsegs ? &log->segs[i] : &log->seg;
+        log_seg_name(seg, sizeof (seg), log->name, i);
+        fprintf(fp, "%s %s %llu %llu %llu %llu %llu\n", log_basename(seg),
+                sp->open ? "open" : "closed", (unsigned long long)sp->records,
+                (unsigned long long)sp->first_wall, (unsigned long long)sp->last_wall,
+                (unsigned long long)sp->first_mono, (unsigned long long)sp->last_mono);
+    }
+
+    if (fflush(fp) != 0 ||
+        (__atomic_load_n(&log->fsync_ms, __ATOMIC_RELAXED) >= 0 && fsync(fileno(fp)) != 0))
+        err = -WEB100_ERR_FILE;
+    if (fclose(fp) != 0 || err != WEB100_ERR_SUCCESS || rename(tmp, path) != 0) {
+        unlink(tmp);
+        web100_errno = WEB100_ERR_FILE;
+        return -WEB100_ERR_FILE;
+    }
+
+    return WEB100_ERR_SUCCESS;
+}
+
+
+/*
+ * log_seg_done - Add the segment just finished to those of the log.
+ */
+static int
+log_seg_done(web100_log *log)
+{
+    struct web100_log_segment *segs;
+    int n;
+
+    if (log->nsegs == log->segs_alloc) {
+        n = log->segs_alloc ? 2 * log->segs_alloc : 16;
+        if ((segs = realloc(log->segs, n * sizeof (*segs))) == NULL) {
+            web100_errno = WEB100_ERR_NOMEM;
+            return -WEB100_ERR_NOMEM;
+        }
+        log->segs = segs;
+        log->segs_alloc = n;
+    }
+    log->seg.open = 0;
+    log->segs[log->nsegs++] = log->seg;
+
+    return WEB100_ERR_SUCCESS;
+}
+
+
+/*
+ * log_rotate - Finish the segment being written and begin the next: its
+ * file, a reference to the header in the first segment, a log frame like
+ * the first's, and connections and delta runs started afresh.
+ */
+static int
+log_rotate(web100_log *log)
+{
+    struct {
+        struct web100_wire_frame frame;
+        struct web100_log_head head;
+    } open;
+    struct web100_wire_frame ref;
+    char path[PATH_MAX], first[PATH_MAX];
+    const char *base;
+    size_t len;
+    int i;
+
+    if (log_finish(log) != WEB100_ERR_SUCCESS ||
+        log_seg_done(log) != WEB100_ERR_SUCCESS)
+        return -web100_errno;
+
+    log_seg_name(path, sizeof (path), log->name, log->nsegs);
+    if ((log->fp = fopen(path, "w")) == NULL) {
+        web100_errno = WEB100_ERR_FILE;
+        return -WEB100_ERR_FILE;
+    }
+    log_prealloc(log);
+
+    log->offset = 0;
+    log->records = 0;
+    log->count = 0;
+    memset(&log->seg, 0, sizeof (log->seg));
+    log->seg.open = 1;
+    log->nsegconns = 0;
+    for (i = 0; i < log->nconns; i++) {
+        log->conns[i].seg = -1;
+        log->conns[i].last = NULL;
+        log->conns[i].records = 0;
+    }
+
+    log_seg_name(first, sizeof (first), log->name, 0);
+    base = log_basename(first);
+    len = strlen(base);
+    log_frame(&ref, log, WEB100_WIRE_SCHEMA_REF, sizeof (ref) + ALIGN8(len));
+    ref.group = len;
+
+    memset(&open, 0, sizeof (open));
+    log_frame(&open.frame, log, WEB100_WIRE_LOG, sizeof (open));
+    open.head = log->start;
+
+    if (log_put(log, &ref, sizeof (ref)) != WEB100_ERR_SUCCESS ||
+        log_put(log, base, len) != WEB100_ERR_SUCCESS ||
+        log_put(log, zeros, ALIGN8(len) - len) != WEB100_ERR_SUCCESS ||
+        log_put(log, &open, sizeof (open)) != WEB100_ERR_SUCCESS)
+        return -WEB100_ERR_FILE;
+
+    if (!(log->flags & WEB100_LOG_MULTI) && log_declare(log, 0) != WEB100_ERR_SUCCESS)
+        return -web100_errno;
+
+    return log_manifest_write(log);
+}
+
+
+/*
+ * log_delta - Encode a snapshot as a delta frame from the record before of
+ * its connection, returning its length, or 0 if it would be no shorter
+ * than a sample frame.
+ */
+static int
+log_delta(web100_log *log, int id, web100_snapshot *snap)
+{
+    struct web100_log_conn *lc = &log->conns[id];
+    struct web100_wire_frame *frame = (struct web100_wire_frame *)log->buf;
+    int size = snap->group->size;
+    int nwords = (size + 3) / 4;
+    unsigned char *p;
+    u_int32_t w0, w1;
+    int i, last = -1, count = 0, len;
+
+    for (i = 0; i < nwords; i++)
+        if (word_get(lc->prev, i, size) != word_get(snap->data, i, size))
+            count++;
+
+    p = log->buf + sizeof (*frame);
+    p = put_varint(p, lc->seg);
+    if (log->flags & WEB100_LOG_MULTI)
+        p = put_varint(p, (log->offset - lc->off) / 8);
+    p = put_varint(p, count);
+    p = put_varint(p, ZIGZAG(snap->time_mono - lc->prev_mono));
+    p = put_varint(p, ZIGZAG(snap->time_wall - lc->prev_wall));
+    for (i = 0; i < nwords; i++) {
+        w0 = word_get(lc->prev, i, size);
+        w1 = word_get(snap->data, i, size);
+        if (w0 == w1)
+            continue;
+        p = put_varint(p, i - last - 1);
+        p = put_varint(p, ZIGZAG((int32_t)(w1 - w0)));
+        last = i;
+    }
+
+    len = ALIGN8(p - log->buf);
+    if (len >= SAMPLE_HEAD + ALIGN8(size))
+        return 0;
+    memset(p, 0, log->buf + len - p);
+    log_frame(frame, log, WEB100_WIRE_DELTA, len);
+
+    return len;
+}
+
+/*
+ * log_record - Write a snapshot of a log's id'th connection as a sample or
+ * delta frame; for a log written asynchronously, this is done on the
+ * writer thread.
+ */
+static int
+log_record(web100_log *log, int id, web100_snapshot *snap)
+{
+    struct {
+        struct web100_wire_frame frame;
+        struct web100_log_sample sample;
+    } head;
+    struct web100_log_conn *lc = &log->conns[id];
+    struct web100_log_index *ent;
+    int size = snap->group->size;
+    u_int64_t off;
+    int n;
+
+    //
+    // Begin the next segment if this record would take the one being
+    // written past its limits
+    //
+    if (log->records > 0 &&
+        ((log->max_bytes && log->offset + SAMPLE_HEAD + ALIGN8(size) > log->max_bytes) ||
+         (log->max_secs && snap->time_mono - log->seg.first_mono >= (u_int64_t)log->max_secs * 1000000000)) &&
+        log_rotate(log) != WEB100_ERR_SUCCESS)
+        return -web100_errno;
+
+    if (lc->seg < 0 && log_declare(log, id) != WEB100_ERR_SUCCESS)
+        return -web100_errno;
+    off = log->offset;
+
+    if (log->keyint > 1 && lc->prev == NULL && (lc->prev = malloc(size)) == NULL) {
+        web100_errno = WEB100_ERR_NOMEM;
+        return -WEB100_ERR_NOMEM;
+    }
+
+    /* A delta needs the record before, which changing keyint may not have kept */
+    if (log->keyint > 1 && lc->records % log->keyint != 0 && lc->last &&
+        (n = log_delta(log, id, snap)) > 0) {
+        if (log_put(log, log->buf, n) != WEB100_ERR_SUCCESS)
+            return -WEB100_ERR_FILE;
+    } else {
+        if (log->count == log->alloc) {
+            n = log->alloc ? 2 * log->alloc : 1024;
+            if ((ent = realloc(log->index, n * sizeof (*ent))) == NULL) {
+                web100_errno = WEB100_ERR_NOMEM;
+                return -WEB100_ERR_NOMEM;
+            }
+            log->index = ent;
+            log->alloc = n;
+        }
+        ent = &log->index[log->count];
+        ent->offset = off;
+        ent->record = log->records;
+        ent->time_mono = snap->time_mono;
+        ent->time_wall = snap->time_wall;
+        ent->conn = lc->seg;
+        ent->pad = 0;
+
+        log_frame(&head.frame, log, WEB100_WIRE_SAMPLE, SAMPLE_HEAD + ALIGN8(size));
+        head.sample.time_mono = snap->time_mono;
+        head.sample.time_wall = snap->time_wall;
+        head.sample.conn = lc->seg;
+        head.sample.flags = 0;
+
+        if (log_put(log, &head, sizeof (head)) != WEB100_ERR_SUCCESS ||
+            log_put(log, snap->data, size) != WEB100_ERR_SUCCESS ||
+            log_put(log, zeros, ALIGN8(size) - size) != WEB100_ERR_SUCCESS)
+            return -WEB100_ERR_FILE;
+        log->count++;
+    }
+
+    if (log->keyint > 1) {
+        memcpy(lc->prev, snap->data, size);
+        lc->last = lc->prev;
+        lc->prev_mono = snap->time_mono;
+        lc->prev_wall = snap->time_wall;
+    } else {
+        lc->last = NULL;
+    }
+    lc->off = off;
+    lc->records++;
+
+    if (log->records++ == 0) {
+        log->seg.first_mono = snap->time_mono;
+        log->seg.first_wall = snap->time_wall;
+    }
+    log->seg.last_mono = snap->time_mono;
+    log->seg.last_wall = snap->time_wall;
+    log->seg.records = log->records;
+
+    return WEB100_ERR_SUCCESS;
+}
+
+/*
+ * Asynchronous writing.  The caller copies each snapshot's times and data
+ * into the next slot of a ring, and a writer thread drains the ring,
+ * encoding the records and writing them out in large batches.  Only the
+ * caller advances head, and only the thread tail, so while each keeps up
+ * with the other neither takes a lock; the mutex and conditions are there
+ * for the thread to sleep on an empty ring, and the caller on a full one.
+ * The caller numbers the connections of a log of many, and hands the
+ * thread each new one in a slot of its own, ahead of its first record.
+ */
+#define WEB100_LOG_LINGER  200      /* ms to hold a partial batch */
+
+
+/*
+ * log_fail - Remember the first error of the writer thread, for the caller.
+ */
+static void
+log_fail(web100_log *log)
+{
+    int err = 0;
+
+    __atomic_compare_exchange_n(&log->error, &err, web100_errno ? web100_errno : WEB100_ERR_FILE,
+                                0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+
+static void*
+log_writer(void *arg)
+{
+    web100_log *log = arg;
+    web100_snapshot snap;
+    struct web100_log_sample sample;
+    struct web100_wire_record rec;
+    struct timespec ts;
+    u_int64_t tail = 0;
+    char *slot;
+    int msec, idle, stop;
+
+    snap.group = log->group;
+    snap.connection = log->connection;
+
+    for (;;) {
+        if (__atomic_load_n(&log->head, __ATOMIC_SEQ_CST) == tail) {
+            //
+            // Nothing queued: sleep, holding a partial batch or an fsync
+            // that is due only for so long
+            //
+            idle = stop = 0;
+            pthread_mutex_lock(&log->lock);
+            __atomic_store_n(&log->waiting, 1, __ATOMIC_SEQ_CST);
+            while (__atomic_load_n(&log->head, __ATOMIC_SEQ_CST) == tail &&
+                   !(stop = log->stop) && !idle) {
+                msec = __atomic_load_n(&log->fsync_ms, __ATOMIC_RELAXED);
+                if (log->nbatch > 0 || (msec >= 0 && log->unsynced)) {
+                    if (msec <= 0 || msec > WEB100_LOG_LINGER)
+                        msec = WEB100_LOG_LINGER;
+                    clock_gettime(CLOCK_REALTIME, &ts);
+                    ts.tv_sec += msec / 1000;
+                    ts.tv_nsec += (msec % 1000) * 1000000;
+                    if (ts.tv_nsec >= 1000000000) {
+                        ts.tv_sec++;
+                        ts.tv_nsec -= 1000000000;
+                    }
+                    idle = pthread_cond_timedwait(&log->nonempty, &log->lock, &ts) != 0;
+                } else {
+                    pthread_cond_wait(&log->nonempty, &log->lock);
+                }
+            }
+            __atomic_store_n(&log->waiting, 0, __ATOMIC_SEQ_CST);
+            pthread_mutex_unlock(&log->lock);
+
+            if (idle || stop) {
+                if (log_flush(log) != WEB100_ERR_SUCCESS ||
+                    log_sync(log) != WEB100_ERR_SUCCESS)
+                    log_fail(log);
+            }
+            if (stop && __atomic_load_n(&log->head, __ATOMIC_SEQ_CST) == tail)
+                break;
+            continue;
+        }
+
+        //
+        // Write out what is queued, freeing each slot as it goes
+        //
+        while (__atomic_load_n(&log->head, __ATOMIC_SEQ_CST) != tail) {
+            slot = log->ring + (tail % log->slots) * log->stride;
+            memcpy(&sample, slot, sizeof (sample));
+            if (sample.flags & WEB100_LOG_NEWCONN) {
+                memcpy(&rec, slot + sizeof (sample), sizeof (rec));
+                if (!log->error && log_addconn(log, &rec) != WEB100_ERR_SUCCESS)
+                    log_fail(log);
+            } else {
+                snap.time_mono = sample.time_mono;
+                snap.time_wall = sample.time_wall;
+                snap.data = slot + sizeof (sample);
+                if (!log->error && log_record(log, sample.conn, &snap) != WEB100_ERR_SUCCESS)
+                    log_fail(log);
+            }
+
+            __atomic_store_n(&log->tail, ++tail, __ATOMIC_SEQ_CST);
+            if (__atomic_load_n(&log->blocked, __ATOMIC_SEQ_CST) &&
+                __atomic_load_n(&log->head, __ATOMIC_SEQ_CST) - tail <= log->slots / 2) {
+                pthread_mutex_lock(&log->lock);
+                pthread_cond_signal(&log->nonfull);
+                pthread_mutex_unlock(&log->lock);
+            }
+        }
+        if (!log->error && log_sync(log) != WEB100_ERR_SUCCESS)
+            log_fail(log);
+    }
+
+    return NULL;
+}
+
+
+/*
+ * log_slot - The slot at the head of the ring of a log written
+ * asynchronously, after waiting for room if the ring is full and the
+ * policy is to block; or NULL if it is full.
+ */
+static char*
+log_slot(web100_log *log)
+{
+    u_int64_t head = log->head;
+
+    if (head - __atomic_load_n(&log->tail, __ATOMIC_SEQ_CST) == log->slots) {
+        if (log->policy != WEB100_LOG_BLOCK)
+            return NULL;
+        /* Wait for half the ring, not a slot at a time */
+        pthread_mutex_lock(&log->lock);
+        __atomic_store_n(&log->blocked, 1, __ATOMIC_SEQ_CST);
+        while (head - __atomic_load_n(&log->tail, __ATOMIC_SEQ_CST) > log->slots / 2)
+            pthread_cond_wait(&log->nonfull, &log->lock);
+        __atomic_store_n(&log->blocked, 0, __ATOMIC_SEQ_CST);
+        pthread_mutex_unlock(&log->lock);
+    }
+
+    return log->ring + (head % log->slots) * log->stride;
+}
+
+
+/* log_push - Hand the slot at the head of the ring to the writer thread */
+static void
+log_push(web100_log *log)
+{
+    __atomic_store_n(&log->head, log->head + 1, __ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&log->waiting, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&log->lock);
+        pthread_cond_signal(&log->nonempty);
+        pthread_mutex_unlock(&log->lock);
+    }
+}
+
+
+/*
+ * log_enqueue - Copy a snapshot of a log's id'th connection into the ring
+ * of a log written asynchronously, the connection's record first if it is
+ * new, dropping the snapshot or waiting for room if the ring is full.
+ */
+static int
+log_enqueue(web100_log *log, int id, const struct web100_wire_record *rec,
+            web100_snapshot *snap)
+{
+    struct web100_log_sample sample;
+    char *slot;
+    int err;
+
+    if ((err = __atomic_load_n(&log->error, __ATOMIC_SEQ_CST)) != 0) {
+        web100_errno = err;
+        return -err;
+    }
+
+    sample.time_mono = snap->time_mono;
+    sample.time_wall = snap->time_wall;
+    sample.conn = id;
+
+    if (rec) {
+        if (log->policy != WEB100_LOG_BLOCK &&
+            log->slots - (int)(log->head - __atomic_load_n(&log->tail, __ATOMIC_SEQ_CST)) < 2)
+            goto Drop;
+        if ((slot = log_slot(log)) == NULL)
+            goto Drop;
+        sample.flags = WEB100_LOG_NEWCONN;
+        memcpy(slot, &sample, sizeof (sample));
+        memcpy(slot + sizeof (sample), rec, sizeof (*rec));
+        log_push(log);
+    }
+
+    if ((slot = log_slot(log)) == NULL)
+        goto Drop;
+    sample.flags = 0;
+    memcpy(slot, &sample, sizeof (sample));
+    memcpy(slot + sizeof (sample), snap->data, log->group->size);
+    log_push(log);
+
+    web100_errno = WEB100_ERR_SUCCESS;
+    return WEB100_ERR_SUCCESS;
+
+ Drop:
+    __atomic_add_fetch(&log->dropped, 1, __ATOMIC_RELAXED);
+    web100_errno = WEB100_ERR_FULL;
+    return -WEB100_ERR_FULL;
+}
+
+
+/*@
+web100_log_set_async - write a log from a thread of its own
+@*/
+int
+web100_log_set_async(web100_log *log, int slots, int policy)
+{
+    /* A new connection's first snapshot takes two slots */
+    if (slots < 2 || log->ring || log->fp == NULL ||
+        (policy != WEB100_LOG_DROP && policy != WEB100_LOG_BLOCK)) {
+        web100_errno = WEB100_ERR_INVAL;
+        return -WEB100_ERR_INVAL;
+    }
+
+    if (fflush(log->fp) != 0) {
+        web100_errno = WEB100_ERR_FILE;
+        return -WEB100_ERR_FILE;
+    }
+
+    /* A slot holds a snapshot's data, or a new connection's record */
+    log->stride = ALIGN8(sizeof (struct web100_log_sample) +
+                         (log->group->size > sizeof (struct web100_wire_record) ?
+                          log->group->size : sizeof (struct web100_wire_record)));
+    log->slots = slots;
+    log->policy = policy;
+    log->head = log->tail = 0;
+    if ((log->ring = malloc((size_t)slots * log->stride)) == NULL ||
+        (log->batch = malloc(WEB100_LOG_BATCH)) == NULL)
+        goto Fail;
+
+    pthread_mutex_init(&log->lock, NULL);
+    pthread_cond_init(&log->nonempty, NULL);
+    pthread_cond_init(&log->nonfull, NULL);
+    if (pthread_create(&log->thread, NULL, log_writer, log) != 0) {
+        pthread_mutex_destroy(&log->lock);
+        pthread_cond_destroy(&log->nonempty);
+        pthread_cond_destroy(&log->nonfull);
+        goto Fail;
+    }
+
+    web100_errno = WEB100_ERR_SUCCESS;
+    return WEB100_ERR_SUCCESS;
+
+ Fail:
+    free(log->ring);
+    free(log->batch);
+    log->ring = NULL;
+    log->batch = NULL;
+    web100_errno = WEB100_ERR_NOMEM;
+    return -WEB100_ERR_NOMEM;
+}
+
+
+/*@
+web100_log_set_fsync - set how often a log is synced to disk
+@*/
+int
+web100_log_set_fsync(web100_log *log, int msec)
+{
+    __atomic_store_n(&log->fsync_ms, msec < 0 ? -1 : msec, __ATOMIC_RELAXED);
+
+    web100_errno = WEB100_ERR_SUCCESS;
+    return WEB100_ERR_SUCCESS;
+}
+
+
+/*@
+web100_log_set_rotate - write a log as segments of limited size or span
+@*/
+int
+web100_log_set_rotate(web100_log *log, u_int64_t bytes, int secs)
+{
+    char path[PATH_MAX];
+
+    if (secs < 0 || (bytes == 0 && secs == 0) || ROTATING(log) || log->ring ||
+        log->fp == NULL) {
+        web100_errno = WEB100_ERR_INVAL;
+        return -WEB100_ERR_INVAL;
+    }
+
+    /* What has been written so far is the first segment */
+    log_seg_name(path, sizeof (path), log->name, 0);
+    if (rename(log->name, path) != 0) {
+        web100_errno = WEB100_ERR_FILE;
+        return -WEB100_ERR_FILE;
+    }
+    log->max_bytes = bytes;
+    log->max_secs = secs;
+    log_prealloc(log);
+
+    if (log_manifest_write(log) != WEB100_ERR_SUCCESS)
+        return -web100_errno;
+
+    web100_errno = WEB100_ERR_SUCCESS;
+    return WEB100_ERR_SUCCESS;
+}
+
+
+int
+web100_log_close_write(web100_log *log)
+{
+    int err = WEB100_ERR_SUCCESS;
+    int i;
+
+    //
+    // Let the writer thread finish what is queued
+    //
+    if (log->ring) {
+        pthread_mutex_lock(&log->lock);
+        log->stop = 1;
+        pthread_cond_signal(&log->nonempty);
+        pthread_mutex_unlock(&log->lock);
+        pthread_join(log->thread, NULL);
+
+        pthread_mutex_destroy(&log->lock);
+        pthread_cond_destroy(&log->nonempty);
+        pthread_cond_destroy(&log->nonfull);
+        free(log->ring);
+        log->ring = NULL;
+
+        if (log->error) {
+            web100_errno = log->error;
+            err = -log->error;
+        }
+    }
+
+    //
+    // The index, connections and trailer; and, for a log written in
+    // segments, the manifest, with the last of them finished
+    //
+    if (log->fp && log_finish(log) != WEB100_ERR_SUCCESS)
+        err = -web100_errno;
+    if (ROTATING(log) &&
+        (log_seg_done(log) != WEB100_ERR_SUCCESS ||
+         log_manifest_write(log) != WEB100_ERR_SUCCESS))
+        err = -web100_errno;
+
+    for (i = 0; i < log->nconns; i++)
+        free(log->conns[i].prev);
+    free(log->conns);
+    free(log->segconns);
+    free(log->keys);
+    free(log->segs);
+    free(log->name);
+    free(log->index);
+    free(log->batch);
+    free(log->buf);
+    free(log);
+    return err;
+}
+
+int
+web100_log_write(web100_log *log, web100_snapshot *snap)
+{
+    struct web100_wire_record rec, first;
+    struct web100_log_key *key;
+    int id, err;
+
+    /* An asynchronous log's errors are its writer thread's to report */
+    if(log->ring == NULL && log->fp == NULL) {
+	web100_errno = WEB100_ERR_FILE;
+	return -WEB100_ERR_FILE;
+    }
+
+    if(log->group != snap->group) {
+	web100_errno = WEB100_ERR_INVAL;
+	return -WEB100_ERR_INVAL;
+    }
+
+    if (!(log->flags & WEB100_LOG_MULTI)) {
+        if(log->connection->spec.dst_port != snap->connection->spec.dst_port ||
+           log->connection->spec.dst_addr != snap->connection->spec.dst_addr ||
+           log->connection->spec.src_port != snap->connection->spec.src_port) {
+
+            web100_errno = WEB100_ERR_INVAL;
+            return -WEB100_ERR_INVAL;
+        }
+        id = 0;
+    } else {
+        //
+        // Number the connection the first time it is seen; a cid the
+        // kernel has given a new connection numbers that one from then on
+        //
+        if (snap->connection == NULL) {
+            web100_errno = WEB100_ERR_INVAL;
+            return -WEB100_ERR_INVAL;
+        }
+        log_conn_rec(&rec, snap->connection);
+        if ((key = log_key(log, &rec)) == NULL)
+            return -web100_errno;
+
+        if (key->id < 0 || memcmp(&key->rec, &rec, sizeof (rec)) != 0) {
+            first = rec;
+            first.time_mono = snap->time_mono;
+            first.time_wall = snap->time_wall;
+            id = log->nkeys;
+            if (log->ring)
+                err = log_enqueue(log, id, &first, snap);
+            else
+                err = log_addconn(log, &first);
+            if (err != WEB100_ERR_SUCCESS)
+                return err;
+            key->rec = rec;
+            key->id = log->nkeys++;
+            if (log->ring)
+                return WEB100_ERR_SUCCESS;
+        } else {
+            id = key->id;
+        }
+    }
+
+    if (log->ring)
+        return log_enqueue(log, id, NULL, snap);
+
+    if ((err = log_record(log, id, snap)) != WEB100_ERR_SUCCESS ||
+        (err = log_sync(log)) != WEB100_ERR_SUCCESS)
+        return err;
+
+    return WEB100_ERR_SUCCESS;
+}
+
+
+/*
+ * log_map - Map a log to read, or read it all in if it cannot be mapped.
+ */
+static int
+log_map(web100_log *log, const char *logname)
+{
+    struct stat st;
+    void *map;
+    int fd;
+
+    if ((fd = open(logname, O_RDONLY)) < 0) {
+        web100_errno = WEB100_ERR_FILE;
+        return -WEB100_ERR_FILE;
+    }
+
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 &&
+        (map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) != MAP_FAILED) {
+        madvise(map, st.st_size, MADV_SEQUENTIAL);
+        log->map = map;
+        log->maplen = st.st_size;
+        log->mapped = 1;
+    } else {
+        log->map = _web100_read_all(fd, &log->maplen);
+    }
+    close(fd);
+
+    return log->map ? WEB100_ERR_SUCCESS : -web100_errno;
+}
+
+
+/*
+ * log_conn_read - Add a connection to a log being read, and to the end of
+ * its agent's list of connections.
+ */
+static int
+log_conn_read(web100_log *log, const struct web100_wire_record *rec)
+{
+    struct web100_log_conn *lc;
+    web100_connection *cp;
+
+    if ((lc = log_conn_new(log)) == NULL)
+        return -WEB100_ERR_NOMEM;
+    if ((cp = (web100_connection *)calloc(1, sizeof (web100_connection))) == NULL) {
+        web100_errno = WEB100_ERR_NOMEM;
+        return -WEB100_ERR_NOMEM;
+    }
+    cp->agent = log->agent;
+    cp->info.local.index = log->nconns;
+    log_conn_spec(cp, rec);
+
+    if (log->nconns == 0)
+        log->agent->info.local.connection_head = cp;
+    else
+        log->conns[log->nconns - 1].connection->info.local.next = cp;
+    lc->rec = *rec;
+    lc->connection = cp;
+    log->nconns++;
+
+    return WEB100_ERR_SUCCESS;
+}
+
+
+/*
+ * log_trailer - Find the trailer at the end of a log that was closed, and
+ * the frame of the given kind it points at (the index or connection
+ * table), returning the frame's offset, or 0 if there is none.
+ */
+static size_t
+log_trailer(web100_log *log, int type, struct web100_wire_frame *frame)
+{
+    struct {
+        struct web100_wire_frame frame;
+        struct web100_log_trailer trailer;
+    } end;
+    size_t pos, len = log->maplen - sizeof (end);
+
+    if (log->maplen - log->first < sizeof (end))
+        return 0;
+    memcpy(&end, log->map + len, sizeof (end));
+    if (end.frame.magic != WEB100_WIRE_MAGIC || end.frame.type != WEB100_WIRE_TRAILER ||
+        end.frame.length != sizeof (end))
+        return 0;
+
+    pos = type == WEB100_WIRE_INDEX ? end.trailer.index : end.trailer.conns;
+    if (pos < log->first || pos > len - sizeof (*frame))
+        return 0;
+    memcpy(frame, log->map + pos, sizeof (*frame));
+    if (frame->magic != WEB100_WIRE_MAGIC || frame->type != type ||
+        frame->length > len - pos)
+        return 0;
+    if (type == WEB100_WIRE_INDEX)
+        log->records = end.trailer.count;
+
+    return pos;
+}
+
+
+/*
+ * log_table_v2 - Read the connections of a log of many from the table
+ * ahead of its trailer; or, from a log cut short without one, out of the
+ * connection frames among its records.
+ */
+static int
+log_table_v2(web100_log *log)
+{
+    struct web100_wire_frame frame;
+    struct web100_wire_record rec;
+    size_t pos;
+    u_int32_t i;
+
+    if ((pos = log_trailer(log, WEB100_WIRE_CONNS, &frame)) != 0) {
+        if (frame.length != sizeof (frame) + (u_int64_t)frame.group * sizeof (rec)) {
+            web100_errno = WEB100_ERR_FILE;
+            return -WEB100_ERR_FILE;
+        }
+        for (i = 0; i < frame.group; i++) {
+            memcpy(&rec, log->map + pos + sizeof (frame) + i * sizeof (rec), sizeof (rec));
+            if (log_conn_read(log, &rec) != WEB100_ERR_SUCCESS)
+                return -web100_errno;
+        }
+        return WEB100_ERR_SUCCESS;
+    }
+
+    for (pos = log->pos; log->maplen - pos >= sizeof (frame); pos += frame.length) {
+        memcpy(&frame, log->map + pos, sizeof (frame));
+        if (frame.magic != WEB100_WIRE_MAGIC || frame.length < sizeof (frame) ||
+            frame.length > log->maplen - pos || frame.type == WEB100_WIRE_INDEX)
+            break;
+        if (frame.type != WEB100_WIRE_CONN)
+            continue;
+        if (frame.length != sizeof (frame) + sizeof (rec) || frame.group != log->nconns) {
+            web100_errno = WEB100_ERR_FILE;
+            return -WEB100_ERR_FILE;
+        }
+        memcpy(&rec, log->map + pos + sizeof (frame), sizeof (rec));
+        if (log_conn_read(log, &rec) != WEB100_ERR_SUCCESS)
+            return -web100_errno;
+    }
+
+    return WEB100_ERR_SUCCESS;
+}
+
+
+/*
+ * log_schema_ref - Compile the header a later segment of a log refers to,
+ * from the schema frame at the start of the first segment, which it names
+ * and which is in the same directory.
+ */
+static web100_agent*
+log_schema_ref(const char *logname, const struct web100_wire_frame *ref,
+               const char *name)
+{
+    struct web100_wire_frame frame;
+    web100_agent *agent = NULL;
+    const char *base = log_basename(logname);
+    size_t len = strlen(base);
+    char path[PATH_MAX];
+    char *text = NULL;
+    int fd;
+
+    /* The name of this log's first segment, and no other file */
+    if (ref->group != len || len < 7 || base[len - 7] != '.' ||
+        memcmp(name, base, len - 6) != 0 || memcmp(name + len - 6, "000000", 6) != 0) {
+        web100_errno = WEB100_ERR_HEADER;
+        return NULL;
+    }
+
+    snprintf(path, sizeof (path), "%.*s%.*s", (int)(base - logname), logname, (int)len, name);
+    if ((fd = open(path, O_RDONLY)) < 0) {
+        web100_errno = WEB100_ERR_FILE;
+        return NULL;
+    }
+
+    if (pread(fd, &frame, sizeof (frame), 0) != sizeof (frame) ||
+        frame.magic != WEB100_WIRE_MAGIC || frame.type != WEB100_WIRE_SCHEMA ||
+        frame.schema != ref->schema || frame.group > frame.length - sizeof (frame)) {
+        web100_errno = WEB100_ERR_HEADER;
+        goto Cleanup;
+    }
+    if ((text = malloc(frame.group)) == NULL) {
+        web100_errno = WEB100_ERR_NOMEM;
+        goto Cleanup;
+    }
+    if (pread(fd, text, frame.group, sizeof (frame)) != frame.group) {
+        web100_errno = WEB100_ERR_HEADER;
+        goto Cleanup;
+    }
+    agent = _web100_agent_attach_header(text, frame.group, 0);
+
+ Cleanup:
+    free(text);
+    close(fd);
+    return agent;
+}
+
+
+/*
+ * log_open_read_v2 - Parse the schema (or schema reference) and log frames
+ * at the start of a version 2 log, and learn its connections.
+ */
+static int
+log_open_read_v2(web100_log *log, const char *logname)
+{
+    struct web100_wire_frame frame;
+    struct web100_log_head head;
+    web100_group *gp;
+
+    //
+    // The schema frame, or in a later segment the reference to it
+    //
+    memcpy(&frame, log->map, sizeof (frame));
+    if ((frame.type != WEB100_WIRE_SCHEMA && frame.type != WEB100_WIRE_SCHEMA_REF) ||
+        frame.length > log->maplen || frame.length < sizeof (frame) ||
+        frame.group > frame.length - sizeof (frame)) {
+        web100_errno = WEB100_ERR_HEADER;
+        return -WEB100_ERR_HEADER;
+    }
+    if (frame.type == WEB100_WIRE_SCHEMA)
+        log->agent = _web100_agent_attach_header(log->map + sizeof (frame), frame.group, 0);
+    else
+        log->agent = log_schema_ref(logname, &frame, log->map + sizeof (frame));
+    if (log->agent == NULL)
+        return -web100_errno;
+    log->agent->type = WEB100_AGENT_TYPE_LOG;
+    log->pos = frame.length;
+
+    //
+    // The log frame
+    //
+    if (log->maplen - log->pos < sizeof (frame) + sizeof (head)) {
+        web100_errno = WEB100_ERR_FILE;
+        return -WEB100_ERR_FILE;
+    }
+    memcpy(&frame, log->map + log->pos, sizeof (frame));
+    memcpy(&head, log->map + log->pos + sizeof (frame), sizeof (head));
+    if (frame.magic != WEB100_WIRE_MAGIC || frame.type != WEB100_WIRE_LOG ||
+        frame.length != sizeof (frame) + sizeof (head)) {
+        web100_errno = WEB100_ERR_FILE;
+        return -WEB100_ERR_FILE;
+    }
+    if (head.version != WEB100_LOG_VERSION) {
+        web100_errno = WEB100_ERR_INVAL;
+        return -WEB100_ERR_INVAL;
+    }
+    log->pos += frame.length;
+    log->first = log->pos;
+
+    for (gp = AGENT_GROUP_HEAD(log->agent); gp; gp = GROUP_NEXT(gp))
+        if (gp->id == frame.group)
+            break;
+    if (gp == NULL) {
+        web100_errno = WEB100_ERR_NOGROUP;
+        return -WEB100_ERR_NOGROUP;
+    }
+
+    log->group = gp;
+    log->time = head.conn.time_wall / 1000000000;
+    log->version = head.version;
+    log->flags = head.flags;
+
+    //
+    // The one connection, in the log frame; or the many
+    //
+    if (!(log->flags & WEB100_LOG_MULTI)) {
+        if (log_conn_read(log, &head.conn) != WEB100_ERR_SUCCESS)
+            return -web100_errno;
+        log->connection = log->conns[0].connection;
+        return WEB100_ERR_SUCCESS;
+    }
+
+    return log_table_v2(log);
+}
+
+
+/*
+ * log_open_read_v1 - Parse the header, marker, time, group name and spec
+ * at the start of a version 1 log.
+ */
+static int
+log_open_read_v1(web100_log *log)
+{
+    char          group_name[WEB100_GROUPNAME_LEN_MAX];
+    struct web100_connection_spec spec;
+    struct web100_wire_record rec;
+    const char         *p, *end = log->map + log->maplen;
+    size_t             len = strlen(END_OF_HEADER_MARKER);
+
+    //
+    // The log starts with a NUL-terminated copy of the header
+    //
+    if ((p = memchr(log->map, '\0', log->maplen)) == NULL) {
+        web100_errno = WEB100_ERR_HEADER;
+        return -WEB100_ERR_HEADER;
+    }
+    if ((log->agent = _web100_agent_attach_header(log->map, p - log->map, 0)) == NULL)
+        return -web100_errno;
+    log->agent->type = WEB100_AGENT_TYPE_LOG;
+
+    p++;
+    if (end - p < len || memcmp(p, END_OF_HEADER_MARKER, len) != 0 ||
+        (p = memchr(p, '\n', end - p)) == NULL) {
+	web100_errno = WEB100_ERR_FILE;
+        return -WEB100_ERR_FILE;
+    }
+    p++;
+
+    if (end - p < sizeof (time_t) + WEB100_GROUPNAME_LEN_MAX +
+                  sizeof (struct web100_connection_spec)) {
+       	web100_errno = WEB100_ERR_FILE;
+        return -WEB100_ERR_FILE;
+    }
+    memcpy(&log->time, p, sizeof (time_t));
+    p += sizeof (time_t);
+    memcpy(group_name, p, WEB100_GROUPNAME_LEN_MAX);
+    group_name[WEB100_GROUPNAME_LEN_MAX - 1] = '\0';
+    p += WEB100_GROUPNAME_LEN_MAX;
+
+    //
+    // Define (dummy) connection with logged spec
+    //
+    memcpy(&spec, p, sizeof (spec));
+    p += sizeof (spec);
+    memset(&rec, 0, sizeof (rec));
+    rec.cid = WEB100_LOG_CID; //dummy
+    memcpy(rec.local_addr, &spec.src_addr, 4);
+    memcpy(rec.rem_addr, &spec.dst_addr, 4);
+    rec.local_port = spec.src_port;
+    rec.rem_port = spec.dst_port;
+    if (log_conn_read(log, &rec) != WEB100_ERR_SUCCESS)
+        return -web100_errno;
+
+    if ((log->group = web100_group_find(log->agent, group_name)) == NULL)
+        return -web100_errno;
+    log->connection = log->conns[0].connection;
+    log->version = 1;
+    log->pos = log->first = p - log->map;
+
+    return WEB100_ERR_SUCCESS;
+}
+
+web100_log*
+web100_log_open_read(char *logname)
+{
+    struct web100_wire_frame frame;
+    web100_log *log = NULL;
+
+    if ((log = (web100_log *)calloc(1, sizeof (web100_log))) == NULL) {
+        web100_errno = WEB100_ERR_NOMEM;
+	goto Cleanup;
+    }
+    log->filter = -1;
+
+    if (log_map(log, logname) != WEB100_ERR_SUCCESS)
+        goto Cleanup;
+
+    //
+    // A version 2 log starts with a frame; a version 1 log with text
+    //
+    if (log->maplen >= sizeof (frame) &&
+        (memcpy(&frame, log->map, sizeof (frame)), frame.magic == WEB100_WIRE_MAGIC)) {
+        if (log_open_read_v2(log, logname) != WEB100_ERR_SUCCESS)
+            goto Cleanup;
+    } else {
+        if (log_open_read_v1(log) != WEB100_ERR_SUCCESS)
+            goto Cleanup;
+    }
+
+    web100_errno = WEB100_ERR_SUCCESS;
+
+ Cleanup:
+
+    if (web100_errno != WEB100_ERR_SUCCESS) {
+        web100_log_close_read(log);
+	return NULL;
+    }
+
+    return log;
+}
+
+int
+web100_log_close_read(web100_log *log)
+{
+    int i;
+
+    if(log) {
+        if (log->mapped)
+            munmap(log->map, log->maplen);
+        else
+            free(log->map);
+	web100_detach(log->agent);   /* also frees the connections */
+        for (i = 0; i < log->nconns; i++)
+            free(log->conns[i].prev);
+        free(log->conns);
+        if (log->alloc)
+            free(log->index);       /* not the one in the mapping */
+        free(log->chain);
+       	free(log);
+    }
+
+    return WEB100_ERR_SUCCESS;
+}
+
+
+/*
+ * log_delta_head - Read the connection's number at the start of a delta
+ * frame's body, and in a log of many the distance back to the frame of
+ * its record before, leaving *qp at the rest.
+ */
+static int
+log_delta_head(web100_log *log, const unsigned char **qp, const unsigned char *end,
+               u_int64_t *idp, u_int64_t *backp)
+{
+    *backp = 0;
+    if (get_varint(qp, end, idp) != 0 ||
+        ((log->flags & WEB100_LOG_MULTI) && get_varint(qp, end, backp) != 0))
+        return -1;
+    return 0;
+}
+
+
+/*
+ * log_undelta - Apply a delta frame's body, after its head, to the last
+ * record read of its connection, building the new one in the
+ * connection's prev.
+ */
+static int
+log_undelta(web100_log *log, struct web100_log_conn *lc,
+            const unsigned char *p, const unsigned char *end)
+{
+    int size = log->group->size;
+    int nwords = (size + 3) / 4;
+    u_int64_t count, dmono, dwall, gap, delta;
+    int i = -1;
+
+    if (lc->prev == NULL && (lc->prev = malloc(size)) == NULL) {
+        web100_errno = WEB100_ERR_NOMEM;
+        return -WEB100_ERR_NOMEM;
+    }
+    if (lc->last != lc->prev) {
+        memcpy(lc->prev, lc->last, size);
+        lc->last = lc->prev;
+    }
+
+    if (get_varint(&p, end, &count) || get_varint(&p, end, &dmono) ||
+        get_varint(&p, end, &dwall))
+        goto Bad;
+
+    while (count--) {
+        if (get_varint(&p, end, &gap) || get_varint(&p, end, &delta) ||
+            gap >= nwords - i - 1)
+            goto Bad;
+        i += gap + 1;
+        word_put(lc->prev, i, size, word_get(lc->prev, i, size) + UNZIGZAG(delta));
+    }
+    lc->prev_mono += UNZIGZAG(dmono);
+    lc->prev_wall += UNZIGZAG(dwall);
+
+    return WEB100_ERR_SUCCESS;
+
+ Bad:
+    lc->last = NULL;
+    web100_errno = WEB100_ERR_INVAL;
+    return -WEB100_ERR_INVAL;
+}
+
+
+/*
+ * log_recover - Rebuild the record a delta frame at p of a connection of
+ * a log of many follows, when it was not read (the log was positioned
+ * past it, or the connection filtered out): follow the deltas' links back
+ * to the keyframe they run from, and apply them again from there.
+ * Returns 1 if the run cannot be followed.
+ */
+static int
+log_recover(web100_log *log, struct web100_log_conn *lc, u_int64_t id,
+            const char *p, u_int64_t back)
+{
+    struct web100_wire_frame frame;
+    struct web100_log_sample sample;
+    const unsigned char *q, *end;
+    const char **chain;
+    u_int64_t cid;
+    int n = 0, err;
+
+    for (;;) {
+        if (back == 0 || back > (u_int64_t)(p - (log->map + log->first)) / 8)
+            return 1;
+        p -= back * 8;
+        memcpy(&frame, p, sizeof (frame));
+        if (frame.magic != WEB100_WIRE_MAGIC || frame.group != log->group->id ||
+            frame.length < sizeof (frame) || frame.length > log->map + log->maplen - p)
+            return 1;
+        if (frame.type == WEB100_WIRE_SAMPLE) {
+            memcpy(&sample, p + sizeof (frame), sizeof (sample));
+            if (frame.length != SAMPLE_HEAD + ALIGN8(log->group->size) || sample.conn != id)
+                return 1;
+            break;
+        }
+        q = (const unsigned char *)p + sizeof (frame);
+        end = (const unsigned char *)p + frame.length;
+        if (frame.type != WEB100_WIRE_DELTA ||
+            log_delta_head(log, &q, end, &cid, &back) != 0 || cid != id)
+            return 1;
+
+        if (n == log->chain_alloc) {
+            int alloc = log->chain_alloc ? 2 * log->chain_alloc : 64;
+
+            if ((chain = realloc(log->chain, alloc * sizeof (*chain))) == NULL) {
+                web100_errno = WEB100_ERR_NOMEM;
+                return -WEB100_ERR_NOMEM;
+            }
+            log->chain = chain;
+            log->chain_alloc = alloc;
+        }
+        log->chain[n++] = p;
+    }
+
+    lc->last = p + SAMPLE_HEAD;
+    lc->prev_mono = sample.time_mono;
+    lc->prev_wall = sample.time_wall;
+    while (n-- > 0) {
+        memcpy(&frame, log->chain[n], sizeof (frame));
+        q = (const unsigned char *)log->chain[n] + sizeof (frame);
+        end = (const unsigned char *)log->chain[n] + frame.length;
+        log_delta_head(log, &q, end, &cid, &back);
+        if ((err = log_undelta(log, lc, q, end)) != WEB100_ERR_SUCCESS)
+            return err;
+    }
+
+    return WEB100_ERR_SUCCESS;
+}
+
+
+/*
+ * log_next_v2 - Find the next sample or delta frame, skipping frames of
+ * other kinds, and records of connections other than the one the log is
+ * filtered to; the index frame, or a frame cut short, ends the records.
+ * A sample's data is left where it is in the log; a delta's is built up
+ * in its connection's prev from the record before.  A connection whose
+ * records have been skipped is picked up again, in a log of many, by
+ * following its deltas back to their keyframe; in a log of one, only at
+ * its next keyframe.
+ */
+static int
+log_next_v2(web100_log *log)
+{
+    struct web100_wire_frame frame;
+    struct web100_log_sample sample;
+    struct web100_log_conn *lc;
+    int size = log->group->size;
+    const unsigned char *q, *end;
+    const char *p;
+    u_int64_t id, back = 0, rec;
+    int err;
+
+    for (;;) {
+        if (log->maplen - log->pos < sizeof (frame)) {
+            log->eof = 1;
+            return EOF;
+        }
+        p = log->map + log->pos;
+        memcpy(&frame, p, sizeof (frame));
+        if (frame.magic != WEB100_WIRE_MAGIC || frame.length < sizeof (frame)) {
+            web100_errno = WEB100_ERR_FILE;
+            return -WEB100_ERR_FILE;
+        }
+        if (frame.type == WEB100_WIRE_INDEX || log->maplen - log->pos < frame.length) {
+            log->eof = 1;
+            return EOF;
+        }
+        log->pos += frame.length;
+        if (frame.type != WEB100_WIRE_SAMPLE && frame.type != WEB100_WIRE_DELTA)
+            continue;
+        rec = log->recno++;
+
+        q = (const unsigned char *)p + sizeof (frame);
+        end = (const unsigned char *)p + frame.length;
+        if (frame.group != log->group->id ||
+            (frame.type == WEB100_WIRE_SAMPLE && frame.length != SAMPLE_HEAD + ALIGN8(size))) {
+            web100_errno = WEB100_ERR_INVAL;
+            return -WEB100_ERR_INVAL;
+        }
+        if (frame.type == WEB100_WIRE_SAMPLE) {
+            memcpy(&sample, q, sizeof (sample));
+            id = sample.conn;
+        } else if (log_delta_head(log, &q, end, &id, &back) != 0) {
+            web100_errno = WEB100_ERR_INVAL;
+            return -WEB100_ERR_INVAL;
+        }
+        if (id >= log->nconns) {
+            web100_errno = WEB100_ERR_INVAL;
+            return -WEB100_ERR_INVAL;
+        }
+
+        lc = &log->conns[id];
+        if (log->filter >= 0 && id != log->filter) {
+            lc->last = NULL;
+            continue;
+        }
+        if (frame.type == WEB100_WIRE_SAMPLE || lc->last != NULL)
+            break;
+        if ((err = log_recover(log, lc, id, p, back)) < 0)
+            return err;
+        if (err == 0)
+            break;
+    }
+
+    if (frame.type == WEB100_WIRE_SAMPLE) {
+        lc->last = p + SAMPLE_HEAD;
+        lc->prev_mono = sample.time_mono;
+        lc->prev_wall = sample.time_wall;
+    } else if ((err = log_undelta(log, lc, q, end)) != WEB100_ERR_SUCCESS) {
+        return err;
+    }
+    log->cur = id;
+    log->lastrec = rec;
+
+    return WEB100_ERR_SUCCESS;
+}
+
+/*
+ * log_next_v1 - Find the next record behind its text marker.
+ */
+static int
+log_next_v1(web100_log *log)
+{
+    const char *p = log->map + log->pos, *end = log->map + log->maplen;
+    size_t len = strlen(BEGIN_SNAP_DATA);
+
+    while (p < end && isspace((unsigned char)*p))
+        p++;
+    if (p == end) {
+        log->eof = 1;
+        return EOF;
+    }
+
+    if (end - p < len || memcmp(p, BEGIN_SNAP_DATA, len) != 0 ||
+        (p = memchr(p, '\n', end - p)) == NULL ||
+        end - ++p < log->group->size) {
+        web100_errno = WEB100_ERR_FILE;
+        return -WEB100_ERR_FILE;
+    }
+
+    /* Version 1 records carry no times */
+    log->conns[0].last = p;
+    log->conns[0].prev_mono = log->conns[0].prev_wall = 0;
+    log->cur = 0;
+    log->lastrec = log->recno++;
+    log->pos = p + log->group->size - log->map;
+
+    return WEB100_ERR_SUCCESS;
+}
+
+
+/*
+ * log_next - Read the next record of a log, or hand back again the one a
+ * seek stopped at.
+ */
+static int
+log_next(web100_log *log)
+{
+    int err;
+
+    if (log->map == NULL) {
+	web100_errno = WEB100_ERR_FILE;
+	return -WEB100_ERR_FILE;
+    }
+
+    if (log->held)
+        log->held = 0;
+    else if ((err = log->version >= 2 ? log_next_v2(log) : log_next_v1(log)) != WEB100_ERR_SUCCESS)
+        return err;
+    log->connection = log->conns[log->cur].connection;
+
+    return WEB100_ERR_SUCCESS;
+}
+
+
+/*@
+web100_log_read - read the next snapshot from a log without copying it
+@*/
+int
+web100_log_read(web100_log *log, web100_snapshot *snap)
+{
+    struct web100_log_conn *lc;
+    int err;
+
+    if ((err = log_next(log)) != WEB100_ERR_SUCCESS)
+        return err;
+    lc = &log->conns[log->cur];
+
+    snap->group = log->group;
+    snap->connection = lc->connection;
+    snap->data = (void *)lc->last;
+    snap->time_mono = lc->prev_mono;
+    snap->time_wall = lc->prev_wall;
+
+    return WEB100_ERR_SUCCESS;
+}
+
+int
+web100_snap_from_log(web100_snapshot* snap, web100_log *log)
+{
+    struct web100_log_conn *lc;
+    int err;
+
+    if (GROUP_AGENT(snap->group)->type != WEB100_AGENT_TYPE_LOG) {
+       	web100_errno = WEB100_ERR_AGENT_TYPE;
+	return -WEB100_ERR_AGENT_TYPE;
+    }
+
+    if (snap->group != log->group) {
+        web100_errno = WEB100_ERR_INVAL;
+        return -WEB100_ERR_INVAL;
+    }
+
+    if ((err = log_next(log)) != WEB100_ERR_SUCCESS)
+        return err;
+    lc = &log->conns[log->cur];
+
+    memcpy(snap->data, lc->last, log->group->size);
+    snap->connection = lc->connection;
+    snap->time_mono = lc->prev_mono;
+    snap->time_wall = lc->prev_wall;
+
+    return WEB100_ERR_SUCCESS;
+}
+
+
+/*@
+web100_log_set_filter - read only the records of one connection of a log
+@*/
+int
+web100_log_set_filter(web100_log *log, web100_connection *conn)
+{
+    int i;
+
+    if (log->map == NULL) {
+        web100_errno = WEB100_ERR_INVAL;
+        return -WEB100_ERR_INVAL;
+    }
+
+    if (conn == NULL) {
+        log->filter = -1;
+        web100_errno = WEB100_ERR_SUCCESS;
+        return WEB100_ERR_SUCCESS;
+    }
+
+    for (i = 0; i < log->nconns; i++)
+        if (log->conns[i].connection == conn)
+            break;
+    if (i == log->nconns) {
+        web100_errno = WEB100_ERR_NOCONNECTION;
+        return -WEB100_ERR_NOCONNECTION;
+    }
+    log->filter = i;
+    if (log->held && log->cur != i)
+        log->held = 0;
+
+    web100_errno = WEB100_ERR_SUCCESS;
+    return WEB100_ERR_SUCCESS;
+}
+
+
+/*
+ * log_index_v2 - Find the index of a log's keyframes, in the frame the
+ * trailer points at; or, for a log cut short without one, build it with a
+ * pass over the records.
+ */
+static int
+log_index_v2(web100_log *log)
+{
+    struct web100_wire_frame frame;
+    struct web100_log_sample sample;
+    struct web100_log_index *ent;
+    size_t pos;
+    int n;
+
+    if (log->indexed)
+        return WEB100_ERR_SUCCESS;
+
+    if ((pos = log_trailer(log, WEB100_WIRE_INDEX, &frame)) != 0) {
+        if (frame.length != sizeof (frame) + (u_int64_t)frame.group * sizeof (*ent)) {
+            web100_errno = WEB100_ERR_FILE;
+            return -WEB100_ERR_FILE;
+        }
+        /* Frames are aligned, and so the index in the mapping */
+        log->index = (struct web100_log_index *)(log->map + pos + sizeof (frame));
+        log->count = frame.group;
+        log->indexed = 1;
+        return WEB100_ERR_SUCCESS;
+    }
+
+    log->records = 0;
+    for (pos = log->first; log->maplen - pos >= sizeof (frame); pos += frame.length) {
+        memcpy(&frame, log->map + pos, sizeof (frame));
+        if (frame.magic != WEB100_WIRE_MAGIC || frame.length < sizeof (frame) ||
+            frame.length > log->maplen - pos || frame.type == WEB100_WIRE_INDEX)
+            break;
+        if (frame.type != WEB100_WIRE_SAMPLE && frame.type != WEB100_WIRE_DELTA)
+            continue;
+        if (frame.type == WEB100_WIRE_SAMPLE && frame.length >= SAMPLE_HEAD) {
+            if (log->count == log->alloc) {
+                n = log->alloc ? 2 * log->alloc : 1024;
+                if ((ent = realloc(log->index, n * sizeof (*ent))) == NULL) {
+                    web100_errno = WEB100_ERR_NOMEM;
+                    return -WEB100_ERR_NOMEM;
+                }
+                log->index = ent;
+                log->alloc = n;
+            }
+            memcpy(&sample, log->map + pos + sizeof (frame), sizeof (sample));
+            ent = &log->index[log->count++];
+            ent->offset = pos;
+            ent->record = log->records;
+            ent->time_mono = sample.time_mono;
+            ent->time_wall = sample.time_wall;
+            ent->conn = sample.conn;
+            ent->pad = 0;
+        }
+        log->records++;
+    }
+    log->indexed = 1;
+
+    return WEB100_ERR_SUCCESS;
+}
+
+
+/*
+ * log_seek - Position a log to read next its first record at or after
+ * the n'th, or, by time, with a wall-clock time at or after t: a binary
+ * search of the index finds the last keyframe before it, and the records
+ * from there up to it are read and passed over.  A version 1 log has no
+ * index, or times, and is read from its start.
+ */
+static int
+log_seek(web100_log *log, u_int64_t n, u_int64_t t, int bytime)
+{
+    struct web100_log_index *ent = NULL;
+    int lo, hi, mid, i, err;
+
+    if (log->map == NULL || (bytime && log->version < 2)) {
+        web100_errno = WEB100_ERR_INVAL;
+        return -WEB100_ERR_INVAL;
+    }
+
+    if (log->version >= 2) {
+        if ((err = log_index_v2(log)) != WEB100_ERR_SUCCESS)
+            return err;
+
+        lo = 0;
+        hi = log->count;
+        while (lo < hi) {
+            mid = lo + (hi - lo) / 2;
+            if (bytime ? log->index[mid].time_wall < t : log->index[mid].record <= n)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        if (lo > 0) {
+            ent = &log->index[lo - 1];
+            if (ent->offset < log->first || ent->offset >= log->maplen) {
+                web100_errno = WEB100_ERR_FILE;
+                return -WEB100_ERR_FILE;
+            }
+        }
+    }
+
+    log->pos = ent ? ent->offset : log->first;
+    log->recno = ent ? ent->record : 0;
+    log->held = 0;
+    log->eof = 0;
+    for (i = 0; i < log->nconns; i++)
+        log->conns[i].last = NULL;
+
+    while ((err = log_next(log)) == WEB100_ERR_SUCCESS) {
+        if (bytime ? log->conns[log->cur].prev_wall >= t : log->lastrec >= n) {
+            log->held = 1;
+            web100_errno = WEB100_ERR_SUCCESS;
+            return WEB100_ERR_SUCCESS;
+        }
+    }
+
+    return err;
+}
+
+
+/*@
+web100_log_seek_record - position a log to read its n'th record next
+@*/
+int
+web100_log_seek_record(web100_log *log, u_int64_t n)
+{
+    return log_seek(log, n, 0, 0);
+}
+
+
+/*@
+web100_log_seek_time - position a log to read next its first record at or after a time
+@*/
+int
+web100_log_seek_time(web100_log *log, u_int64_t t)
+{
+    return log_seek(log, 0, t, 1);
+}
+
+/*@
+web100_log_manifest - list the segments of a log that overlap a span of time
+@*/
+int
+web100_log_manifest(char *logname, u_int64_t from, u_int64_t to,
+                    struct web100_log_segment **segsp)
+{
+    struct web100_log_segment *segs = NULL, seg;
+    unsigned long long records, fw, lw, fm, lm;
+    char path[PATH_MAX], state[8];
+    char *buf = NULL, *line, *next, *sp, *names;
+    size_t len, dirlen = log_basename(logname) - logname;
+    int fd, nlines = 0, n = 0;
+
+    snprintf(path, sizeof (path), "%s.manifest", logname);
+    if ((fd = open(path, O_RDONLY)) < 0) {
+        web100_errno = WEB100_ERR_FILE;
+        return -WEB100_ERR_FILE;
+    }
+    buf = _web100_read_all(fd, &len);
+    close(fd);
+    if (buf == NULL)
+        return -web100_errno;
+
+    if (strncmp(buf, MANIFEST_MAGIC "\n", strlen(MANIFEST_MAGIC) + 1) != 0) {
+        web100_errno = WEB100_ERR_FILE;
+        goto Cleanup;
+    }
+    for (line = buf; *line; line++)
+        if (*line == '\n')
+            nlines++;
+
+    /* The segments, and then their paths, in one block */
+    if ((segs = malloc(nlines * (sizeof (*segs) + dirlen + 1) + len)) == NULL) {
+        web100_errno = WEB100_ERR_NOMEM;
+        goto Cleanup;
+    }
+    names = (char *)(segs + nlines);
+
+    for (line = strchr(buf, '\n') + 1; *line; line = next) {
+        if ((next = strchr(line, '\n')) == NULL)
+            break;                  /* cut short */
+        *next++ = '\0';
+        if ((sp = strchr(line, ' ')) == NULL ||
+            sscanf(sp, "%7s %llu %llu %llu %llu %llu",
+                   state, &records, &fw, &lw, &fm, &lm) != 6) {
+            web100_errno = WEB100_ERR_FILE;
+            goto Cleanup;
+        }
+
+        seg.open = strcmp(state, "open") == 0;
+        seg.records = records;
+        seg.first_wall = fw;
+        seg.last_wall = lw;
+        seg.first_mono = fm;
+        seg.last_mono = lm;
+
+        /* One still being written may yet reach any later time */
+        if (seg.records > 0 &&
+            (seg.first_wall > to || (!seg.open && seg.last_wall < from)))
+            continue;
+
+        seg.name = names;
+        memcpy(names, logname, dirlen);
+        memcpy(names + dirlen, line, sp - line);
+        names += dirlen + (sp - line);
+        *names++ = '\0';
+        segs[n++] = seg;
+    }
+
+    *segsp = segs;
+    segs = NULL;
+    web100_errno = WEB100_ERR_SUCCESS;
+
+ Cleanup:
+    free(segs);
+    free(buf);
+    return web100_errno == WEB100_ERR_SUCCESS ? n : -web100_errno;
+}
+
+
+web100_agent*
+web100_get_log_agent(web100_log *log)
+{
+    return log->agent;
+}
+
+web100_group*
+web100_get_log_group(web100_log *log)
+{
+    return log->group;
+}
+
+web100_connection*
+web100_get_log_connection(web100_log *log)
+{
+    return log->connection;
+}
+
+time_t
+web100_get_log_time(web100_log *log)
+{
+    return log->time;
+}
+
+u_int64_t
+web100_get_log_dropped(web100_log *log)
+{
+    return __atomic_load_n(&log->dropped, __ATOMIC_RELAXED);
+}
+
+int
+web100_get_log_pending(web100_log *log)
+{
+    if (log->ring == NULL)
+        return 0;
+    return log->head - __atomic_load_n(&log->tail, __ATOMIC_SEQ_CST);
+}
+
+int
+web100_log_eof(web100_log* log)
+{
+    return log->eof;
+}
@@ -0,0 +1,475 @@
+/*
+ * Copyright (c) 2001 Carnegie Mellon University,
+ *                    The Board of Trustees of the University of Illinois,
+ *                    and University Corporation for Atmospheric Research.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ *
+ * Merging logs: the records of many logs of a group, read as one stream
+ * in order of their wall-clock times.
+ *
+ * Each log's next few records are copied out ahead of the merge, and a
+ * min-heap holds the logs by the time of the first of those, so each
+ * record merged costs a sift of O(log n).  Only so many logs are kept
+ * open at once: when a log's records run out and another must be closed
+ * to open it, the one read least recently is, and is later opened again
+ * and positioned with web100_log_seek_record where it was left.  The
+ * connections of all the logs are numbered as one set, a connection that
+ * is in more than one (as a log written in segments) being one.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "web100-int.h"
+
+#define ALIGN8(x)  (((x) + 7) & ~(size_t)7)
+
+#define MERGE_MAXOPEN   64                  /* logs open, unless told */
+#define MERGE_BUDGET    (16 * 1024 * 1024)  /* bytes read ahead, over all logs */
+#define MERGE_AHEAD_MIN 4
+#define MERGE_AHEAD_MAX 256
+
+/* Input a's next record goes before input b's */
+#define MERGE_BEFORE(m, a, b) \
+    ((m)->inputs[a].wall[(m)->inputs[a].next] < (m)->inputs[b].wall[(m)->inputs[b].next] || \
+     ((m)->inputs[a].wall[(m)->inputs[a].next] == (m)->inputs[b].wall[(m)->inputs[b].next] && \
+      (a) < (b)))
+
+
+static void
+merge_sift_down(web100_log_merge *m, int i)
+{
+    int e = m->heap[i];
+    int c;
+
+    while ((c = 2 * i + 1) < m->nheap) {
+        if (c + 1 < m->nheap && MERGE_BEFORE(m, m->heap[c + 1], m->heap[c]))
+            c++;
+        if (!MERGE_BEFORE(m, m->heap[c], e))
+            break;
+        m->heap[i] = m->heap[c];
+        i = c;
+    }
+    m->heap[i] = e;
+}
+
+
+static void
+merge_sift_up(web100_log_merge *m, int i)
+{
+    int e = m->heap[i];
+    int p;
+
+    while (i > 0) {
+        p = (i - 1) / 2;
+        if (!MERGE_BEFORE(m, e, m->heap[p]))
+            break;
+        m->heap[i] = m->heap[p];
+        i = p;
+    }
+    m->heap[i] = e;
+}
+
+
+/*
+ * merge_conn - The merge's number for a connection of one of its logs,
+ * numbering it, and adding it to the merge's agent, the first time it is
+ * seen in any of them.
+ */
+static int
+merge_conn(web100_log_merge *m, const struct web100_log_conn *lc)
+{
+    struct web100_wire_record rec = lc->rec;
+    struct web100_log_key *keys, *k;
+    web100_connection **conns, *cp;
+    int i, j, n;
+
+    rec.time_mono = rec.time_wall = 0;
+
+    if (2 * (m->nconns + 1) > m->keys_size) {
+        n = m->keys_size ? 2 * m->keys_size : 64;
+        if ((keys = malloc(n * sizeof (*keys))) == NULL) {
+            web100_errno = WEB100_ERR_NOMEM;
+            return -WEB100_ERR_NOMEM;
+        }
+        for (i = 0; i < n; i++)
+            keys[i].id = -1;
+        for (j = 0; j < m->keys_size; j++) {
+            if (m->keys[j].id < 0)
+                continue;
+            for (i = _web100_hash(&m->keys[j].rec, sizeof (rec)) & (n - 1);
+                 keys[i].id >= 0; i = (i + 1) & (n - 1))
+                ;
+            keys[i] = m->keys[j];
+        }
+        free(m->keys);
+        m->keys = keys;
+        m->keys_size = n;
+    }
+
+    for (i = _web100_hash(&rec, sizeof (rec)) & (m->keys_size - 1);
+         ; i = (i + 1) & (m->keys_size - 1)) {
+        k = &m->keys[i];
+        if (k->id < 0)
+            break;
+        if (memcmp(&k->rec, &rec, sizeof (rec)) == 0)
+            return k->id;
+    }
+
+    if (m->nconns == m->conns_alloc) {
+        n = m->conns_alloc ? 2 * m->conns_alloc : 16;
+        if ((conns = realloc(m->conns, n * sizeof (*conns))) == NULL) {
+            web100_errno = WEB100_ERR_NOMEM;
+            return -WEB100_ERR_NOMEM;
+        }
+        m->conns = conns;
+        m->conns_alloc = n;
+    }
+    if ((cp = malloc(sizeof (web100_connection))) == NULL) {
+        web100_errno = WEB100_ERR_NOMEM;
+        return -WEB100_ERR_NOMEM;
+    }
+    memcpy(cp, lc->connection, sizeof (*cp));
+    cp->agent = m->agent;
+    cp->info.local.next = NULL;
+
+    if (m->nconns == 0)
+        m->agent->info.local.connection_head = cp;
+    else
+        m->conns[m->nconns - 1]->info.local.next = cp;
+    m->conns[m->nconns] = cp;
+    k->rec = rec;
+    k->id = m->nconns++;
+
+    return k->id;
+}
+
+
+static void
+merge_close_input(web100_log_merge *m, int i)
+{
+    int j;
+
+    web100_log_close_read(m->inputs[i].log);
+    m->inputs[i].log = NULL;
+    for (j = 0; j < m->nopen; j++)
+        if (m->opened[j] == i)
+            break;
+    m->opened[j] = m->opened[--m->nopen];
+}
+
+
+/*
+ * merge_open_input - Open a log of a merge, closing the one read least
+ * recently if as many as may be are open, and go on from the record it
+ * was left at.  The first log opened gives the merge its agent and group;
+ * the others must have the same header and group.
+ */
+static int
+merge_open_input(web100_log_merge *m, int i)
+{
+    struct web100_merge_input *in = &m->inputs[i];
+    struct web100_image *image;
+    web100_log *log;
+    int *conns;
+    int j, err, least = 0;
+
+    if (m->nopen == m->maxopen) {
+        for (j = 1; j < m->nopen; j++)
+            if (m->inputs[m->opened[j]].used < m->inputs[m->opened[least]].used)
+                least = j;
+        merge_close_input(m, m->opened[least]);
+    }
+
+    if ((log = web100_log_open_read(in->name)) == NULL)
+        return -web100_errno;
+    in->log = log;
+    m->opened[m->nopen++] = i;
+
+    image = GROUP_AGENT(log->group)->info.local.image;
+    if (m->agent == NULL) {
+        if ((m->agent = _web100_agent_attach_header(AGENT_HEADER(log->agent),
+                                                    image->header_len, 0)) == NULL)
+            return -web100_errno;
+        m->agent->type = WEB100_AGENT_TYPE_LOG;
+        if ((m->group = web100_group_find(m->agent, log->group->name)) == NULL)
+            return -web100_errno;
+    } else if (image->hash != m->agent->info.local.image->hash ||
+               strcmp(log->group->name, m->group->name) != 0) {
+        web100_errno = WEB100_ERR_HEADER;
+        return -WEB100_ERR_HEADER;
+    }
+
+    if ((conns = realloc(in->conns, (log->nconns + 1) * sizeof (int))) == NULL) {
+        web100_errno = WEB100_ERR_NOMEM;
+        return -WEB100_ERR_NOMEM;
+    }
+    in->conns = conns;
+    for (j = 0; j < log->nconns; j++)
+        if ((in->conns[j] = merge_conn(m, &log->conns[j])) < 0)
+            return in->conns[j];
+
+    if (in->recno > 0 && (err = web100_log_seek_record(log, in->recno)) != WEB100_ERR_SUCCESS) {
+        if (err != EOF || !web100_log_eof(log))
+            return err;
+        in->eof = 1;
+        merge_close_input(m, i);
+    }
+
+    return WEB100_ERR_SUCCESS;
+}
+
+
+/*
+ * merge_fill - Read ahead the next records of a log of a merge, opening
+ * it if it is closed, and closing it at its end.
+ */
+static int
+merge_fill(web100_log_merge *m, int i)
+{
+    struct web100_merge_input *in = &m->inputs[i];
+    web100_snapshot snap;
+    size_t size, stride;
+    int err;
+
+    in->next = in->count = 0;
+    if (in->eof)
+        return WEB100_ERR_SUCCESS;
+    if (in->log == NULL && (err = merge_open_input(m, i)) != WEB100_ERR_SUCCESS)
+        return err;
+    if (in->eof)
+        return WEB100_ERR_SUCCESS;
+    in->used = ++m->clock;
+
+    /* Each record aligned, as in a log */
+    size = m->group->size;
+    stride = ALIGN8(size);
+    if (in->data == NULL) {
+        if ((in->data = malloc(m->ahead * stride)) == NULL ||
+            (in->mono = malloc(m->ahead * sizeof (u_int64_t))) == NULL ||
+            (in->wall = malloc(m->ahead * sizeof (u_int64_t))) == NULL ||
+            (in->conn = malloc(m->ahead * sizeof (int))) == NULL) {
+            web100_errno = WEB100_ERR_NOMEM;
+            return -WEB100_ERR_NOMEM;
+        }
+    }
+
+    while (in->count < m->ahead) {
+        if ((err = web100_log_read(in->log, &snap)) != WEB100_ERR_SUCCESS) {
+            if (err != EOF || !web100_log_eof(in->log))
+                return err;
+            in->eof = 1;
+            merge_close_input(m, i);
+            break;
+        }
+        memcpy(in->data + in->count * stride, snap.data, size);
+        in->mono[in->count] = snap.time_mono;
+        in->wall[in->count] = snap.time_wall;
+        in->conn[in->count] = in->conns[in->log->cur];
+        in->count++;
+        in->recno = in->log->lastrec + 1;
+    }
+
+    return WEB100_ERR_SUCCESS;
+}
+
+
+/*@
+web100_log_merge_open - open logs to read their records merged in time order
+@*/
+web100_log_merge*
+web100_log_merge_open(char **lognames, int nlogs, int maxopen)
+{
+    web100_log_merge *m = NULL;
+    int i;
+
+    if (nlogs <= 0) {
+        web100_errno = WEB100_ERR_INVAL;
+        return NULL;
+    }
+
+    if ((m = calloc(1, sizeof (web100_log_merge))) == NULL) {
+        web100_errno = WEB100_ERR_NOMEM;
+        goto Cleanup;
+    }
+    m->last = -1;
+    m->maxopen = maxopen > 0 ? maxopen : MERGE_MAXOPEN;
+    m->ahead = MERGE_AHEAD_MIN;
+    if ((m->inputs = calloc(nlogs, sizeof (*m->inputs))) == NULL ||
+        (m->heap = malloc(nlogs * sizeof (int))) == NULL ||
+        (m->opened = malloc(m->maxopen * sizeof (int))) == NULL) {
+        web100_errno = WEB100_ERR_NOMEM;
+        goto Cleanup;
+    }
+    m->ninputs = nlogs;
+    for (i = 0; i < nlogs; i++) {
+        if ((m->inputs[i].name = strdup(lognames[i])) == NULL) {
+            web100_errno = WEB100_ERR_NOMEM;
+            goto Cleanup;
+        }
+    }
+
+    //
+    // The first log gives the size of the records, and so how many of
+    // each log are read ahead
+    //
+    if (merge_open_input(m, 0) != WEB100_ERR_SUCCESS)
+        goto Cleanup;
+    if (m->group->size > 0)
+        m->ahead = MERGE_BUDGET / (nlogs * ALIGN8(m->group->size));
+    if (m->ahead < MERGE_AHEAD_MIN)
+        m->ahead = MERGE_AHEAD_MIN;
+    if (m->ahead > MERGE_AHEAD_MAX)
+        m->ahead = MERGE_AHEAD_MAX;
+
+    for (i = 0; i < nlogs; i++) {
+        if (merge_fill(m, i) != WEB100_ERR_SUCCESS)
+            goto Cleanup;
+        if (m->inputs[i].count > 0) {
+            m->heap[m->nheap++] = i;
+            merge_sift_up(m, m->nheap - 1);
+        }
+    }
+
+    web100_errno = WEB100_ERR_SUCCESS;
+
+ Cleanup:
+
+    if (web100_errno != WEB100_ERR_SUCCESS) {
+        web100_log_merge_close(m);
+        return NULL;
+    }
+
+    return m;
+}
+
+
+/*@
+web100_log_merge_close - close the logs of a merge
+@*/
+int
+web100_log_merge_close(web100_log_merge *m)
+{
+    struct web100_merge_input *in;
+    int i;
+
+    if (m == NULL)
+        return WEB100_ERR_SUCCESS;
+
+    for (i = 0; i < m->ninputs; i++) {
+        in = &m->inputs[i];
+        web100_log_close_read(in->log);
+        free(in->name);
+        free(in->conns);
+        free(in->data);
+        free(in->mono);
+        free(in->wall);
+        free(in->conn);
+    }
+    web100_detach(m->agent);        /* also frees the connections */
+    free(m->inputs);
+    free(m->heap);
+    free(m->opened);
+    free(m->conns);
+    free(m->keys);
+    free(m);
+
+    return WEB100_ERR_SUCCESS;
+}
+
+
+/*@
+web100_log_merge_read - read the next snapshot, in time order, of the logs of a merge
+@*/
+int
+web100_log_merge_read(web100_log_merge *m, web100_snapshot *snap)
+{
+    struct web100_merge_input *in;
+    int i, err;
+
+    //
+    // Done with the record handed out last, whose log is at the root of
+    // the heap: go on to the log's next, reading more ahead if need be,
+    // and sift it down to its place
+    //
+    if ((i = m->last) >= 0) {
+        in = &m->inputs[i];
+        m->last = -1;
+        if (++in->next == in->count && (err = merge_fill(m, i)) != WEB100_ERR_SUCCESS) {
+            m->heap[0] = m->heap[--m->nheap];
+            merge_sift_down(m, 0);
+            return err;
+        }
+        if (in->count == 0)
+            m->heap[0] = m->heap[--m->nheap];
+        if (m->nheap > 0)
+            merge_sift_down(m, 0);
+    }
+
+    if (m->nheap == 0) {
+        m->eof = 1;
+        return EOF;
+    }
+
+    m->last = m->heap[0];
+    in = &m->inputs[m->last];
+    snap->group = m->group;
+    snap->connection = m->conns[in->conn[in->next]];
+    snap->data = in->data + in->next * ALIGN8(m->group->size);
+    snap->time_mono = in->mono[in->next];
+    snap->time_wall = in->wall[in->next];
+
+    web100_errno = WEB100_ERR_SUCCESS;
+    return WEB100_ERR_SUCCESS;
+}
+
+
+/*
+ * _web100_log_merge_conn - The merge's number for the connection of the
+ * record last read, its place in the agent's list.
+ */
+int
+_web100_log_merge_conn(web100_log_merge *m)
+{
+    struct web100_merge_input *in = &m->inputs[m->last];
+
+    return in->conn[in->next];
+}
+
+
+web100_agent*
+web100_get_log_merge_agent(web100_log_merge *m)
+{
+    return m->agent;
+}
+
+web100_group*
+web100_get_log_merge_group(web100_log_merge *m)
+{
+    return m->group;
+}
+
+/*@
+web100_log_merge_eof - whether a merge has no snapshots left to read
+@*/
+int
+web100_log_merge_eof(web100_log_merge *m)
+{
+    return m->eof;
+}
@@ -0,0 +1,464 @@
+/*
+ * Copyright (c) 2001 Carnegie Mellon University,
+ *                    The Board of Trustees of the University of Illinois,
+ *                    and University Corporation for Atmospheric Research.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ *
+ * Replay agents: a log played back as if it were the kernel, so the tools
+ * can be run on what was recorded.
+ *
+ * web100_attach(WEB100_AGENT_TYPE_LOG, logname) opens the log and hands
+ * back its agent, marked as a replay.  Its connections are the log's.  A
+ * virtual clock runs from the wall-clock time of the log's first record,
+ * at the speed set with web100_replay_set_speed: web100_snap of a
+ * connection returns the last of its records at or before the clock's
+ * time, reading the log forward as far as the clock has got.  At speed 0
+ * the clock does not run by itself; each web100_snap moves it on to the
+ * next record of the log, whichever connection it is of, so the log is
+ * played as fast as it is asked for, and a lookup of a connection not yet
+ * reached reads on to it.
+ *
+ * A connection is not there, to web100_connection_head or web100_snap,
+ * until its first record is reached, and is gone once its last record
+ * has been handed out.  The log is read through once when it is
+ * attached, to count each connection's records.
+ *
+ * With WEB100_REPLAY set in the environment to the name of a log, an
+ * attach to the local kernel attaches a replay of it instead, at the
+ * speed in WEB100_REPLAY_SPEED, so tools run on a log unchanged.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/types.h>
+
+#include "web100-int.h"
+
+
+static u_int64_t
+replay_mono(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u_int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+/*
+ * replay_find - A connection's state, by its number in the log.  A log of
+ * many connections may hold a cid more than once, so the cid cannot say
+ * which connection is meant; the number is kept in the connection itself,
+ * and so in the copies a snapset takes.
+ */
+static struct web100_replay_conn*
+replay_find(struct web100_replay *r, const web100_connection *conn)
+{
+    int n = conn->info.local.index;
+
+    if (conn->agent != r->log->agent || n < 0 || n >= r->nconns)
+        return NULL;
+    return &r->conns[n];
+}
+
+
+/* Whether a connection of the cid is open at the replay's time */
+static int
+replay_open(struct web100_replay *r, int cid)
+{
+    int i;
+
+    for (i = 0; i < r->nconns; i++)
+        if (r->conns[i].cid == cid && r->conns[i].reached && !r->conns[i].gone)
+            return 1;
+    return 0;
+}
+
+
+/*
+ * replay_reach - Take the record read ahead as its connection's latest,
+ * and read the next.
+ */
+static int
+replay_reach(struct web100_replay *r)
+{
+    struct web100_replay_conn *c = &r->conns[r->next_conn];
+    int err;
+
+    memcpy(c->data, r->next.data, r->log->group->size);
+    c->time_mono = r->next.time_mono;
+    c->time_wall = r->next.time_wall;
+    c->reached++;
+    r->now = r->next.time_wall;
+
+    if ((err = web100_log_read(r->log, &r->next)) == EOF && web100_log_eof(r->log)) {
+        r->eof = 1;
+        return WEB100_ERR_SUCCESS;
+    }
+    if (err != WEB100_ERR_SUCCESS)
+        return err;
+    r->next_conn = r->log->cur;
+    return WEB100_ERR_SUCCESS;
+}
+
+
+/*
+ * replay_advance - Read the log up to the clock's time; or, at speed 0
+ * and if step is set, one record on.
+ */
+static int
+replay_advance(struct web100_replay *r, int step)
+{
+    u_int64_t t;
+    int err;
+
+    if (r->speed == 0) {
+        if (!step || r->eof)
+            return WEB100_ERR_SUCCESS;
+        if (r->held) {
+            r->held = 0;
+            return WEB100_ERR_SUCCESS;
+        }
+        return replay_reach(r);
+    }
+
+    /* The clock starts when the replay is first looked at */
+    if (r->real0 == 0)
+        r->real0 = replay_mono();
+    t = r->virt0 + (u_int64_t)((replay_mono() - r->real0) * r->speed);
+    while (!r->eof && r->next.time_wall <= t)
+        if ((err = replay_reach(r)) != WEB100_ERR_SUCCESS)
+            return err;
+    r->now = t;
+    return WEB100_ERR_SUCCESS;
+}
+
+
+/*
+ * replay_conn - The data of a connection as of now, or NULL with
+ * web100_errno set if it has not begun or has ended.
+ */
+static struct web100_replay_conn*
+replay_conn(struct web100_replay *r, web100_connection *conn, int step)
+{
+    struct web100_replay_conn *c;
+    int err;
+
+    if ((err = replay_advance(r, step)) != WEB100_ERR_SUCCESS) {
+        web100_errno = -err;
+        return NULL;
+    }
+    if ((c = replay_find(r, conn)) == NULL || c->reached == 0 || c->gone) {
+        web100_errno = WEB100_ERR_NOCONNECTION;
+        return NULL;
+    }
+    return c;
+}
+
+
+/*
+ * _web100_replay_refresh - Make the agent's list of connections those
+ * open at the replay's time, in the log's order.  At speed 0, with none
+ * open, or not the one of cid if it is not negative, the log is read on
+ * until it is, and the record last reached held for the next snap.
+ */
+int
+_web100_replay_refresh(web100_agent *agent, int cid)
+{
+    struct web100_replay *r = agent->info.local.replay;
+    web100_connection **link;
+    int i, err;
+
+    if ((err = replay_advance(r, 0)) != WEB100_ERR_SUCCESS)
+        return -err;
+
+    for (;;) {
+        link = &agent->info.local.connection_head;
+        for (i = 0; i < r->nconns; i++) {
+            if (r->conns[i].reached == 0 || r->conns[i].gone)
+                continue;
+            *link = r->log->conns[i].connection;
+            link = &(*link)->info.local.next;
+        }
+        *link = NULL;
+
+        if (r->speed != 0 || r->eof)
+            return WEB100_ERR_SUCCESS;
+        if (cid < 0 ? agent->info.local.connection_head != NULL : replay_open(r, cid))
+            return WEB100_ERR_SUCCESS;
+        if ((err = replay_reach(r)) != WEB100_ERR_SUCCESS)
+            return -err;
+        r->held = 1;
+    }
+}
+
+
+/*
+ * _web100_agent_attach_replay - Open a log to play back, and return its
+ * agent.
+ */
+web100_agent*
+_web100_agent_attach_replay(const char *logname)
+{
+    struct web100_replay *r = NULL;
+    web100_snapshot snap;
+    const char *speed;
+    u_int64_t *counts = NULL, *p;
+    int nconns = 0, i, err;
+
+    if (logname == NULL) {
+        web100_errno = WEB100_ERR_INVAL;
+        return NULL;
+    }
+
+    if ((r = calloc(1, sizeof (struct web100_replay))) == NULL) {
+        web100_errno = WEB100_ERR_NOMEM;
+        return NULL;
+    }
+    if ((r->log = web100_log_open_read((char *)logname)) == NULL)
+        goto Cleanup;
+
+    //
+    // How many records each connection has, and where the clock starts
+    //
+    while ((err = web100_log_read(r->log, &snap)) == WEB100_ERR_SUCCESS) {
+        if (r->log->nconns > nconns) {
+            if ((p = realloc(counts, r->log->nconns * sizeof (u_int64_t))) == NULL) {
+                web100_errno = WEB100_ERR_NOMEM;
+                goto Cleanup;
+            }
+            counts = p;
+            memset(counts + nconns, 0, (r->log->nconns - nconns) * sizeof (u_int64_t));
+            nconns = r->log->nconns;
+        }
+        counts[r->log->cur]++;
+    }
+    if (err != EOF || !web100_log_eof(r->log))
+        goto Cleanup;
+
+    r->nconns = r->log->nconns;
+    if ((r->conns = calloc(r->nconns + 1, sizeof (*r->conns))) == NULL) {
+        web100_errno = WEB100_ERR_NOMEM;
+        goto Cleanup;
+    }
+    for (i = 0; i < r->nconns; i++) {
+        r->conns[i].cid = r->log->conns[i].connection->cid;
+        r->conns[i].records = i < nconns ? counts[i] : 0;
+        if ((r->conns[i].data = malloc(r->log->group->size)) == NULL) {
+            web100_errno = WEB100_ERR_NOMEM;
+            goto Cleanup;
+        }
+    }
+
+    if ((err = web100_log_seek_record(r->log, 0)) == EOF && web100_log_eof(r->log)) {
+        r->eof = 1;
+    } else if (err != WEB100_ERR_SUCCESS ||
+               web100_log_read(r->log, &r->next) != WEB100_ERR_SUCCESS) {
+        goto Cleanup;
+    } else {
+        r->next_conn = r->log->cur;
+        r->virt0 = r->next.time_wall;
+    }
+    r->speed = 1;
+    if ((speed = getenv("WEB100_REPLAY_SPEED")) != NULL && atof(speed) >= 0)
+        r->speed = atof(speed);
+
+    free(counts);
+    r->log->agent->info.local.replay = r;
+    web100_errno = WEB100_ERR_SUCCESS;
+    return r->log->agent;
+
+ Cleanup:
+    free(counts);
+    if (r->conns)
+        for (i = 0; i < r->nconns; i++)
+            free(r->conns[i].data);
+    free(r->conns);
+    web100_log_close_read(r->log);
+    free(r);
+    return NULL;
+}
+
+
+/*
+ * _web100_replay_free - Close a replay agent's log, which frees the
+ * agent with it.
+ */
+void
+_web100_replay_free(web100_agent *agent)
+{
+    struct web100_replay *r = agent->info.local.replay;
+    int i;
+
+    /* The log frees its connections from the list, so all must be on it */
+    agent->info.local.replay = NULL;
+    agent->info.local.connection_head = r->nconns ? r->log->conns[0].connection : NULL;
+    for (i = 0; i < r->nconns; i++) {
+        r->log->conns[i].connection->info.local.next =
+            i + 1 < r->nconns ? r->log->conns[i + 1].connection : NULL;
+        free(r->conns[i].data);
+    }
+    free(r->conns);
+    web100_log_close_read(r->log);
+    free(r);
+}
+
+
+/*
+ * _web100_replay_snap - web100_snap of a replay agent.
+ */
+int
+_web100_replay_snap(web100_snapshot *snap)
+{
+    struct web100_replay *r = GROUP_AGENT(snap->group)->info.local.replay;
+    struct web100_replay_conn *c;
+
+    /* Only the log's group was recorded */
+    if (snap->group != r->log->group) {
+        web100_errno = WEB100_ERR_NOCONNECTION;
+        return -WEB100_ERR_NOCONNECTION;
+    }
+
+    if ((c = replay_conn(r, snap->connection, 1)) == NULL)
+        return -web100_errno;
+
+    memcpy(snap->data, c->data, snap->group->size);
+    snap->time_mono = c->time_mono;
+    snap->time_wall = c->time_wall;
+    if (c->reached == c->records)
+        c->gone = 1;            /* its last, handed out */
+
+    web100_errno = WEB100_ERR_SUCCESS;
+    return WEB100_ERR_SUCCESS;
+}
+
+
+/*
+ * _web100_replay_raw_read - web100_raw_read of a replay agent: a variable
+ * of the log's group from the connection's latest record.
+ */
+int
+_web100_replay_raw_read(web100_var *var, web100_connection *conn, void *buf)
+{
+    web100_agent *agent = conn->agent;
+    struct web100_replay *r = agent->info.local.replay;
+    struct web100_replay_conn *c;
+    int size = size_from_type(var->type);
+    int v6 = conn->addrtype == WEB100_ADDRTYPE_IPV6;
+    const void *src = NULL;
+    int len = 0;
+
+    //
+    // The connection's addresses and ports, in whatever group, are its
+    // own, and there to read whether it is open or not
+    //
+    if (strcmp(var->name, "LocalAddressType") == 0 ||
+        strcmp(var->name, "RemAddressType") == 0) {
+        src = &conn->addrtype;
+        len = sizeof (conn->addrtype);
+    } else if (strcmp(var->name, "LocalAddress") == 0) {
+        src = v6 ? (const void *)conn->spec_v6.src_addr : (const void *)&conn->spec.src_addr;
+        len = v6 ? 16 : 4;
+    } else if (strcmp(var->name, "RemAddress") == 0 ||
+               strcmp(var->name, "RemoteAddress") == 0) {
+        src = v6 ? (const void *)conn->spec_v6.dst_addr : (const void *)&conn->spec.dst_addr;
+        len = v6 ? 16 : 4;
+    } else if (strcmp(var->name, "LocalPort") == 0) {
+        src = v6 ? &conn->spec_v6.src_port : &conn->spec.src_port;
+        len = 2;
+    } else if (strcmp(var->name, "RemPort") == 0 ||
+               strcmp(var->name, "RemotePort") == 0) {
+        src = v6 ? &conn->spec_v6.dst_port : &conn->spec.dst_port;
+        len = 2;
+    }
+
+    if (src) {
+        memset(buf, 0, size);
+        memcpy(buf, src, len < size ? len : size);
+    } else if (VAR_GROUP(var) == r->log->group) {
+        if ((c = replay_conn(r, conn, 0)) == NULL)
+            return -web100_errno;
+        memcpy(buf, c->data + var->offset, size);
+    } else {
+        web100_errno = WEB100_ERR_NOCONNECTION;
+        return -WEB100_ERR_NOCONNECTION;
+    }
+
+    web100_errno = WEB100_ERR_SUCCESS;
+    return WEB100_ERR_SUCCESS;
+}
+
+
+/*@
+web100_replay_set_speed - set how fast a replay agent plays its log
+@*/
+int
+web100_replay_set_speed(web100_agent *agent, double speed)
+{
+    struct web100_replay *r;
+    int err;
+
+    if (agent == NULL || speed < 0) {
+        web100_errno = WEB100_ERR_INVAL;
+        return -WEB100_ERR_INVAL;
+    }
+    if ((r = agent->info.local.replay) == NULL) {
+        web100_errno = WEB100_ERR_AGENT_TYPE;
+        return -WEB100_ERR_AGENT_TYPE;
+    }
+
+    /* The clock goes on from where it has got to, if it has started */
+    if (r->real0 != 0 || r->speed == 0) {
+        if ((err = replay_advance(r, 0)) != WEB100_ERR_SUCCESS) {
+            web100_errno = -err;
+            return err;
+        }
+        if (r->now > r->virt0)
+            r->virt0 = r->now;
+        r->real0 = replay_mono();
+    }
+    r->speed = speed;
+
+    web100_errno = WEB100_ERR_SUCCESS;
+    return WEB100_ERR_SUCCESS;
+}
+
+
+/*@
+web100_replay_eof - whether a replay agent has played all of its log
+@*/
+int
+web100_replay_eof(web100_agent *agent)
+{
+    struct web100_replay *r = agent->info.local.replay;
+
+    return r ? r->eof : 1;
+}
+
+
+u_int64_t
+web100_get_replay_time(web100_agent *agent)
+{
+    struct web100_replay *r = agent->info.local.replay;
+
+    if (r == NULL)
+        return 0;
+    replay_advance(r, 0);
+    return r->now;
+}
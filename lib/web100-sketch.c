@@ -0,0 +1,276 @@
+/*
+ * Copyright (c) 2001 Carnegie Mellon University,
+ *                    The Board of Trustees of the University of Illinois,
+ *                    and University Corporation for Atmospheric Research.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ *
+ * Distributions of a value across connections.
+ *
+ * A sketch is a histogram with buckets of equal relative width: each power
+ * of two from 2^SKETCH_EXP_MIN up is split into 2^SKETCH_SUB_BITS buckets.
+ * The bucket of a value comes straight from the bits of the double, its
+ * exponent and the top of its mantissa, so adding a value is a few integer
+ * operations.  A quantile is reported as the middle of its bucket, within
+ * 1 / (2^(SKETCH_SUB_BITS+1) + 1) of the true value, relatively.  Count,
+ * sum, minimum and maximum are kept exactly alongside.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "web100-int.h"
+
+
+/*
+ * sketch_bucket - The bucket of v.  Bucket 0 holds everything below
+ * 2^SKETCH_EXP_MIN, including 0 and negative values; values past the
+ * top are counted in the last bucket.
+ */
+static int
+sketch_bucket(double v)
+{
+    u_int64_t bits;
+    int e;
+
+    if (!(v >= SKETCH_LOW))
+        return 0;
+
+    memcpy(&bits, &v, sizeof (bits));
+    e = (int)(bits >> 52) - 1023;
+    if (e > SKETCH_EXP_MAX)
+        return SKETCH_NBUCKETS - 1;
+
+    return 1 + ((e - SKETCH_EXP_MIN) << SKETCH_SUB_BITS) +
+           (int)((bits >> (52 - SKETCH_SUB_BITS)) & (SKETCH_SUB - 1));
+}
+
+
+/* The middle of bucket b, which is not 0: its bits with one more set */
+static double
+sketch_mid(int b)
+{
+    u_int64_t e = ((b - 1) >> SKETCH_SUB_BITS) + SKETCH_EXP_MIN + 1023;
+    u_int64_t m = (b - 1) & (SKETCH_SUB - 1);
+    u_int64_t bits;
+    double v;
+
+    bits = e << 52 | m << (52 - SKETCH_SUB_BITS) |
+           (u_int64_t)1 << (51 - SKETCH_SUB_BITS);
+    memcpy(&v, &bits, sizeof (v));
+    return v;
+}
+
+
+static void
+sketch_add(web100_sketch *sk, double v)
+{
+    if (v != v)                 /* NaN */
+        return;
+
+    sk->buckets[sketch_bucket(v)]++;
+    if (sk->count == 0 || v < sk->min)
+        sk->min = v;
+    if (sk->count == 0 || v > sk->max)
+        sk->max = v;
+    sk->sum += v;
+    sk->count++;
+}
+
+
+/*@
+web100_sketch_alloc - allocate an empty distribution sketch
+@*/
+web100_sketch*
+web100_sketch_alloc(void)
+{
+    web100_sketch *sk;
+
+    if ((sk = calloc(1, sizeof (web100_sketch))) == NULL) {
+        web100_errno = WEB100_ERR_NOMEM;
+        return NULL;
+    }
+
+    web100_errno = WEB100_ERR_SUCCESS;
+    return sk;
+}
+
+
+/*@
+web100_sketch_free - deallocate a sketch
+@*/
+void
+web100_sketch_free(web100_sketch *sk)
+{
+    free(sk);
+}
+
+
+/*@
+web100_sketch_reset - empty a sketch
+@*/
+void
+web100_sketch_reset(web100_sketch *sk)
+{
+    memset(sk, 0, sizeof (web100_sketch));
+}
+
+
+/*@
+web100_sketch_add - add values to a sketch
+@*/
+void
+web100_sketch_add(web100_sketch *sk, const double *values, int n, int stride)
+{
+    int i;
+
+    for (i = 0; i < n; i++, values += stride)
+        sketch_add(sk, *values);
+}
+
+
+/*@
+web100_sketch_merge - add the contents of one sketch to another
+@*/
+void
+web100_sketch_merge(web100_sketch *dst, web100_sketch *src)
+{
+    int i;
+
+    if (src->count == 0)
+        return;
+
+    for (i = 0; i < SKETCH_NBUCKETS; i++)
+        dst->buckets[i] += src->buckets[i];
+    if (dst->count == 0 || src->min < dst->min)
+        dst->min = src->min;
+    if (dst->count == 0 || src->max > dst->max)
+        dst->max = src->max;
+    dst->sum += src->sum;
+    dst->count += src->count;
+}
+
+
+/*@
+web100_snapset_sketch - add variables of every connection in a set to sketches
+@*/
+int
+web100_snapset_sketch(web100_snapset *set, web100_accessor *accs, int nacc,
+                      web100_sketch **sketches)
+{
+    int i, k;
+
+    for (k = 0; k < nacc; k++) {
+        if (accs[k].group != set->group) {
+            web100_errno = WEB100_ERR_INVAL;
+            return -WEB100_ERR_INVAL;
+        }
+    }
+
+    for (i = 0; i < set->count; i++)
+        for (k = 0; k < nacc; k++)
+            sketch_add(sketches[k], _web100_get_double(&set->snaps[i], &accs[k]));
+
+    web100_errno = WEB100_ERR_SUCCESS;
+    return WEB100_ERR_SUCCESS;
+}
+
+
+/*@
+web100_sketch_quantile - estimate a quantile of the values in a sketch
+@*/
+double
+web100_sketch_quantile(web100_sketch *sk, double q)
+{
+    u_int64_t rank, seen = 0;
+    double v;
+    int b;
+
+    if (sk->count == 0 || !(q >= 0 && q <= 1)) {
+        web100_errno = WEB100_ERR_INVAL;
+        return 0;
+    }
+    web100_errno = WEB100_ERR_SUCCESS;
+
+    if (q == 0)
+        return sk->min;
+    if (q == 1)
+        return sk->max;
+
+    /* The value at 0-based position rank in sorted order */
+    rank = (u_int64_t)(q * (sk->count - 1));
+    for (b = 0; b < SKETCH_NBUCKETS; b++) {
+        seen += sk->buckets[b];
+        if (seen > rank)
+            break;
+    }
+
+    if (b == 0)
+        v = sk->min < 0 ? sk->min : 0;
+    else if (b == SKETCH_NBUCKETS - 1)
+        v = sk->max;
+    else
+        v = sketch_mid(b);
+
+    /* No estimate is better than the extremes themselves */
+    if (v < sk->min)
+        v = sk->min;
+    if (v > sk->max)
+        v = sk->max;
+    return v;
+}
+
+
+/*@
+web100_get_sketch_count - return the number of values added to a sketch
+@*/
+u_int64_t
+web100_get_sketch_count(web100_sketch *sk)
+{
+    return sk->count;
+}
+
+
+/*@
+web100_get_sketch_mean - return the mean of the values in a sketch
+@*/
+double
+web100_get_sketch_mean(web100_sketch *sk)
+{
+    return sk->count ? sk->sum / sk->count : 0;
+}
+
+
+/*@
+web100_get_sketch_min - return the least value added to a sketch
+@*/
+double
+web100_get_sketch_min(web100_sketch *sk)
+{
+    return sk->min;
+}
+
+
+/*@
+web100_get_sketch_max - return the greatest value added to a sketch
+@*/
+double
+web100_get_sketch_max(web100_sketch *sk)
+{
+    return sk->max;
+}
@@ -0,0 +1,407 @@
+/*
+ * Copyright (c) 2001 Carnegie Mellon University,
+ *                    The Board of Trustees of the University of Illinois,
+ *                    and University Corporation for Atmospheric Research.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ *
+ * Smoothing of per-connection values over successive sweeps.
+ *
+ * A smoother keeps one array per statistic, each holding a row of nvals
+ * floats per connection in cid order -- the layout web100_snapset_ratesf()
+ * produces.  As long as the set of connections does not change, the state
+ * of value k of a sweep is entry k of every array, so a sweep is one pass
+ * over the input that updates all of the statistics side by side.  When
+ * connections come and go, the rows are first merged into a second set of
+ * arrays, which are then swapped in.
+ *
+ * The window is a ring of the last `window' sweeps, ring slot by ring slot.
+ * A connection's window starts out full of its first value.
+ *
+ * Given the snapset the rows were taken from, the smoother keeps each row's
+ * connection too, and a cid the kernel has given to a new connection since
+ * the last sweep starts over as a new row rather than carrying on the old
+ * connection's state.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+#include "web100-int.h"
+
+
+/* Frees one set of state arrays */
+static void
+state_free(int *cids, web100_connection *conns, float *ewma, float *ring)
+{
+    free(cids);
+    free(conns);
+    free(ewma);
+    free(ring);
+}
+
+
+/*
+ * smoother_conn - The connection of cid in set, looking from *k on, the
+ * set's connections being in cid order; NULL if it has none.
+ */
+static const web100_connection*
+smoother_conn(const web100_snapset *set, int cid, int *k)
+{
+    while (*k < set->count && set->conns[*k].cid < cid)
+        (*k)++;
+    return *k < set->count && set->conns[*k].cid == cid ? &set->conns[*k] : NULL;
+}
+
+
+/*
+ * smoother_spare - Make the spare arrays big enough for n connections.
+ * What they hold is not kept.
+ */
+static int
+smoother_spare(web100_smoother *sm, int n)
+{
+    size_t row = (size_t)sm->nvals * sizeof (float);
+
+    if (n <= sm->salloc)
+        return WEB100_ERR_SUCCESS;
+    if (n < 2 * sm->salloc)
+        n = 2 * sm->salloc;
+
+    state_free(sm->scids, sm->sconns, sm->sewma, sm->sring);
+    sm->scids = NULL;
+    sm->sconns = NULL;
+    sm->sewma = sm->sring = NULL;
+    sm->salloc = 0;
+
+    if ((sm->scids = malloc(n * sizeof (int))) == NULL ||
+        (sm->sconns = calloc(n, sizeof (web100_connection))) == NULL ||
+        (sm->sewma = malloc(n * row)) == NULL ||
+        (sm->window && (sm->sring = malloc(n * row * sm->window)) == NULL))
+        return WEB100_ERR_NOMEM;
+
+    sm->salloc = n;
+    return WEB100_ERR_SUCCESS;
+}
+
+
+/*
+ * smoother_grow - Make the output arrays big enough for n connections.
+ */
+static int
+smoother_grow(web100_smoother *sm, int n)
+{
+    size_t row = (size_t)sm->nvals * sizeof (float);
+    float *p;
+    int i;
+
+    if (n <= sm->oalloc)
+        return WEB100_ERR_SUCCESS;
+    if (n < 2 * sm->oalloc)
+        n = 2 * sm->oalloc;
+
+    for (i = WEB100_SMOOTH_MEAN; i <= WEB100_SMOOTH_MAX && sm->window; i++) {
+        if ((p = realloc(sm->out[i], n * row)) == NULL)
+            return WEB100_ERR_NOMEM;
+        sm->out[i] = p;
+    }
+
+    sm->oalloc = n;
+    return WEB100_ERR_SUCCESS;
+}
+
+
+/*
+ * smoother_remap - Lay the state out for the connections in cids, of set
+ * if it is not NULL.  Those already known keep their state; new ones, and
+ * reused cids, start from their row of x.
+ */
+static int
+smoother_remap(web100_smoother *sm, const float *x, const int *cids, int n,
+               const web100_snapset *set)
+{
+    size_t nv = sm->nvals;
+    size_t ostride = (size_t)sm->alloc * nv, nstride;
+    const web100_connection *conn = NULL;
+    web100_connection *tconns;
+    int *tcids;
+    float *tewma, *tring;
+    int i = 0, j, k = 0, w, talloc, err;
+
+    if ((err = smoother_spare(sm, n)) != WEB100_ERR_SUCCESS)
+        return err;
+    nstride = (size_t)sm->salloc * nv;
+
+    for (j = 0; j < n; j++) {
+        while (i < sm->count && sm->cids[i] < cids[j])
+            i++;
+        if (set)
+            conn = smoother_conn(set, cids[j], &k);
+        sm->scids[j] = cids[j];
+        if (i < sm->count && sm->cids[i] == cids[j] &&
+            (conn == NULL || _web100_same_connection(&sm->conns[i], conn))) {
+            sm->sconns[j] = sm->conns[i];
+            memcpy(sm->sewma + j * nv, sm->ewma + i * nv, nv * sizeof (float));
+            for (w = 0; w < sm->window; w++)
+                memcpy(sm->sring + w * nstride + j * nv,
+                       sm->ring + w * ostride + i * nv, nv * sizeof (float));
+        } else {
+            if (conn)
+                sm->sconns[j] = *conn;
+            else
+                memset(&sm->sconns[j], 0, sizeof (web100_connection));
+            memcpy(sm->sewma + j * nv, x + j * nv, nv * sizeof (float));
+            for (w = 0; w < sm->window; w++)
+                memcpy(sm->sring + w * nstride + j * nv, x + j * nv,
+                       nv * sizeof (float));
+        }
+    }
+
+    tcids = sm->cids;   sm->cids = sm->scids;   sm->scids = tcids;
+    tconns = sm->conns; sm->conns = sm->sconns; sm->sconns = tconns;
+    tewma = sm->ewma;   sm->ewma = sm->sewma;   sm->sewma = tewma;
+    tring = sm->ring;   sm->ring = sm->sring;   sm->sring = tring;
+    talloc = sm->alloc; sm->alloc = sm->salloc; sm->salloc = talloc;
+    sm->count = n;
+
+    return WEB100_ERR_SUCCESS;
+}
+
+
+/*
+ * sweep - Fold n values of x into the state, which has the ring slots
+ * stride floats apart.
+ */
+static void
+sweep(web100_smoother *sm, const float *x, size_t n, size_t stride)
+{
+    const float wt = sm->weight, scale = 1.0f / (sm->window ? sm->window : 1);
+    float *ewma = sm->ewma;
+    float *slot = sm->window ? sm->ring + (size_t)sm->head * stride : NULL;
+    float *mean = sm->out[WEB100_SMOOTH_MEAN];
+    float *min = sm->out[WEB100_SMOOTH_MIN];
+    float *max = sm->out[WEB100_SMOOTH_MAX];
+    const float *r;
+    float v, s, lo, hi;
+    size_t k = 0;
+    int w;
+
+#ifdef __SSE__
+    /* Loaded, not passed, so no float argument meets a prototype */
+    const __m128 vwt = _mm_load1_ps(&wt), vscale = _mm_load1_ps(&scale);
+    __m128 vx, ve, vv, vs, vlo, vhi;
+
+    for (; k + 4 <= n; k += 4) {
+        vx = _mm_loadu_ps(x + k);
+        ve = _mm_loadu_ps(ewma + k);
+        ve = _mm_add_ps(ve, _mm_mul_ps(vwt, _mm_sub_ps(vx, ve)));
+        _mm_storeu_ps(ewma + k, ve);
+        if (sm->window == 0)
+            continue;
+
+        _mm_storeu_ps(slot + k, vx);
+        vs = vlo = vhi = _mm_loadu_ps(sm->ring + k);
+        for (w = 1, r = sm->ring + stride + k; w < sm->window; w++, r += stride) {
+            vv = _mm_loadu_ps(r);
+            vs = _mm_add_ps(vs, vv);
+            vlo = _mm_min_ps(vlo, vv);
+            vhi = _mm_max_ps(vhi, vv);
+        }
+        _mm_storeu_ps(mean + k, _mm_mul_ps(vs, vscale));
+        _mm_storeu_ps(min + k, vlo);
+        _mm_storeu_ps(max + k, vhi);
+    }
+#endif
+    for (; k < n; k++) {
+        ewma[k] += wt * (x[k] - ewma[k]);
+        if (sm->window == 0)
+            continue;
+
+        slot[k] = x[k];
+        s = lo = hi = sm->ring[k];
+        for (w = 1, r = sm->ring + stride + k; w < sm->window; w++, r += stride) {
+            v = *r;
+            s += v;
+            lo = v < lo ? v : lo;
+            hi = v > hi ? v : hi;
+        }
+        mean[k] = s * scale;
+        min[k] = lo;
+        max[k] = hi;
+    }
+}
+
+
+/*@
+web100_smoother_alloc - allocate a smoother for rows of per-connection values
+@*/
+web100_smoother*
+web100_smoother_alloc(int nvals, float weight, int window)
+{
+    web100_smoother *sm;
+
+    if (nvals <= 0 || !(weight > 0 && weight <= 1) || window < 0) {
+        web100_errno = WEB100_ERR_INVAL;
+        return NULL;
+    }
+
+    if ((sm = calloc(1, sizeof (web100_smoother))) == NULL) {
+        web100_errno = WEB100_ERR_NOMEM;
+        return NULL;
+    }
+    sm->nvals = nvals;
+    sm->weight = weight;
+    sm->window = window;
+
+    web100_errno = WEB100_ERR_SUCCESS;
+    return sm;
+}
+
+
+/*@
+web100_smoother_free - deallocate a smoother
+@*/
+void
+web100_smoother_free(web100_smoother *sm)
+{
+    int i;
+
+    if (sm == NULL)
+        return;
+
+    state_free(sm->cids, sm->conns, sm->ewma, sm->ring);
+    state_free(sm->scids, sm->sconns, sm->sewma, sm->sring);
+    for (i = WEB100_SMOOTH_MEAN; i <= WEB100_SMOOTH_MAX; i++)
+        free(sm->out[i]);
+    free(sm);
+}
+
+
+/*@
+web100_smoother_update - fold one sweep of per-connection values into a smoother
+@*/
+int
+web100_smoother_update(web100_smoother *sm, const float *values,
+                       const int *cids, int nrows, web100_snapset *set)
+{
+    const web100_connection *conn;
+    int i, k, same, err;
+
+    if (nrows < 0) {
+        web100_errno = WEB100_ERR_INVAL;
+        return -WEB100_ERR_INVAL;
+    }
+    for (i = 1; i < nrows; i++) {
+        if (cids[i] <= cids[i - 1]) {
+            web100_errno = WEB100_ERR_INVAL;
+            return -WEB100_ERR_INVAL;
+        }
+    }
+
+    /* Usually the same connections as last time, in which case no copying */
+    same = nrows == sm->count &&
+           (nrows == 0 || memcmp(cids, sm->cids, nrows * sizeof (int)) == 0);
+    for (i = 0, k = 0; set && i < nrows; i++) {
+        if ((conn = smoother_conn(set, cids[i], &k)) == NULL) {
+            web100_errno = WEB100_ERR_INVAL;
+            return -WEB100_ERR_INVAL;
+        }
+        if (same && !_web100_same_connection(&sm->conns[i], conn))
+            same = 0;
+    }
+    if (!same) {
+        if ((err = smoother_remap(sm, values, cids, nrows, set)) != WEB100_ERR_SUCCESS)
+            goto Cleanup;
+    }
+    if ((err = smoother_grow(sm, nrows)) != WEB100_ERR_SUCCESS)
+        goto Cleanup;
+
+    sweep(sm, values, (size_t)nrows * sm->nvals, (size_t)sm->alloc * sm->nvals);
+    if (sm->window)
+        sm->head = (sm->head + 1) % sm->window;
+
+ Cleanup:
+    web100_errno = err;
+    return -err;
+}
+
+
+/*@
+web100_smoother_stat - return the array of one statistic of a smoother
+@*/
+const float*
+web100_smoother_stat(web100_smoother *sm, WEB100_SMOOTH stat)
+{
+    if (stat < WEB100_SMOOTH_EWMA || stat > WEB100_SMOOTH_MAX ||
+        (stat != WEB100_SMOOTH_EWMA && sm->window == 0)) {
+        web100_errno = WEB100_ERR_INVAL;
+        return NULL;
+    }
+
+    web100_errno = WEB100_ERR_SUCCESS;
+    return stat == WEB100_SMOOTH_EWMA ? sm->ewma : sm->out[stat];
+}
+
+
+/*@
+web100_smoother_find - return the row of a connection in a smoother
+@*/
+int
+web100_smoother_find(web100_smoother *sm, int cid)
+{
+    int lo = 0, hi = sm->count, mid;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (sm->cids[mid] < cid)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if (lo == sm->count || sm->cids[lo] != cid) {
+        web100_errno = WEB100_ERR_NOCONNECTION;
+        return -WEB100_ERR_NOCONNECTION;
+    }
+
+    web100_errno = WEB100_ERR_SUCCESS;
+    return lo;
+}
+
+
+/*@
+web100_get_smoother_count - return the number of connections in a smoother
+@*/
+int
+web100_get_smoother_count(web100_smoother *sm)
+{
+    return sm->count;
+}
+
+
+/*@
+web100_get_smoother_cids - return the connection IDs of a smoother's rows
+@*/
+const int*
+web100_get_smoother_cids(web100_smoother *sm)
+{
+    return sm->cids;
+}
@@ -0,0 +1,321 @@
+/*
+ * Copyright (c) 2001 Carnegie Mellon University,
+ *                    The Board of Trustees of the University of Illinois,
+ *                    and University Corporation for Atmospheric Research.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ *
+ * Snapshot sets: one group snapshotted across all connections at once.
+ *
+ * A set keeps its own copies of the connections, so its snapshots stay
+ * usable after the agent's connection list is refreshed, and keeps all the
+ * data in one block in cid order, so two sets can be walked side by side.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "web100-int.h"
+
+
+static int
+cid_cmp(const void *a, const void *b)
+{
+    const web100_connection *ca = a, *cb = b;
+
+    return (ca->cid > cb->cid) - (ca->cid < cb->cid);
+}
+
+
+/*
+ * snapset_grow - Make room for n connections.
+ */
+static int
+snapset_grow(web100_snapset *set, int n)
+{
+    web100_snapshot *snaps;
+    web100_connection *conns;
+    char *data;
+
+    if (n <= set->alloc)
+        return WEB100_ERR_SUCCESS;
+    if (n < 2 * set->alloc)
+        n = 2 * set->alloc;
+
+    if ((snaps = realloc(set->snaps, n * sizeof (*snaps))) == NULL)
+        return WEB100_ERR_NOMEM;
+    set->snaps = snaps;
+    if ((conns = realloc(set->conns, n * sizeof (*conns))) == NULL)
+        return WEB100_ERR_NOMEM;
+    set->conns = conns;
+    if ((data = realloc(set->data, (size_t)n * set->group->size)) == NULL)
+        return WEB100_ERR_NOMEM;
+    set->data = data;
+
+    set->alloc = n;
+    return WEB100_ERR_SUCCESS;
+}
+
+
+/*@
+web100_snapset_alloc - allocate an empty snapshot set for a group
+@*/
+web100_snapset*
+web100_snapset_alloc(web100_group *group)
+{
+    web100_snapset *set;
+
+    if ((set = calloc(1, sizeof (web100_snapset))) == NULL) {
+        web100_errno = WEB100_ERR_NOMEM;
+        return NULL;
+    }
+    set->group = group;
+
+    web100_errno = WEB100_ERR_SUCCESS;
+    return set;
+}
+
+
+/*@
+web100_snapset_free - deallocate a snapshot set
+@*/
+void
+web100_snapset_free(web100_snapset *set)
+{
+    if (set == NULL)
+        return;
+
+    free(set->snaps);
+    free(set->conns);
+    free(set->data);
+    free(set);
+}
+
+
+/*@
+web100_snapset_take - snapshot the set's group on every current connection
+@*/
+int
+web100_snapset_take(web100_snapset *set)
+{
+    web100_agent *agent = GROUP_AGENT(set->group);
+    web100_connection *cp;
+    web100_snapshot *snap;
+    int size = set->group->size;
+    int n, i, err;
+
+    if (agent->type != WEB100_AGENT_TYPE_LOCAL && agent->info.local.replay == NULL) {
+        web100_errno = WEB100_ERR_AGENT_TYPE;
+        return -WEB100_ERR_AGENT_TYPE;
+    }
+
+    if ((cp = web100_connection_head(agent)) == NULL &&
+        web100_errno != WEB100_ERR_SUCCESS)
+        return -web100_errno;
+
+    for (n = 0; cp; cp = cp->info.local.next)
+        n++;
+    if ((err = snapset_grow(set, n)) != WEB100_ERR_SUCCESS) {
+        web100_errno = err;
+        return -err;
+    }
+
+    n = 0;
+    for (cp = agent->info.local.connection_head; cp; cp = cp->info.local.next) {
+        set->conns[n] = *cp;
+        set->conns[n].info.local.next = NULL;
+        n++;
+    }
+    qsort(set->conns, n, sizeof (web100_connection), cid_cmp);
+
+    /* Connections that close before we get to them are dropped */
+    set->count = 0;
+    for (i = 0; i < n; i++) {
+        if (i != set->count)
+            set->conns[set->count] = set->conns[i];
+        snap = &set->snaps[set->count];
+        snap->group = set->group;
+        snap->connection = &set->conns[set->count];
+        snap->data = set->data + (size_t)set->count * size;
+
+        if (web100_snap(snap) == WEB100_ERR_SUCCESS)
+            set->count++;
+        else if (web100_errno != WEB100_ERR_NOCONNECTION)
+            return -web100_errno;
+    }
+
+    web100_errno = WEB100_ERR_SUCCESS;
+    return WEB100_ERR_SUCCESS;
+}
+
+
+/*@
+web100_snapset_at - return the snapshot at an index of a snapshot set
+@*/
+web100_snapshot*
+web100_snapset_at(web100_snapset *set, int index)
+{
+    if (index < 0 || index >= set->count) {
+        web100_errno = WEB100_ERR_NOCONNECTION;
+        return NULL;
+    }
+
+    web100_errno = WEB100_ERR_SUCCESS;
+    return &set->snaps[index];
+}
+
+
+/*@
+web100_snapset_find - return the snapshot of a connection in a snapshot set
+@*/
+web100_snapshot*
+web100_snapset_find(web100_snapset *set, int cid)
+{
+    int lo = 0, hi = set->count, mid;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (set->conns[mid].cid < cid)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if (lo == set->count || set->conns[lo].cid != cid) {
+        web100_errno = WEB100_ERR_NOCONNECTION;
+        return NULL;
+    }
+
+    web100_errno = WEB100_ERR_SUCCESS;
+    return &set->snaps[lo];
+}
+
+
+/*
+ * _web100_same_connection - Whether two connections with one cid are the
+ * same, not a cid the kernel has given to a new connection in between.
+ */
+int
+_web100_same_connection(const web100_connection *a, const web100_connection *b)
+{
+    if (a->addrtype != b->addrtype)
+        return 0;
+    if (a->addrtype == WEB100_ADDRTYPE_IPV4)
+        return a->spec.src_addr == b->spec.src_addr &&
+               a->spec.dst_addr == b->spec.dst_addr &&
+               a->spec.src_port == b->spec.src_port &&
+               a->spec.dst_port == b->spec.dst_port;
+    return memcmp(a->spec_v6.src_addr, b->spec_v6.src_addr, 16) == 0 &&
+           memcmp(a->spec_v6.dst_addr, b->spec_v6.dst_addr, 16) == 0 &&
+           a->spec_v6.src_port == b->spec_v6.src_port &&
+           a->spec_v6.dst_port == b->spec_v6.dst_port;
+}
+
+
+/*
+ * snapset_rates - Rates for every connection in both sets, one row of
+ * nvars per connection, with the rows' cids in cids if it is not NULL.
+ * A cid whose addresses or ports differ between the sets was reused, and
+ * gets no row.  Returns the number of rows.
+ */
+static int
+snapset_rates(web100_snapset *s1, web100_snapset *s2, double *rates,
+              float *ratesf, int *cids)
+{
+    int nvars = s1->group->nlive;
+    int i = 0, j = 0, rows = 0;
+    int c1, c2, err;
+
+    if (s1->group != s2->group) {
+        web100_errno = WEB100_ERR_INVAL;
+        return -WEB100_ERR_INVAL;
+    }
+
+    while (i < s1->count && j < s2->count) {
+        c1 = s1->conns[i].cid;
+        c2 = s2->conns[j].cid;
+        if (c1 < c2) {
+            i++;
+        } else if (c1 > c2) {
+            j++;
+        } else if (!_web100_same_connection(&s1->conns[i], &s2->conns[j])) {
+            i++;
+            j++;
+        } else {
+            if (rates)
+                err = web100_snapshot_rates(&s1->snaps[i], &s2->snaps[j],
+                                            rates + (size_t)rows * nvars);
+            else
+                err = web100_snapshot_ratesf(&s1->snaps[i], &s2->snaps[j],
+                                             ratesf + (size_t)rows * nvars);
+            /* Snapshots taken at the same instant have no rate */
+            if (err == WEB100_ERR_SUCCESS) {
+                if (cids)
+                    cids[rows] = c1;
+                rows++;
+            }
+            i++;
+            j++;
+        }
+    }
+
+    web100_errno = WEB100_ERR_SUCCESS;
+    return rows;
+}
+
+
+/*@
+web100_snapset_rates - per-second counter rates for every connection of two sets
+@*/
+int
+web100_snapset_rates(web100_snapset *s1, web100_snapset *s2, double *rates,
+                     int *cids)
+{
+    return snapset_rates(s1, s2, rates, NULL, cids);
+}
+
+
+/*@
+web100_snapset_ratesf - web100_snapset_rates into an array of float
+@*/
+int
+web100_snapset_ratesf(web100_snapset *s1, web100_snapset *s2, float *rates,
+                      int *cids)
+{
+    return snapset_rates(s1, s2, NULL, rates, cids);
+}
+
+
+/*@
+web100_get_snapset_group - return the group of a snapshot set
+@*/
+web100_group*
+web100_get_snapset_group(web100_snapset *set)
+{
+    return set->group;
+}
+
+
+/*@
+web100_get_snapset_count - return the number of connections in a snapshot set
+@*/
+int
+web100_get_snapset_count(web100_snapset *set)
+{
+    return set->count;
+}
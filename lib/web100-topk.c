@@ -0,0 +1,220 @@
+/*
+ * Copyright (c) 2001 Carnegie Mellon University,
+ *                    The Board of Trustees of the University of Illinois,
+ *                    and University Corporation for Atmospheric Research.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ *
+ * The k connections with the largest value of something.
+ *
+ * The tracker is a min-heap of at most k entries, so its root is the
+ * smallest value still in the running.  Most values of a large sweep are
+ * below it and cost one comparison; the rest replace the root and sift
+ * down, O(log k).  Equal values rank the lower cid first.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "web100-int.h"
+
+
+/* a ranks below b */
+#define TOPK_BELOW(a, b) \
+    ((a)->value < (b)->value || ((a)->value == (b)->value && (a)->cid > (b)->cid))
+
+
+static void
+topk_sift_down(struct web100_topk_entry *heap, int n, int i)
+{
+    struct web100_topk_entry e = heap[i];
+    int c;
+
+    while ((c = 2 * i + 1) < n) {
+        if (c + 1 < n && TOPK_BELOW(&heap[c + 1], &heap[c]))
+            c++;
+        if (!TOPK_BELOW(&heap[c], &e))
+            break;
+        heap[i] = heap[c];
+        i = c;
+    }
+    heap[i] = e;
+}
+
+
+static void
+topk_sift_up(struct web100_topk_entry *heap, int i)
+{
+    struct web100_topk_entry e = heap[i];
+    int p;
+
+    while (i > 0 && TOPK_BELOW(&e, &heap[p = (i - 1) / 2])) {
+        heap[i] = heap[p];
+        i = p;
+    }
+    heap[i] = e;
+}
+
+
+static void
+topk_add(web100_topk *tk, double value, int cid)
+{
+    struct web100_topk_entry e;
+
+    if (value != value)         /* NaN */
+        return;
+
+    e.value = value;
+    e.cid = cid;
+    if (tk->count < tk->k) {
+        tk->heap[tk->count] = e;
+        topk_sift_up(tk->heap, tk->count++);
+    } else if (TOPK_BELOW(&tk->heap[0], &e)) {
+        tk->heap[0] = e;
+        topk_sift_down(tk->heap, tk->count, 0);
+    }
+}
+
+
+/*@
+web100_topk_alloc - allocate a tracker of the k largest values
+@*/
+web100_topk*
+web100_topk_alloc(int k)
+{
+    web100_topk *tk;
+
+    if (k <= 0) {
+        web100_errno = WEB100_ERR_INVAL;
+        return NULL;
+    }
+
+    if ((tk = calloc(1, sizeof (web100_topk))) == NULL ||
+        (tk->heap = malloc(k * sizeof (struct web100_topk_entry))) == NULL) {
+        free(tk);
+        web100_errno = WEB100_ERR_NOMEM;
+        return NULL;
+    }
+    tk->k = k;
+
+    web100_errno = WEB100_ERR_SUCCESS;
+    return tk;
+}
+
+
+/*@
+web100_topk_free - deallocate a top-k tracker
+@*/
+void
+web100_topk_free(web100_topk *tk)
+{
+    if (tk == NULL)
+        return;
+
+    free(tk->heap);
+    free(tk);
+}
+
+
+/*@
+web100_topk_reset - empty a top-k tracker
+@*/
+void
+web100_topk_reset(web100_topk *tk)
+{
+    tk->count = 0;
+}
+
+
+/*@
+web100_topk_add - offer values of connections to a top-k tracker
+@*/
+void
+web100_topk_add(web100_topk *tk, const double *values, const int *cids,
+                int n, int stride)
+{
+    int i;
+
+    for (i = 0; i < n; i++, values += stride)
+        topk_add(tk, *values, cids[i]);
+}
+
+
+/*@
+web100_snapset_topk - offer a variable of every connection in a set to a top-k tracker
+@*/
+int
+web100_snapset_topk(web100_snapset *set, web100_accessor *acc, web100_topk *tk)
+{
+    int i;
+
+    if (acc->group != set->group) {
+        web100_errno = WEB100_ERR_INVAL;
+        return -WEB100_ERR_INVAL;
+    }
+
+    for (i = 0; i < set->count; i++)
+        topk_add(tk, _web100_get_double(&set->snaps[i], acc),
+                 set->conns[i].cid);
+
+    web100_errno = WEB100_ERR_SUCCESS;
+    return WEB100_ERR_SUCCESS;
+}
+
+
+/*@
+web100_topk_sorted - return the entries of a top-k tracker, largest first
+@*/
+int
+web100_topk_sorted(web100_topk *tk, double *values, int *cids)
+{
+    struct web100_topk_entry e;
+    int n, i;
+
+    /* Heapsort in place; a min-heap sorts into descending order */
+    for (n = tk->count; n > 1; n--) {
+        e = tk->heap[0];
+        tk->heap[0] = tk->heap[n - 1];
+        tk->heap[n - 1] = e;
+        topk_sift_down(tk->heap, n - 1, 0);
+    }
+    for (i = 0; i < tk->count; i++) {
+        if (values)
+            values[i] = tk->heap[i].value;
+        if (cids)
+            cids[i] = tk->heap[i].cid;
+    }
+    /* Ascending order is a min-heap again */
+    for (i = 0; i < tk->count / 2; i++) {
+        e = tk->heap[i];
+        tk->heap[i] = tk->heap[tk->count - 1 - i];
+        tk->heap[tk->count - 1 - i] = e;
+    }
+
+    return tk->count;
+}
+
+
+/*@
+web100_get_topk_count - return the number of entries in a top-k tracker
+@*/
+int
+web100_get_topk_count(web100_topk *tk)
+{
+    return tk->count;
+}
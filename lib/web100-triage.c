@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2001 Carnegie Mellon University,
+ *                    The Board of Trustees of the University of Illinois,
+ *                    and University Corporation for Atmospheric Research.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ *
+ * Triage: what limited each connection's sending.
+ *
+ * The kernel splits the time a connection spends sending into time limited
+ * by the sender itself, by the congestion window and by the receiver's
+ * window (SndLimTimeSender, SndLimTimeCwnd and SndLimTimeRwin).  The share
+ * of each over an interval is what the triage widget of the GUI shows for
+ * one connection; here it is worked out for every connection in a pair of
+ * snapshot sets.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+#include "web100-int.h"
+
+/* Rows are scaled in blocks of this many, with their totals on the stack */
+#define TRIAGE_BLOCK 64
+
+static const char* const triage_vars[WEB100_TRIAGE_N] = {
+    "SndLimTimeSender",
+    "SndLimTimeCwnd",
+    "SndLimTimeRwin"
+};
+
+
+/*
+ * triage_scale - Divide each of n rows of f by its total in tot, leaving
+ * rows with no total as all 0.  Four rows are twelve floats, so the SIMD
+ * path spreads the four reciprocals across three vectors to match.
+ */
+static void
+triage_scale(float *f, const float *tot, int n)
+{
+    float inv;
+    int i = 0, k;
+
+#ifdef __SSE__
+    const float unit = 1;
+    const __m128 one = _mm_load1_ps(&unit), zero = _mm_setzero_ps();
+    __m128 t, vinv;
+    float *r;
+
+    for (; i + 4 <= n; i += 4) {
+        r = f + WEB100_TRIAGE_N * i;
+        t = _mm_loadu_ps(tot + i);
+        vinv = _mm_and_ps(_mm_div_ps(one, t), _mm_cmpgt_ps(t, zero));
+        _mm_storeu_ps(r, _mm_mul_ps(_mm_loadu_ps(r),
+                      _mm_shuffle_ps(vinv, vinv, _MM_SHUFFLE(1, 0, 0, 0))));
+        _mm_storeu_ps(r + 4, _mm_mul_ps(_mm_loadu_ps(r + 4),
+                      _mm_shuffle_ps(vinv, vinv, _MM_SHUFFLE(2, 2, 1, 1))));
+        _mm_storeu_ps(r + 8, _mm_mul_ps(_mm_loadu_ps(r + 8),
+                      _mm_shuffle_ps(vinv, vinv, _MM_SHUFFLE(3, 3, 3, 2))));
+    }
+#endif
+    for (; i < n; i++) {
+        inv = tot[i] > 0 ? 1.0f / tot[i] : 0;
+        for (k = 0; k < WEB100_TRIAGE_N; k++)
+            f[WEB100_TRIAGE_N * i + k] *= inv;
+    }
+}
+
+
+/*@
+web100_snapset_triage - send limit fractions for every connection of two sets
+@*/
+int
+web100_snapset_triage(web100_snapset *s1, web100_snapset *s2,
+                      float *fractions, int *cids)
+{
+    web100_accessor acc[WEB100_TRIAGE_N];
+    u_int64_t mask[WEB100_TRIAGE_N];
+    float tot[TRIAGE_BLOCK];
+    float *row;
+    int i = 0, j = 0, k, rows = 0, base = 0;
+    int c1, c2;
+
+    if (s1->group != s2->group) {
+        web100_errno = WEB100_ERR_INVAL;
+        return -WEB100_ERR_INVAL;
+    }
+
+    for (k = 0; k < WEB100_TRIAGE_N; k++) {
+        if (web100_accessor_find(&acc[k], s1->group, triage_vars[k]) < 0)
+            return -web100_errno;
+        mask[k] = acc[k].size < 8 ? ((u_int64_t)1 << 8 * acc[k].size) - 1
+                                  : ~(u_int64_t)0;
+    }
+
+    while (i < s1->count && j < s2->count) {
+        c1 = s1->conns[i].cid;
+        c2 = s2->conns[j].cid;
+        if (c1 < c2) {
+            i++;
+        } else if (c1 > c2) {
+            j++;
+        } else if (!_web100_same_connection(&s1->conns[i], &s2->conns[j])) {
+            /* The cid was reused in between */
+            i++;
+            j++;
+        } else {
+            /* Counters wrap at their own width */
+            row = fractions + WEB100_TRIAGE_N * rows;
+            tot[rows - base] = 0;
+            for (k = 0; k < WEB100_TRIAGE_N; k++) {
+                row[k] = (float)((web100_get_uint(&s1->snaps[i], &acc[k]) -
+                                  web100_get_uint(&s2->snaps[j], &acc[k])) &
+                                 mask[k]);
+                tot[rows - base] += row[k];
+            }
+            if (cids)
+                cids[rows] = c1;
+            if (++rows - base == TRIAGE_BLOCK) {
+                triage_scale(fractions + WEB100_TRIAGE_N * base, tot,
+                             TRIAGE_BLOCK);
+                base = rows;
+            }
+            i++;
+            j++;
+        }
+    }
+    triage_scale(fractions + WEB100_TRIAGE_N * base, tot, rows - base);
+
+    web100_errno = WEB100_ERR_SUCCESS;
+    return rows;
+}
@@ -0,0 +1,321 @@
+/*
+ * Copyright (c) 2001 Carnegie Mellon University,
+ *                    The Board of Trustees of the University of Illinois,
+ *                    and University Corporation for Atmospheric Research.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation; either version 2.1 of the License, or (at your
+ * option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307  USA
+ *
+ * Snapshots on the wire.
+ *
+ * A stream of frames, each in memory the caller owns.  A schema frame
+ * carries the text of a header once, under its fingerprint; each record
+ * frame after it names the fingerprint and the group, and carries the
+ * connection's cid and addresses, the snapshot's times, and the group's
+ * data as it was read.  Frames are kept to multiples of 8 bytes, so
+ * records packed back to back stay aligned, and a decoded snapshot's data
+ * points straight into the frame rather than being copied out.
+ *
+ * Frames are in the byte order of the host that wrote them; a reader on
+ * the other order sees a bad magic number.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "web100-int.h"
+
+#define ALIGN8(x)  (((x) + 7) & ~(size_t)7)
+
+#define WIRE_HEAD  (sizeof (struct web100_wire_frame) + sizeof (struct web100_wire_record))
+
+
+/*
+ * wire_schema_add - Compile the header text of a schema frame and keep
+ * it, with its groups indexed by id, which must be the text's hash: the
+ * records that follow are decoded by the schema their id names.
+ */
+static struct web100_wire_schema*
+wire_schema_add(web100_wire *wire, u_int64_t id, const char *text, size_t len)
+{
+    struct web100_wire_schema *sch, *nschemas;
+    web100_agent *agent;
+    web100_group *gp;
+    int n;
+
+    if (wire->count == wire->alloc) {
+        n = wire->alloc ? 2 * wire->alloc : 4;
+        if ((nschemas = realloc(wire->schemas, n * sizeof (*nschemas))) == NULL) {
+            web100_errno = WEB100_ERR_NOMEM;
+            return NULL;
+        }
+        wire->schemas = nschemas;
+        wire->alloc = n;
+    }
+
+    if (_web100_hash(text, len) != id) {
+        web100_errno = WEB100_ERR_HEADER;
+        return NULL;
+    }
+    if ((agent = _web100_agent_attach_header(text, len, 0)) == NULL)
+        return NULL;
+    agent->type = WEB100_AGENT_TYPE_LOG;
+
+    sch = &wire->schemas[wire->count];
+    sch->id = id;
+    sch->agent = agent;
+    sch->ngroups = agent->info.local.image->ngroups;
+    if ((sch->groups = calloc(sch->ngroups + 1, sizeof (web100_group *))) == NULL) {
+        web100_detach(agent);
+        web100_errno = WEB100_ERR_NOMEM;
+        return NULL;
+    }
+    for (gp = AGENT_GROUP_HEAD(agent); gp; gp = GROUP_NEXT(gp))
+        sch->groups[gp->id] = gp;
+    if ((gp = AGENT_SPEC(agent)) != NULL)
+        sch->groups[gp->id] = gp;
+
+    wire->count++;
+    return sch;
+}
+
+
+static struct web100_wire_schema*
+wire_schema_find(web100_wire *wire, u_int64_t id)
+{
+    int i;
+
+    for (i = 0; i < wire->count; i++)
+        if (wire->schemas[i].id == id)
+            return &wire->schemas[i];
+    return NULL;
+}
+
+
+/*@
+web100_wire_size - return the length of a wire record of a group
+@*/
+int
+web100_wire_size(web100_group *group)
+{
+    return WIRE_HEAD + ALIGN8(group->size);
+}
+
+
+/*@
+web100_wire_encode_schema - write a wire frame describing an agent's header
+@*/
+int
+web100_wire_encode_schema(web100_agent *agent, void *buf, size_t size)
+{
+    struct web100_image *image = agent->info.local.image;
+    struct web100_wire_frame frame;
+    char *p = buf;
+
+    frame.magic = WEB100_WIRE_MAGIC;
+    frame.length = sizeof (frame) + ALIGN8(image->header_len);
+    frame.type = WEB100_WIRE_SCHEMA;
+    frame.group = image->header_len;
+    frame.schema = image->hash;
+
+    if (frame.length <= size) {
+        memcpy(p, &frame, sizeof (frame));
+        memcpy(p + sizeof (frame), AGENT_HEADER(agent), image->header_len);
+        memset(p + sizeof (frame) + image->header_len, 0,
+               frame.length - sizeof (frame) - image->header_len);
+    }
+
+    web100_errno = WEB100_ERR_SUCCESS;
+    return frame.length;
+}
+
+
+/*@
+web100_wire_encode - write a snapshot as a wire record
+@*/
+int
+web100_wire_encode(web100_snapshot *snap, void *buf, size_t size)
+{
+    web100_group *group = snap->group;
+    web100_connection *conn = snap->connection;
+    struct {
+        struct web100_wire_frame frame;
+        struct web100_wire_record rec;
+    } head;
+    char *p = buf;
+    int len = web100_wire_size(group);
+
+    web100_errno = WEB100_ERR_SUCCESS;
+    if (len > size)
+        return len;
+
+    memset(&head, 0, sizeof (head));
+    head.frame.magic = WEB100_WIRE_MAGIC;
+    head.frame.length = len;
+    head.frame.type = WEB100_WIRE_RECORD;
+    head.frame.group = group->id;
+    head.frame.schema = GROUP_AGENT(group)->info.local.image->hash;
+
+    head.rec.cid = -1;
+    if (conn) {
+        head.rec.cid = conn->cid;
+        head.rec.addrtype = conn->addrtype;
+        if (conn->addrtype == WEB100_ADDRTYPE_IPV4) {
+            memcpy(head.rec.local_addr, &conn->spec.src_addr, 4);
+            memcpy(head.rec.rem_addr, &conn->spec.dst_addr, 4);
+            head.rec.local_port = conn->spec.src_port;
+            head.rec.rem_port = conn->spec.dst_port;
+        } else {
+            memcpy(head.rec.local_addr, conn->spec_v6.src_addr, 16);
+            memcpy(head.rec.rem_addr, conn->spec_v6.dst_addr, 16);
+            head.rec.local_port = conn->spec_v6.src_port;
+            head.rec.rem_port = conn->spec_v6.dst_port;
+        }
+    }
+    head.rec.time_mono = snap->time_mono;
+    head.rec.time_wall = snap->time_wall;
+
+    memcpy(p, &head, WIRE_HEAD);
+    memcpy(p + WIRE_HEAD, snap->data, group->size);
+    memset(p + WIRE_HEAD + group->size, 0, ALIGN8(group->size) - group->size);
+
+    return len;
+}
+
+
+/*@
+web100_wire_alloc - allocate a wire decoder
+@*/
+web100_wire*
+web100_wire_alloc(void)
+{
+    web100_wire *wire;
+
+    if ((wire = calloc(1, sizeof (web100_wire))) == NULL) {
+        web100_errno = WEB100_ERR_NOMEM;
+        return NULL;
+    }
+
+    web100_errno = WEB100_ERR_SUCCESS;
+    return wire;
+}
+
+
+/*@
+web100_wire_free - deallocate a wire decoder and the agents of its schemas
+@*/
+void
+web100_wire_free(web100_wire *wire)
+{
+    int i;
+
+    if (wire == NULL)
+        return;
+
+    for (i = 0; i < wire->count; i++) {
+        web100_detach(wire->schemas[i].agent);
+        free(wire->schemas[i].groups);
+    }
+    free(wire->schemas);
+    free(wire);
+}
+
+
+/*@
+web100_wire_decode - read the next wire frame from a buffer
+@*/
+int
+web100_wire_decode(web100_wire *wire, const void *buf, size_t len,
+                   web100_snapshot *snap)
+{
+    struct web100_wire_frame frame;
+    struct web100_wire_record rec;
+    struct web100_wire_schema *sch;
+    web100_connection *conn = &wire->conn;
+    web100_group *group;
+    const char *p = buf;
+
+    snap->group = NULL;
+    snap->connection = NULL;
+    snap->data = NULL;
+
+    web100_errno = WEB100_ERR_SUCCESS;
+    if (len < sizeof (frame))
+        return 0;                   /* not a whole frame yet */
+    memcpy(&frame, p, sizeof (frame));
+    if (frame.magic != WEB100_WIRE_MAGIC || frame.length < sizeof (frame) ||
+        frame.length % 8 != 0) {
+        web100_errno = WEB100_ERR_INVAL;
+        return -WEB100_ERR_INVAL;
+    }
+    if (frame.length > len)
+        return 0;
+
+    switch (frame.type) {
+    case WEB100_WIRE_SCHEMA:
+        if (frame.group > frame.length - sizeof (frame)) {
+            web100_errno = WEB100_ERR_INVAL;
+            return -WEB100_ERR_INVAL;
+        }
+        if (wire_schema_find(wire, frame.schema) == NULL &&
+            wire_schema_add(wire, frame.schema, p + sizeof (frame), frame.group) == NULL)
+            return -web100_errno;
+        break;
+
+    case WEB100_WIRE_RECORD:
+        if ((sch = wire_schema_find(wire, frame.schema)) == NULL) {
+            web100_errno = WEB100_ERR_HEADER;
+            return -WEB100_ERR_HEADER;
+        }
+        if (frame.group >= sch->ngroups ||
+            (group = sch->groups[frame.group]) == NULL ||
+            frame.length != web100_wire_size(group)) {
+            web100_errno = WEB100_ERR_INVAL;
+            return -WEB100_ERR_INVAL;
+        }
+        memcpy(&rec, p + sizeof (frame), sizeof (rec));
+
+        memset(conn, 0, sizeof (*conn));
+        conn->cid = rec.cid;
+        conn->addrtype = rec.addrtype;
+        conn->agent = sch->agent;
+        if (rec.addrtype == WEB100_ADDRTYPE_IPV4) {
+            memcpy(&conn->spec.src_addr, rec.local_addr, 4);
+            memcpy(&conn->spec.dst_addr, rec.rem_addr, 4);
+            conn->spec.src_port = rec.local_port;
+            conn->spec.dst_port = rec.rem_port;
+        } else {
+            memcpy(conn->spec_v6.src_addr, rec.local_addr, 16);
+            memcpy(conn->spec_v6.dst_addr, rec.rem_addr, 16);
+            conn->spec_v6.src_port = rec.local_port;
+            conn->spec_v6.dst_port = rec.rem_port;
+        }
+
+        snap->group = group;
+        snap->connection = conn;
+        snap->data = (void *)(p + WIRE_HEAD);
+        snap->time_mono = rec.time_mono;
+        snap->time_wall = rec.time_wall;
+        break;
+
+    default:
+        /* Frames of kinds we do not know are skipped */
+        break;
+    }
+
+    return frame.length;
+}
@@ -81,6 +81,7 @@ const char* const web100_sys_errlist[] = {
     "group not found",                     /* WEB100_ERR_NOGROUP */
     "socket operation failed",             /* WEB100_ERR_SOCK */
     "unexpected error due to kernel version mismatch", /* WEB100_ERR_KERNVER */
+    "log queue full",                      /* WEB100_ERR_FULL */
 };
 
 /*
@@ -95,230 +96,53 @@ int web100_sys_nerr = ARRAYSIZE(web100_sys_errlist);
 
 static inline void dep_check(web100_var *var)
 {
+    web100_agent *agent;
+    unsigned char *warned;
+
     if (var->flags & WEB100_VAR_FL_DEP) {
-        if (!(var->flags & WEB100_VAR_FL_WARNED) && !web100_quiet)
+        /* The image may be shared read-only, so remember warnings in the
+         * agent rather than in the variable */
+        agent = VAR_AGENT(var);
+        if ((warned = agent->info.local.dep_warned) == NULL)
+            warned = agent->info.local.dep_warned =
+                calloc((agent->info.local.image->nvars + 7) / 8, 1);
+        if (warned && (warned[var->id / 8] & (1 << (var->id % 8))))
+            return;
+        if (!web100_quiet)
             fprintf(stderr, "libweb100: warning: accessing depricated variable %s\n", var->name);
-        var->flags |= WEB100_VAR_FL_WARNED;
+        if (warned)
+            warned[var->id / 8] |= 1 << (var->id % 8);
     }
 }
 
 /*
- * size_from_type - Returns the size in bytes of an object of the specified
- * type.
+ * _web100_agent_attach_local - Attaches to the local Web100 installation,
+ * or to an alternate copy of its header if one is given.
  */
-static int
-size_from_type(WEB100_TYPE type)
-{
-    switch (type) {
-    case WEB100_TYPE_INTEGER:
-    case WEB100_TYPE_INTEGER32:
-    case WEB100_TYPE_INET_ADDRESS_IPV4:
-    case WEB100_TYPE_COUNTER32:
-    case WEB100_TYPE_GAUGE32:
-    case WEB100_TYPE_UNSIGNED32:
-    case WEB100_TYPE_TIME_TICKS:
-        return 4;
-    case WEB100_TYPE_COUNTER64:
-        return 8;
-    case WEB100_TYPE_INET_PORT_NUMBER:
-        return 2;
-    case WEB100_TYPE_INET_ADDRESS:
-    case WEB100_TYPE_INET_ADDRESS_IPV6:
-        return 17;
-    case WEB100_TYPE_STR32:
-        return 32;
-    case WEB100_TYPE_OCTET:
-        return 1;
-    default:
-        return 0;
-    }
-}
-
-
-/*
- * web100_attach_local - Initializes the provided agent with the information
- * from the local Web100 installation.  Returns NULL and sets web100_errno
- * on failure.
- */ 
-static web100_agent*
-_web100_agent_attach_header(FILE *header)
-{
-    web100_agent* agent = NULL;
-    int c;
-    web100_group* gp;
-    web100_var* vp; 
-    int fsize;
-    char tmpbuf[WEB100_VARNAME_LEN_MAX];
-    int have_len = 0;
-
-    if ((agent = malloc(sizeof(web100_agent))) == NULL) {
-        web100_errno = WEB100_ERR_NOMEM;
-        goto Cleanup;
-    }
-
-    /* agent must be 0-filled to get the correct list adding semantics */
-    bzero(agent, sizeof(web100_agent));
-
-    if (fscanf(header, "%[^\n]", agent->version) != 1) {
-        web100_errno = WEB100_ERR_HEADER;
-        goto Cleanup;
-    }
-    if (strncmp(agent->version, "1.", 2) != 0)
-        have_len = 1;
-
-    /* XXX: Watch out for failure cases, be sure to deallocate memory
-     * properly */
-    
-    gp = NULL; 
-    while (!feof(header) && !ferror(header)) {
-        while (isspace(c = fgetc(header)))
-            ;
-        
-        if (c < 0) {
-            break;
-        } else if (c == '/') {
-            if ((gp = (web100_group*) malloc(sizeof(web100_group))) == NULL) {
-                web100_errno = WEB100_ERR_NOMEM;
-                goto Cleanup;
-            }
-                
-            gp->agent = agent;
-            
-            if (fscanf(header, "%s", gp->name) != 1) {
-                web100_errno = WEB100_ERR_HEADER;
-                goto Cleanup;
-            }
-            
-            IFDEBUG(printf("_web100_agent_attach_local: new group: %s\n", gp->name));
-            
-            gp->size = 0;
-            gp->nvars = 0;
-            
-            if (strcmp(gp->name, "spec") == 0) {
-                agent->info.local.spec = gp;
-            } else {
-                gp->info.local.var_head = NULL;
-                gp->info.local.next = agent->info.local.group_head;
-                agent->info.local.group_head = gp;
-            }
-        } else {
-            ungetc(c, header);
-            
-            if (gp == NULL) {
-                web100_errno = WEB100_ERR_HEADER;
-                goto Cleanup;
-            }
-            
-            if ((vp = (web100_var *)malloc(sizeof (web100_var))) == NULL) {
-                web100_errno = WEB100_ERR_NOMEM;
-                goto Cleanup;
-            }
-
-            vp->group = gp;
-            
-            if (!have_len) {
-                if (fscanf(header, "%s%d%d", vp->name, &vp->offset, &vp->type) != 3) {
-                    web100_errno = WEB100_ERR_HEADER;
-                    goto Cleanup;
-                }
-                vp->len = -1;
-            } else {
-                if (fscanf(header, "%s%d%d%d", vp->name, &vp->offset, &vp->type, &vp->len) != 4) {
-                    web100_errno = WEB100_ERR_HEADER;
-                    goto Cleanup;
-                }
-            }
-            
-            /* Depricated variable check */
-            vp->flags = 0;
-            if (vp->name[0] == '_') {
-                vp->flags |= WEB100_VAR_FL_DEP;
-                strcpy(tmpbuf, vp->name);      /* Strip off leading _ */
-                strcpy(vp->name, tmpbuf + 1);
-                IFDEBUG(printf("_web100_agent_attach_local: depricated var: %s\n", vp->name));
-            }
-
-            IFDEBUG(printf("_web100_agent_attach_local: new var: %s %d %d\n", vp->name, vp->offset, vp->type));
-
-	    /* increment group (== file) size if necessary */ 
-            fsize = vp->offset + size_from_type(vp->type);
-            gp->size = ((gp->size < fsize) ? fsize : gp->size); 
-            
-	    /* if size_from_type 0 (i.e., type unrecognized),
-	       forgo adding the variable */
-	    if(!size_from_type(vp->type)) {
-		free(vp);
-		continue;
-	    }
-
-            gp->nvars++;
-            
-            vp->info.local.next = gp->info.local.var_head;
-            gp->info.local.var_head = vp;
-        }
-    }
-   
-    web100_errno = WEB100_ERR_SUCCESS;
-    
- Cleanup:
-    if (web100_errno != WEB100_ERR_SUCCESS) {
-        web100_detach(agent);
-        agent = NULL;
-    }
-    
-    return agent;
-}
-
-
 static web100_agent*
-_web100_agent_attach_local(void)
+_web100_agent_attach_local(const char *path)
 {
     web100_agent* agent = NULL;
-    FILE* header = NULL;
-    int c;
-    web100_group* gp;
-    web100_var* vp;
+    char *buf = NULL;
+    size_t len;
+    int fd;
 
-    if ((header = fopen(WEB100_HEADER_FILE, "r")) == NULL) {
+    if ((fd = open(path ? path : WEB100_HEADER_FILE, O_RDONLY)) < 0) {
         web100_errno = WEB100_ERR_HEADER;
-        goto Cleanup;
+        return NULL;
     }
 
-    if((agent = _web100_agent_attach_header(header)) == NULL)
-       	goto Cleanup;
-
-    agent->type = WEB100_AGENT_TYPE_LOCAL;
+    buf = _web100_read_all(fd, &len);
+    close(fd);
+    if (buf == NULL)
+        return NULL;
 
-    web100_errno = WEB100_ERR_SUCCESS;
-    
- Cleanup:
-    if (header != NULL) {
-        fclose(header);
-        header = NULL;
-    }
-    
-    if (web100_errno != WEB100_ERR_SUCCESS) { 
-        web100_detach(agent);
-        agent = NULL;
+    if ((agent = _web100_agent_attach_header(buf, len, 1)) != NULL) {
+        agent->type = WEB100_AGENT_TYPE_LOCAL;
+        web100_errno = WEB100_ERR_SUCCESS;
     }
-    
-    return agent;
-}
-
-
-static web100_agent*
-_web100_agent_attach_log(FILE *header)
-{
-    web100_agent* agent = NULL;
-
-    if((agent = _web100_agent_attach_header(header)) == NULL) {
-	return NULL;
-    } 
-
-    agent->type = WEB100_AGENT_TYPE_LOG;
 
-    web100_errno = WEB100_ERR_SUCCESS;
-    
+    free(buf);
     return agent;
 }
 
@@ -370,7 +194,7 @@ refresh_connections(web100_agent *agent)
         cp->info.local.next = agent->info.local.connection_head;
         agent->info.local.connection_head = cp;
         
-        spec_gp = agent->info.local.spec;
+        spec_gp = AGENT_SPEC(agent);
         
         if ((var = web100_var_find(spec_gp, "LocalAddressType")) == NULL)
             cp->addrtype = WEB100_ADDRTYPE_IPV4;
@@ -452,9 +276,16 @@ web100_strerror(int errnum)
 web100_agent*
 web100_attach(int type, void *data)
 {
+    const char *log;
+
     switch (type) {
     case WEB100_AGENT_TYPE_LOCAL:
-        return _web100_agent_attach_local();
+        /* A log played back in place of the kernel, for tools run on it */
+        if (data == NULL && (log = getenv("WEB100_REPLAY")) != NULL && log[0])
+            return _web100_agent_attach_replay(log);
+        return _web100_agent_attach_local((const char *)data);
+    case WEB100_AGENT_TYPE_LOG:
+        return _web100_agent_attach_replay((const char *)data);
     default:
         web100_errno = WEB100_ERR_AGENT_TYPE;
         return NULL;
@@ -465,26 +296,16 @@ web100_attach(int type, void *data)
 void
 web100_detach(web100_agent *agent)
 {
-    web100_group *gp, *gp2;
-    web100_var *vp, *vp2;
     web100_connection *cp, *cp2;
     
     if (agent == NULL) {
         return;
     }
-    
-    gp = agent->info.local.group_head;
-    while (gp) {
-        vp = gp->info.local.var_head;
-        while (vp) {
-            vp2 = vp->info.local.next;
-            free(vp);
-            vp = vp2;
-        }
-        
-        gp2 = gp->info.local.next;
-        free(gp);
-        gp = gp2;
+
+    /* A replay's agent is its log's, and goes with it */
+    if (agent->info.local.replay) {
+        _web100_replay_free(agent);
+        return;
     }
     
     cp = agent->info.local.connection_head;
@@ -494,7 +315,8 @@ web100_detach(web100_agent *agent)
         cp = cp2;
     }
     
-    free(agent);
+    /* Groups and variables share the agent's allocation */
+    _web100_agent_free(agent);
 }
 
 
@@ -507,20 +329,20 @@ web100_group_head(web100_agent *agent)
     }
     
     web100_errno = WEB100_ERR_SUCCESS;
-    return agent->info.local.group_head;
+    return AGENT_GROUP_HEAD(agent);
 }
 
 
 web100_group*
 web100_group_next(web100_group *group)
 {
-    if (!((group->agent->type == WEB100_AGENT_TYPE_LOCAL) || (group->agent->type == WEB100_AGENT_TYPE_LOG))) {
+    if (!((GROUP_AGENT(group)->type == WEB100_AGENT_TYPE_LOCAL) || (GROUP_AGENT(group)->type == WEB100_AGENT_TYPE_LOG))) {
 	web100_errno = WEB100_ERR_AGENT_TYPE;
 	return NULL;
     }
     
     web100_errno = WEB100_ERR_SUCCESS;
-    return group->info.local.next;
+    return GROUP_NEXT(group);
 }
 
 
@@ -534,11 +356,11 @@ web100_group_find(web100_agent *agent, const char *name)
         return NULL;
     }
     
-    gp = agent->info.local.group_head;
+    gp = AGENT_GROUP_HEAD(agent);
     while (gp) {
         if (strcmp(gp->name, name) == 0)
             break;
-        gp = gp->info.local.next;
+        gp = GROUP_NEXT(gp);
     }
     
     web100_errno = (gp == NULL ? WEB100_ERR_NOGROUP : WEB100_ERR_SUCCESS);
@@ -551,14 +373,14 @@ web100_var_head(web100_group *group)
 {
     web100_var *vp;
     
-    if (!((group->agent->type == WEB100_AGENT_TYPE_LOCAL) || (group->agent->type == WEB100_AGENT_TYPE_LOG))) {
+    if (!((GROUP_AGENT(group)->type == WEB100_AGENT_TYPE_LOCAL) || (GROUP_AGENT(group)->type == WEB100_AGENT_TYPE_LOG))) {
         web100_errno = WEB100_ERR_AGENT_TYPE;
         return NULL;
     }
     
-    vp = group->info.local.var_head;
+    vp = GROUP_VAR_HEAD(group);
     while (vp && (vp->flags & WEB100_VAR_FL_DEP))
-        vp = vp->info.local.next;
+        vp = VAR_NEXT(vp);
     web100_errno = WEB100_ERR_SUCCESS;
     return vp;
 }
@@ -570,35 +392,52 @@ web100_var_next(web100_var *var)
     web100_var *vp;
     
 
-    if (!((var->group->agent->type == WEB100_AGENT_TYPE_LOCAL) || (var->group->agent->type == WEB100_AGENT_TYPE_LOG))) {
+    if (!((VAR_AGENT(var)->type == WEB100_AGENT_TYPE_LOCAL) || (VAR_AGENT(var)->type == WEB100_AGENT_TYPE_LOG))) {
         web100_errno = WEB100_ERR_AGENT_TYPE;
         return NULL;
     }
     
-    vp = var->info.local.next;
+    vp = VAR_NEXT(var);
     while (vp && (vp->flags & WEB100_VAR_FL_DEP))
-        vp = vp->info.local.next;
+        vp = VAR_NEXT(vp);
     web100_errno = WEB100_ERR_SUCCESS;
     return vp;
 }
 
 
+/*@
+web100_var_at - return the variable at an index in a group's offset order
+@*/
+web100_var*
+web100_var_at(web100_group *group, int index)
+{
+    if (!((GROUP_AGENT(group)->type == WEB100_AGENT_TYPE_LOCAL) || (GROUP_AGENT(group)->type == WEB100_AGENT_TYPE_LOG))) {
+        web100_errno = WEB100_ERR_AGENT_TYPE;
+        return NULL;
+    }
+
+    if (index < 0 || index >= group->nlive) {
+        web100_errno = WEB100_ERR_NOVAR;
+        return NULL;
+    }
+
+    web100_errno = WEB100_ERR_SUCCESS;
+    return &GROUP_VAR_ARRAY(group)[index];
+}
+
+
 web100_var*
 web100_var_find(web100_group *group, const char *name)
 {
     web100_var *vp;
     
-    if (!((group->agent->type == WEB100_AGENT_TYPE_LOCAL) || (group->agent->type == WEB100_AGENT_TYPE_LOG))) {
+    if (!((GROUP_AGENT(group)->type == WEB100_AGENT_TYPE_LOCAL) || (GROUP_AGENT(group)->type == WEB100_AGENT_TYPE_LOG))) {
         web100_errno = WEB100_ERR_AGENT_TYPE;
         return NULL;
     }
     
-    vp = group->info.local.var_head;
-    while (vp) {
-        if (strcmp(vp->name, name) == 0)
-            break;
-        vp = vp->info.local.next;
-    }
+    vp = _web100_index_find(IMAGE_BASE(group), GROUP_INDEX(group),
+                            group->nvar_index, name);
 
     web100_errno = (vp == NULL ? WEB100_ERR_NOVAR : WEB100_ERR_SUCCESS);
     if (vp)
@@ -614,18 +453,25 @@ int
 web100_agent_find_var_and_group(web100_agent* agent, const char* name,
                                 web100_group** group, web100_var** var)
 {
-    web100_group* g;
+    struct web100_image* image;
+    web100_var* v;
     
-    g = web100_group_head(agent);
-    while (g) {
-        web100_var* v = web100_var_find(g, name);
-        if (v) {
-            *group = g;
-            *var = v;
-            dep_check(v);
-            return WEB100_ERR_SUCCESS;
-        }
-        g = web100_group_next(g);
+    if (!((agent->type == WEB100_AGENT_TYPE_LOCAL) || (agent->type == WEB100_AGENT_TYPE_LOG))) {
+        web100_errno = WEB100_ERR_AGENT_TYPE;
+        return WEB100_ERR_AGENT_TYPE;
+    }
+
+    /* The agent-wide index holds the first match in group list order */
+    image = agent->info.local.image;
+    v = _web100_index_find((char *)image,
+                           IMAGE_PTR(image, image->var_index),
+                           image->nvar_index, name);
+    if (v) {
+        *group = VAR_GROUP(v);
+        *var = v;
+        dep_check(v);
+        web100_errno = WEB100_ERR_SUCCESS;
+        return WEB100_ERR_SUCCESS;
     }
 
     /* var not found in any of the groups */
@@ -637,6 +483,16 @@ web100_agent_find_var_and_group(web100_agent* agent, const char* name,
 web100_connection*
 web100_connection_head(web100_agent *agent)
 {
+    /* The connections of a log are those it was written with; of a
+     * replay, those open at its time */
+    if (agent->type == WEB100_AGENT_TYPE_LOG) {
+        if (agent->info.local.replay &&
+            (web100_errno = _web100_replay_refresh(agent, -1)) != WEB100_ERR_SUCCESS)
+            return NULL;
+        web100_errno = WEB100_ERR_SUCCESS;
+        return agent->info.local.connection_head;
+    }
+
     if (agent->type != WEB100_AGENT_TYPE_LOCAL) {
         web100_errno = WEB100_ERR_AGENT_TYPE;
         return NULL;
@@ -652,7 +508,8 @@ web100_connection_head(web100_agent *agent)
 web100_connection*
 web100_connection_next(web100_connection *connection)
 {
-    if (connection->agent->type != WEB100_AGENT_TYPE_LOCAL) {
+    if (!((connection->agent->type == WEB100_AGENT_TYPE_LOCAL) ||
+          (connection->agent->type == WEB100_AGENT_TYPE_LOG))) {
         web100_errno = WEB100_ERR_AGENT_TYPE;
         return NULL;
     }
@@ -668,13 +525,18 @@ web100_connection_find(web100_agent *agent,
 {
     web100_connection *cp;
     
-    if (agent->type != WEB100_AGENT_TYPE_LOCAL) {
+    /* The connections of a log are those it was written with; of a
+     * replay, those open at its time */
+    if (agent->type == WEB100_AGENT_TYPE_LOCAL) {
+        if ((web100_errno = refresh_connections(agent)) != WEB100_ERR_SUCCESS)
+            return NULL;
+    } else if (agent->type != WEB100_AGENT_TYPE_LOG) {
         web100_errno = WEB100_ERR_AGENT_TYPE;
         return NULL;
-    }
-    
-    if ((web100_errno = refresh_connections(agent)) != WEB100_ERR_SUCCESS)
+    } else if (agent->info.local.replay &&
+               (web100_errno = _web100_replay_refresh(agent, -1)) != WEB100_ERR_SUCCESS) {
         return NULL;
+    }
     
     cp = agent->info.local.connection_head;
     while (cp) {
@@ -697,13 +559,18 @@ web100_connection_find_v6(web100_agent *agent,
 {
     web100_connection *cp;
     
-    if (agent->type != WEB100_AGENT_TYPE_LOCAL) {
+    /* The connections of a log are those it was written with; of a
+     * replay, those open at its time */
+    if (agent->type == WEB100_AGENT_TYPE_LOCAL) {
+        if ((web100_errno = refresh_connections(agent)) != WEB100_ERR_SUCCESS)
+            return NULL;
+    } else if (agent->type != WEB100_AGENT_TYPE_LOG) {
         web100_errno = WEB100_ERR_AGENT_TYPE;
         return NULL;
-    }
-    
-    if ((web100_errno = refresh_connections(agent)) != WEB100_ERR_SUCCESS)
+    } else if (agent->info.local.replay &&
+               (web100_errno = _web100_replay_refresh(agent, -1)) != WEB100_ERR_SUCCESS) {
         return NULL;
+    }
     
     cp = agent->info.local.connection_head;
     while (cp) {
@@ -727,13 +594,18 @@ web100_connection_lookup(web100_agent *agent, int cid)
         return NULL;
     }
 
-    if (agent->type != WEB100_AGENT_TYPE_LOCAL) {
+    /* The connections of a log are those it was written with; of a
+     * replay, those open at its time */
+    if (agent->type == WEB100_AGENT_TYPE_LOCAL) {
+        if ((web100_errno = refresh_connections(agent)) != WEB100_ERR_SUCCESS)
+            return NULL;
+    } else if (agent->type != WEB100_AGENT_TYPE_LOG) {
         web100_errno = WEB100_ERR_AGENT_TYPE;
         return NULL;
-    }
-    
-    if ((web100_errno = refresh_connections(agent)) != WEB100_ERR_SUCCESS)
+    } else if (agent->info.local.replay &&
+               (web100_errno = _web100_replay_refresh(agent, cid)) != WEB100_ERR_SUCCESS) {
         return NULL;
+    }
     
     cp = agent->info.local.connection_head;
     while (cp) {
@@ -868,7 +740,7 @@ web100_snapshot_alloc(web100_group *group, web100_connection *conn)
 {
     web100_snapshot *snap;
     
-    if (group->agent != conn->agent) {
+    if (GROUP_AGENT(group) != conn->agent) {
         web100_errno = WEB100_ERR_INVAL;
         return NULL;
     }
@@ -886,6 +758,7 @@ web100_snapshot_alloc(web100_group *group, web100_connection *conn)
     
     snap->group = group;
     snap->connection = conn;
+    snap->time_mono = snap->time_wall = 0;
     
     return snap;
 }
@@ -899,7 +772,7 @@ web100_snapshot_alloc_from_log(web100_log *log)
 {
     web100_snapshot *snap;
     
-    if (log->group->agent != log->connection->agent) {
+    if (log->connection && GROUP_AGENT(log->group) != log->connection->agent) {
         web100_errno = WEB100_ERR_INVAL;
         return NULL;
     }
@@ -917,6 +790,7 @@ web100_snapshot_alloc_from_log(web100_log *log)
     
     snap->group = log->group;
     snap->connection = log->connection;
+    snap->time_mono = snap->time_wall = 0;
     
     return snap;
 }
@@ -936,6 +810,21 @@ web100_snapshot_free(web100_snapshot *snap)
 }
 
 
+/*
+ * snap_stamp - Record when a snapshot's data was read.
+ */
+static void
+snap_stamp(web100_snapshot *snap)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    snap->time_mono = (u_int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    snap->time_wall = (u_int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
 /*@
 web100_snap - take a snapshot
 @*/
@@ -945,7 +834,10 @@ web100_snap(web100_snapshot *snap)
     FILE *fp;
     char filename[PATH_MAX];
     
-    if (snap->group->agent->type != WEB100_AGENT_TYPE_LOCAL) {
+    if (GROUP_AGENT(snap->group)->info.local.replay)
+        return _web100_replay_snap(snap);
+
+    if (GROUP_AGENT(snap->group)->type != WEB100_AGENT_TYPE_LOCAL) {
         web100_errno = WEB100_ERR_AGENT_TYPE;
         return -WEB100_ERR_AGENT_TYPE;
     }
@@ -957,9 +849,11 @@ web100_snap(web100_snapshot *snap)
     }
     
     if (fread(snap->data, snap->group->size, 1, fp) != 1){
+        fclose(fp);
         web100_errno = WEB100_ERR_NOCONNECTION;
         return -WEB100_ERR_NOCONNECTION;
     }
+    snap_stamp(snap);
 
     if (fclose(fp)) {
        	web100_errno = WEB100_ERR_FILE;
@@ -979,17 +873,20 @@ web100_raw_read(web100_var *var, web100_connection *conn, void *buf)
     FILE *fp;
     char filename[PATH_MAX];
     
-    if (var->group->agent != conn->agent) {
+    if (VAR_AGENT(var) != conn->agent) {
         web100_errno = WEB100_ERR_INVAL;
         return -WEB100_ERR_INVAL;
     }
     
+    if (conn->agent->info.local.replay)
+        return _web100_replay_raw_read(var, conn, buf);
+
     if (conn->agent->type != WEB100_AGENT_TYPE_LOCAL) {
         web100_errno = WEB100_ERR_AGENT_TYPE;
         return -WEB100_ERR_AGENT_TYPE;
     }
     
-    sprintf(filename, "%s/%d/%s", WEB100_ROOT_DIR, conn->cid, var->group->name);
+    sprintf(filename, "%s/%d/%s", WEB100_ROOT_DIR, conn->cid, VAR_GROUP(var)->name);
     if ((fp = fopen(filename, "r")) == NULL) {
         web100_errno = WEB100_ERR_NOCONNECTION;
         return -WEB100_ERR_NOCONNECTION;
@@ -1022,7 +919,7 @@ web100_raw_write(web100_var *var, web100_connection *conn, void *buf)
     FILE *fp;
     char filename[PATH_MAX];
     
-    if (var->group->agent != conn->agent) {
+    if (VAR_AGENT(var) != conn->agent) {
         web100_errno = WEB100_ERR_INVAL;
         return -WEB100_ERR_INVAL;
     }
@@ -1032,7 +929,7 @@ web100_raw_write(web100_var *var, web100_connection *conn, void *buf)
         return -WEB100_ERR_AGENT_TYPE;
     }
     
-    sprintf(filename, "%s/%d/%s", WEB100_ROOT_DIR, conn->cid, var->group->name);
+    sprintf(filename, "%s/%d/%s", WEB100_ROOT_DIR, conn->cid, VAR_GROUP(var)->name);
     if ((fp = fopen(filename, "w")) == NULL) {
         web100_errno = WEB100_ERR_NOCONNECTION;
         return -WEB100_ERR_NOCONNECTION;
@@ -1067,7 +964,7 @@ web100_snap_read - read a variable from a snapshot into a buffer
 int
 web100_snap_read(web100_var *var, web100_snapshot *snap, void *buf)
 {
-    if (var->group != snap->group) {
+    if (VAR_GROUP(var) != snap->group) {
         web100_errno = WEB100_ERR_INVAL;
         return -WEB100_ERR_INVAL;
     }
@@ -1079,6 +976,61 @@ web100_snap_read(web100_var *var, web100_snapshot *snap, void *buf)
 }
 
 
+/*@
+web100_accessor_init - resolve a variable into an accessor for web100_get_*
+@*/
+int
+web100_accessor_init(web100_accessor *acc, web100_var *var)
+{
+    if (acc == NULL || var == NULL) {
+        web100_errno = WEB100_ERR_INVAL;
+        return -WEB100_ERR_INVAL;
+    }
+
+    dep_check(var);
+
+    acc->group = VAR_GROUP(var);
+    acc->offset = var->offset;
+    acc->size = size_from_type(var->type);
+    acc->type = var->type;
+
+    return WEB100_ERR_SUCCESS;
+}
+
+
+/*@
+web100_accessor_find - resolve a variable by name into an accessor
+@*/
+int
+web100_accessor_find(web100_accessor *acc, web100_group *group,
+                     const char *name)
+{
+    web100_var *var;
+
+    if ((var = web100_var_find(group, name)) == NULL)
+        return -web100_errno;
+
+    return web100_accessor_init(acc, var);
+}
+
+
+/*
+ * _web100_get_double - The value of an integer variable as a double, signed
+ * for the signed types.  For code that ranks or summarizes any variable.
+ */
+double
+_web100_get_double(const web100_snapshot *snap, const web100_accessor *acc)
+{
+    switch (acc->type) {
+    case WEB100_TYPE_INTEGER:
+    case WEB100_TYPE_INTEGER32:
+        return web100_get_s32(snap, acc);
+    default:
+        return (double)web100_get_uint(snap, acc);
+    }
+}
+
+
 /*@
 web100_delta_any - produce the delta of a variable between two snapshots
 @*/
@@ -1123,6 +1075,8 @@ web100_snap_data_copy(web100_snapshot *dest, web100_snapshot *src)
     }
 
     memcpy(dest->data, src->data, src->group->size);
+    dest->time_mono = src->time_mono;
+    dest->time_wall = src->time_wall;
 
     return WEB100_ERR_SUCCESS;
 }
@@ -1143,89 +1097,6 @@ web100_value_to_text(WEB100_TYPE type, void* buf)
 }
 
 
-/*@
-web100_value_to_textn - return string representation of buf
-@*/
-int
-web100_value_to_textn(char* dest, size_t size, WEB100_TYPE type, void* buf)
-{
-    if (type == WEB100_TYPE_INET_ADDRESS)
-        type = ((char *)buf)[16] == WEB100_ADDRTYPE_IPV4 ?
-               WEB100_TYPE_INET_ADDRESS_IPV4 :
-               WEB100_TYPE_INET_ADDRESS_IPV6;
-    
-    switch(type) {
-    case WEB100_TYPE_INET_ADDRESS_IPV4:
-    {
-        unsigned char *addr = (unsigned char *) buf; 
-        return snprintf(dest, size, "%u.%u.%u.%u", addr[0], addr[1], addr[2], addr[3]);
-    }
-    case WEB100_TYPE_INTEGER:
-    case WEB100_TYPE_INTEGER32:
-        return snprintf(dest, size, "%d", *(int32_t *) buf);
-    case WEB100_TYPE_COUNTER32: 
-    case WEB100_TYPE_GAUGE32: 
-    case WEB100_TYPE_UNSIGNED32:
-    case WEB100_TYPE_TIME_TICKS:
-        return snprintf(dest, size, "%u", *(u_int32_t *) buf);
-    case WEB100_TYPE_COUNTER64:
-        return snprintf(dest, size, "%llu", *(u_int64_t *) buf);
-    case WEB100_TYPE_INET_PORT_NUMBER:
-        return snprintf(dest, size, "%u", *(u_int16_t *) buf);
-    case WEB100_TYPE_INET_ADDRESS_IPV6:
-    {
-        short *addr = (short *)buf;
-        int start = -1, end = -1;
-        int i, j;
-        int pos;
-        
-        /* Find longest subsequence of 0's in addr */
-        for (i = 0; i < 8; i++) {
-            if (addr[i] == 0) {
-                for (j = i + 1; addr[j] == 0 && j < 8; j++)
-                    ;
-                if (j - i > end - start) {
-                    end = j;
-                    start = i;
-                }
-                i = j;
-            }
-        }
-        if (end - start == 1)
-            start = -1;
-        
-        pos = 0;
-        for (i = 0; i < 8; i++) {
-            if (i > 0)
-                pos += snprintf(dest + pos, size - pos, ":");
-                if (pos >= size)
-                    break;
-            if (i == start) {
-                pos += snprintf(dest + pos, size - pos, ":");
-                i += end - start - 1;
-            } else {
-                pos += snprintf(dest + pos, size - pos, "%hx", ntohs(addr[i]));
-            }
-            if (pos >= size)
-                break;
-        }
-        
-        if (pos > size)
-        	pos = size;
-        return pos;
-    }
-    case WEB100_TYPE_STR32:
-        return snprintf(dest, size, "%s", (char *)buf);
-    case WEB100_TYPE_OCTET:
-        return snprintf(dest, size, "0x%x", *(u_int8_t *)buf);
-    default:
-        return snprintf(dest, size, "%s", "unknown type");
-    }
-
-    /* never reached */
-}
-
-
 /*@
 web100_get_agent_type - return the type of an agent
 @*/
@@ -1246,6 +1117,16 @@ web100_get_agent_version(web100_agent *agent)
 }
 
 
+/*@
+web100_get_agent_fingerprint - return a hash identifying an agent's header
+@*/
+u_int64_t
+web100_get_agent_fingerprint(web100_agent *agent)
+{
+    return agent->info.local.image->hash;
+}
+
+
 /*@
 web100_get_group_name - return the name from a group
 @*/
@@ -1272,7 +1153,7 @@ web100_get_group_nvars - get the number of variables in a group
 int
 web100_get_group_nvars(web100_group *group)
 {
-    return group->nvars;
+    return group->nlive;
 }
 
 
@@ -1352,321 +1233,3 @@ web100_get_connection_spec_v6(web100_connection* connection, struct web100_conne
 {
     memcpy(spec_v6, &connection->spec_v6, sizeof (struct web100_connection_spec_v6)); 
 }
-
-/* Logging functionality begins here */
-
-#define END_OF_HEADER_MARKER "----End-Of-Header---- -1 -1"
-#define BEGIN_SNAP_DATA      "----Begin-Snap-Data----"
-#define MAX_TMP_BUF_SIZE    80
-#define WEB100_LOG_CID      -1       /* A dummy CID  */
-
-web100_log*
-web100_log_open_write(char *logname, web100_connection *conn,
-		      web100_group *group)
-{
-    FILE      *header;
-    int       c; 
-    time_t    timep;
-
-    web100_log *log = NULL;
-
-    if (group->agent != conn->agent) {
-       	web100_errno = WEB100_ERR_INVAL;
-	goto Cleanup; 
-    } 
-
-    if ((log = (web100_log *)malloc(sizeof (web100_log))) == NULL) {
-        web100_errno = WEB100_ERR_NOMEM; 
-	goto Cleanup;
-    }
-
-    if ((header = fopen(WEB100_HEADER_FILE, "r")) == NULL) {
-        web100_errno = WEB100_ERR_HEADER; 
-        goto Cleanup;
-    }
-
-    log->group       = group; 
-    log->connection  = conn;
-
-    if((log->fp = fopen(logname, "w")) == NULL) {
-	web100_errno = WEB100_ERR_FILE; 
-	goto Cleanup;
-    }
-
-    while ((c=fgetc(header)) != EOF){
-      if(fputc(c, log->fp) != c){
-	web100_errno = WEB100_ERR_FILE; 
-	goto Cleanup;
-      }
-    }
-    fputc('\0', log->fp);
-
-    if(fclose(header)) { 
-	web100_errno = WEB100_ERR_FILE; 
-	goto Cleanup;
-    } 
-    //
-    // Put an end of HEADER marker
-    //
-    fprintf(log->fp, "%s\n", END_OF_HEADER_MARKER);
-    //
-    // Put Date and Time
-    //
-    log->time = time(NULL);
-
-    if(fwrite(&log->time, sizeof(time_t), 1, log->fp) != 1) {
-	web100_errno = WEB100_ERR_FILE;
-	goto Cleanup;
-    } 
-    //
-    // Put in group name
-    // 
-    if(fwrite(group->name, WEB100_GROUPNAME_LEN_MAX, 1, log->fp) != 1) {
-       	web100_errno = WEB100_ERR_FILE;
-       	goto Cleanup;
-    }
-    //
-    // Put in connection spec
-    //
-    if(fwrite(&(conn->spec), sizeof(struct web100_connection_spec), 1, log->fp) != 1) {
-	web100_errno = WEB100_ERR_FILE;
-       	goto Cleanup;
-    }
-
-    web100_errno = WEB100_ERR_SUCCESS;
-
-Cleanup:
-    if(web100_errno != WEB100_ERR_SUCCESS) { 
-	if(log) {
-	    if(log->fp)
-	       	fclose(log->fp); 
-	    free(log);
-       	}
-       	return NULL;
-    } 
-
-    return log;
-}
-
-int
-web100_log_close_write(web100_log *log) 
-{ 
-    if(fclose(log->fp) != 0) { 
-	web100_errno = WEB100_ERR_FILE; 
-	return -WEB100_ERR_FILE;
-    } 
-
-    free(log);
-    return WEB100_ERR_SUCCESS;
-}
-
-int
-web100_log_write(web100_log *log, web100_snapshot *snap)
-{ 
-    if(log->fp == NULL) {
-	web100_errno = WEB100_ERR_FILE; 
-	return -WEB100_ERR_FILE;
-    }
-
-    if(log->group != snap->group) {
-	web100_errno = WEB100_ERR_INVAL; 
-	return -WEB100_ERR_INVAL;
-    }
-
-    if(log->connection->spec.dst_port != snap->connection->spec.dst_port ||
-       log->connection->spec.dst_addr != snap->connection->spec.dst_addr ||
-       log->connection->spec.src_port != snap->connection->spec.src_port) {
-
-	web100_errno = WEB100_ERR_INVAL; 
-	return -WEB100_ERR_INVAL;
-    }
-
-    fprintf(log->fp, "%s\n", BEGIN_SNAP_DATA);
-
-    if(fwrite(snap->data, snap->group->size, 1, log->fp) != 1) {
-	web100_errno = WEB100_ERR_FILE;
-	return -WEB100_ERR_FILE;
-    }
-
-    return WEB100_ERR_SUCCESS;
-}
-
-web100_log*
-web100_log_open_read(char *logname)
-{
-    int           c; 
-    char      	  tmpbuf[MAX_TMP_BUF_SIZE];
-    struct tm     *tmp;
-    char          group_name[WEB100_GROUPNAME_LEN_MAX];
-    web100_agent       *agent = NULL;
-    web100_connection  *cp = NULL; 
-    FILE               *header = NULL;
-    
-    web100_log *log = NULL;
-
-    if ((log = (web100_log *)malloc(sizeof (web100_log))) == NULL) {
-        web100_errno = WEB100_ERR_NOMEM; 
-	goto Cleanup;
-    }
-
-    if ((log->fp = fopen(logname, "r")) == NULL) {
-        web100_errno  = WEB100_ERR_FILE;
-        goto Cleanup;
-    }
-
-    if ((header = fopen("./log_header", "w+")) == NULL) {
-	web100_errno = WEB100_ERR_FILE;
-	goto Cleanup; 
-    }
-
-    while ((c = fgetc(log->fp)) != '\0') {
-       	fputc(c, header);
-    }
-
-    rewind(header);
-
-    agent = _web100_agent_attach_log(header);
-
-    if (fgets(tmpbuf, MAX_TMP_BUF_SIZE, log->fp) == NULL ) {
-       	web100_errno = WEB100_ERR_HEADER;
-       	goto Cleanup;
-    }
-
-    if (strncmp(tmpbuf, END_OF_HEADER_MARKER, strlen(END_OF_HEADER_MARKER)) != 0 ) { 
-	web100_errno = WEB100_ERR_FILE;
-       	goto Cleanup;
-    }
-
-    if(fread(&log->time, sizeof(time_t), 1, log->fp) != 1) {
-       	web100_errno = WEB100_ERR_FILE;
-       	goto Cleanup;
-    }
-
-    if(fread(group_name, WEB100_GROUPNAME_LEN_MAX, 1, log->fp) != 1) {
-	web100_errno = WEB100_ERR_FILE;
-       	goto Cleanup;
-    }
-
-    //
-    // Define (dummy) connection with logged spec
-    //
-    if ((cp = (web100_connection *)malloc(sizeof (web100_connection))) == NULL) {
-        web100_errno = WEB100_ERR_NOMEM;
-	goto Cleanup;
-    }
-
-    cp->agent    = agent;
-    cp->cid      = WEB100_LOG_CID; //dummy
-    if(fread(&(cp->spec), sizeof(struct web100_connection_spec), 1, log->fp) != 1) {
-	web100_errno = WEB100_ERR_FILE;
-       	goto Cleanup;
-    }
-
-    cp->info.local.next = NULL;
-    agent->info.local.connection_head = cp;
-
-    log->agent = agent;
-    log->group = web100_group_find(agent, group_name);
-    log->connection = cp;
-
-    web100_errno = WEB100_ERR_SUCCESS;
-
- Cleanup:
-
-    if (header) fclose(header);
-    remove("./log_header"); 
-
-    if (web100_errno != WEB100_ERR_SUCCESS) {
-       	if (log) {
-	    if (log->fp)
-	       	fclose(log->fp);
-	    free(log); 
-	} 
-	if(agent) web100_detach(agent);
-       	if(cp) free(cp); 
-
-	return NULL;
-    }
-    
-    return log;
-}
-
-int
-web100_log_close_read(web100_log *log)
-{
-    if(log) {
-       	if(fclose(log->fp) != 0) { 
-	    web100_errno = WEB100_ERR_FILE; 
-	    return -WEB100_ERR_FILE;
-       	} 
-	web100_detach(log->agent);
-       	free(log);
-    }
-
-    return WEB100_ERR_SUCCESS;
-}
-
-int
-web100_snap_from_log(web100_snapshot* snap, web100_log *log)
-{
-    int c, what;
-    char tmpbuf[MAX_TMP_BUF_SIZE];
-
-    if (snap->group->agent->type != WEB100_AGENT_TYPE_LOG) {
-       	web100_errno = WEB100_ERR_AGENT_TYPE; 
-	return -WEB100_ERR_AGENT_TYPE;
-    }
-
-    if (log->fp == NULL) {
-	web100_errno = WEB100_ERR_FILE; 
-	return -WEB100_ERR_FILE; 
-    }        
-
-    if(fscanf(log->fp, "%s[^\n]", tmpbuf) == EOF) {
-	return EOF;
-    }
-    while( (fgetc(log->fp)) != '\n' )
-        ;    // Cleanup the line
-
-    if( strcmp(tmpbuf,BEGIN_SNAP_DATA) != 0 ){
-        web100_errno = WEB100_ERR_FILE; 
-        return -WEB100_ERR_FILE; 
-    }        
-
-    if(fread(snap->data, snap->group->size, 1, log->fp) != 1) {
-	web100_errno = WEB100_ERR_FILE; 
-	return -WEB100_ERR_FILE; 
-    }
-
-    return WEB100_ERR_SUCCESS;
-}
-
-web100_agent*
-web100_get_log_agent(web100_log *log)
-{
-    return log->agent;
-}
-
-web100_group*
-web100_get_log_group(web100_log *log)
-{
-    return log->group;
-}
-
-web100_connection*
-web100_get_log_connection(web100_log *log)
-{
-    return log->connection;
-}
-
-time_t
-web100_get_log_time(web100_log *log)
-{
-    return log->time;
-}
-
-int
-web100_log_eof(web100_log* log)
-{
-    return feof(log->fp);
-}
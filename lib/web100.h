@@ -30,11 +30,16 @@
 
 #include <sys/types.h>
 #include <sys/param.h>
+#include <string.h>
 
 #ifndef NULL
 #define NULL 0
 #endif
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 typedef enum {
     WEB100_TYPE_INTEGER = 0,
     WEB100_TYPE_INTEGER32,
@@ -60,6 +65,23 @@ typedef enum {
     WEB100_ADDRTYPE_DNS = 16
 } WEB100_ADDRTYPE;
 
+/* Statistics kept by a web100_smoother */
+typedef enum {
+    WEB100_SMOOTH_EWMA = 0,
+    WEB100_SMOOTH_MEAN,
+    WEB100_SMOOTH_MIN,
+    WEB100_SMOOTH_MAX
+} WEB100_SMOOTH;
+
+/* Columns of web100_snapset_triage(): what limited sending */
+typedef enum {
+    WEB100_TRIAGE_SND = 0,                /* the sender */
+    WEB100_TRIAGE_CNG,                    /* the congestion window */
+    WEB100_TRIAGE_RCV                     /* the receive window */
+} WEB100_TRIAGE;
+
+#define WEB100_TRIAGE_N  3
+
 struct web100_connection_spec {
     u_int16_t dst_port;
     u_int32_t dst_addr;
@@ -74,9 +96,35 @@ struct web100_connection_spec_v6 {
     char      src_addr[16];
 };
 
+/* A segment of a log written with web100_log_set_rotate, from its manifest */
+struct web100_log_segment {
+    char*     name;                       /* path of the segment's file */
+    int       open;                       /* still being written */
+    u_int64_t records;
+    u_int64_t first_wall, last_wall;      /* of its records, ns since the epoch */
+    u_int64_t first_mono, last_mono;
+};
+
+/* A connection of a columnar file, and its rows, which are together */
+struct web100_columns_conn {
+    int       cid;
+    WEB100_ADDRTYPE addrtype;
+    struct web100_connection_spec spec;   /* IPv4 */
+    struct web100_connection_spec_v6 spec_v6;
+    u_int64_t first;                      /* row */
+    u_int64_t rows;
+};
+
+/* Flags of web100_columns_export */
+#define WEB100_COLUMNS_DELTA    1         /* integers as varints of their changes */
+
 /* Agent types */
 #define WEB100_AGENT_TYPE_LOCAL 0
-#define WEB100_AGENT_TYPE_LOG   1
+#define WEB100_AGENT_TYPE_LOG   1         /* data: a log to play back */
+
+/* What web100_log_write does when an asynchronous log's queue is full */
+#define WEB100_LOG_DROP         0
+#define WEB100_LOG_BLOCK        1
 
 #define WEB100_VERSTR_LEN_MAX       64
 #define WEB100_GROUPNAME_LEN_MAX    32
@@ -94,6 +142,7 @@ struct web100_connection_spec_v6 {
 #define WEB100_ERR_NOGROUP         8
 #define WEB100_ERR_SOCK            9
 #define WEB100_ERR_KERNVER         10
+#define WEB100_ERR_FULL            11
 
 extern int               web100_errno;
 extern const char* const web100_sys_errlist[];
@@ -108,12 +157,46 @@ typedef struct web100_var         web100_var;
 typedef struct web100_connection  web100_connection;
 typedef struct web100_snapshot    web100_snapshot;
 typedef struct web100_log         web100_log;
+typedef struct web100_log_merge   web100_log_merge;
+typedef struct web100_columns     web100_columns;
+typedef struct web100_snapset     web100_snapset;
+typedef struct web100_smoother    web100_smoother;
+typedef struct web100_sketch      web100_sketch;
+typedef struct web100_topk        web100_topk;
+typedef struct web100_counters    web100_counters;
+typedef struct web100_wire        web100_wire;
+
+/*
+ * The snapshot layout is public so that the inline accessors below can read
+ * the data buffer without a function call.  Treat it as read-only and use
+ * the library routines to allocate, fill and free snapshots.
+ */
+struct web100_snapshot {
+    web100_group*      group;
+    web100_connection* connection;
+    void*              data;
+    u_int64_t          time_mono;   /* when taken: CLOCK_MONOTONIC, ns */
+    u_int64_t          time_wall;   /* and CLOCK_REALTIME, ns since 1970 */
+};
+
+/*
+ * A variable resolved once against its group (see web100_accessor_init).
+ * Holds everything needed to pull the value out of a snapshot of that group.
+ */
+typedef struct web100_accessor {
+    web100_group*      group;
+    int                offset;
+    int                size;
+    int                type;
+} web100_accessor;
 
 void               web100_perror(const char* _str);
 const char*        web100_strerror(int _errnum);
 
 web100_agent*      web100_attach(int _type, void* _data);
 void               web100_detach(web100_agent* _agent);
+int                web100_replay_set_speed(web100_agent* _agent, double _speed);
+int                web100_replay_eof(web100_agent* _agent);
 
 int                web100_agent_find_var_and_group(web100_agent* _agent, const char* _varname, web100_group** _group, web100_var** _var);
 
@@ -124,6 +207,7 @@ web100_group*      web100_group_find(web100_agent* _agent, const char* _name);
 web100_var*        web100_var_head(web100_group* _group);
 web100_var*        web100_var_next(web100_var* _var);
 web100_var*        web100_var_find(web100_group* _group, const char* _name);
+web100_var*        web100_var_at(web100_group* _group, int _index);
 
 web100_connection* web100_connection_head(web100_agent* _agent);
 web100_connection* web100_connection_next(web100_connection* _conn);
@@ -148,13 +232,67 @@ int                web100_raw_write(web100_var* _var, web100_connection* _conn,
 
 int                web100_snap_read(web100_var* _var, web100_snapshot* _snap, void* _buf);
 int                web100_delta_any(web100_var* _var, web100_snapshot* _s1, web100_snapshot* _s2, void* _buf);
+int                web100_snapshot_delta(web100_snapshot* _dst, web100_snapshot* _s1, web100_snapshot* _s2);
+int                web100_snapshot_rates(web100_snapshot* _s1, web100_snapshot* _s2, double* _rates);
+int                web100_snapshot_ratesf(web100_snapshot* _s1, web100_snapshot* _s2, float* _rates);
+
+web100_counters*   web100_counters_alloc(web100_group* _group);
+void               web100_counters_free(web100_counters* _ctr);
+int                web100_counters_update(web100_counters* _ctr, web100_snapshot* _snap);
+u_int64_t          web100_counters_get(web100_counters* _ctr, web100_var* _var);
+const u_int64_t*   web100_counters_totals(web100_counters* _ctr);
+
+web100_snapset*    web100_snapset_alloc(web100_group* _group);
+void               web100_snapset_free(web100_snapset* _set);
+int                web100_snapset_take(web100_snapset* _set);
+web100_snapshot*   web100_snapset_at(web100_snapset* _set, int _index);
+web100_snapshot*   web100_snapset_find(web100_snapset* _set, int _cid);
+int                web100_snapset_rates(web100_snapset* _s1, web100_snapset* _s2, double* _rates, int* _cids);
+int                web100_snapset_ratesf(web100_snapset* _s1, web100_snapset* _s2, float* _rates, int* _cids);
+int                web100_snapset_triage(web100_snapset* _s1, web100_snapset* _s2, float* _fractions, int* _cids);
+
+web100_smoother*   web100_smoother_alloc(int _nvals, float _weight, int _window);
+void               web100_smoother_free(web100_smoother* _sm);
+int                web100_smoother_update(web100_smoother* _sm, const float* _values, const int* _cids, int _nrows,
+                                          web100_snapset* _set);
+const float*       web100_smoother_stat(web100_smoother* _sm, WEB100_SMOOTH _stat);
+int                web100_smoother_find(web100_smoother* _sm, int _cid);
+
+web100_sketch*     web100_sketch_alloc(void);
+void               web100_sketch_free(web100_sketch* _sk);
+void               web100_sketch_reset(web100_sketch* _sk);
+void               web100_sketch_add(web100_sketch* _sk, const double* _values, int _n, int _stride);
+void               web100_sketch_merge(web100_sketch* _dst, web100_sketch* _src);
+int                web100_snapset_sketch(web100_snapset* _set, web100_accessor* _accs, int _nacc, web100_sketch** _sketches);
+double             web100_sketch_quantile(web100_sketch* _sk, double _q);
+
+web100_topk*       web100_topk_alloc(int _k);
+void               web100_topk_free(web100_topk* _tk);
+void               web100_topk_reset(web100_topk* _tk);
+void               web100_topk_add(web100_topk* _tk, const double* _values, const int* _cids, int _n, int _stride);
+int                web100_snapset_topk(web100_snapset* _set, web100_accessor* _acc, web100_topk* _tk);
+int                web100_topk_sorted(web100_topk* _tk, double* _values, int* _cids);
+
 int                web100_snap_data_copy(web100_snapshot* _dest, web100_snapshot* _src);
 
+int                web100_accessor_init(web100_accessor* _acc, web100_var* _var);
+int                web100_accessor_find(web100_accessor* _acc, web100_group* _group, const char* _name);
+
 char*              web100_value_to_text(WEB100_TYPE _type, void* _buf);
 int                web100_value_to_textn(char* _dest, size_t _size, WEB100_TYPE _type, void* _buf);
+int                web100_snapshot_format(web100_snapshot* _snap, const web100_accessor* _accs, int _nacc,
+                                          int _sep, char* _dest, size_t _size);
+
+int                web100_wire_size(web100_group* _group);
+int                web100_wire_encode_schema(web100_agent* _agent, void* _buf, size_t _size);
+int                web100_wire_encode(web100_snapshot* _snap, void* _buf, size_t _size);
+web100_wire*       web100_wire_alloc(void);
+void               web100_wire_free(web100_wire* _wire);
+int                web100_wire_decode(web100_wire* _wire, const void* _buf, size_t _len, web100_snapshot* _snap);
 
 int                web100_get_agent_type(web100_agent* _agent);
 const char*        web100_get_agent_version(web100_agent* _agent);
+u_int64_t          web100_get_agent_fingerprint(web100_agent* _agent);
 
 const char*        web100_get_group_name(web100_group* _group);
 int                web100_get_group_size(web100_group* _group);
@@ -167,6 +305,19 @@ size_t             web100_get_var_size(web100_var* _var);
 web100_group*      web100_get_snap_group(web100_snapshot* _snap);
 const char*        web100_get_snap_group_name(web100_snapshot* _snap);
 
+web100_group*      web100_get_snapset_group(web100_snapset* _set);
+int                web100_get_snapset_count(web100_snapset* _set);
+
+int                web100_get_smoother_count(web100_smoother* _sm);
+const int*         web100_get_smoother_cids(web100_smoother* _sm);
+
+u_int64_t          web100_get_sketch_count(web100_sketch* _sk);
+double             web100_get_sketch_mean(web100_sketch* _sk);
+double             web100_get_sketch_min(web100_sketch* _sk);
+double             web100_get_sketch_max(web100_sketch* _sk);
+
+int                web100_get_topk_count(web100_topk* _tk);
+
 /* missing
 web100_agent*      web100_get_connection_agent(web100_connection *_conn);
 */
@@ -178,17 +329,112 @@ void               web100_get_connection_spec_v6(web100_connection* _conn, struc
 web100_log*        web100_log_open_write(char* _logname, web100_connection* _conn, web100_group* _group);
 int                web100_log_close_write(web100_log* _log);
 int                web100_log_write(web100_log* _log, web100_snapshot* _snap);
+int                web100_log_set_delta(web100_log* _log, int _keyint);
+int                web100_log_set_async(web100_log* _log, int _slots, int _policy);
+int                web100_log_set_fsync(web100_log* _log, int _msec);
+int                web100_log_set_rotate(web100_log* _log, u_int64_t _bytes, int _secs);
 web100_log*        web100_log_open_read(char* _logname);
 int                web100_log_close_read(web100_log* _log);
 web100_snapshot*   web100_snapshot_alloc_from_log(web100_log* _log);
 int                web100_snap_from_log(web100_snapshot* _snap, web100_log* _log);
+int                web100_log_read(web100_log* _log, web100_snapshot* _snap);
+int                web100_log_set_filter(web100_log* _log, web100_connection* _conn);
+int                web100_log_seek_record(web100_log* _log, u_int64_t _n);
+int                web100_log_seek_time(web100_log* _log, u_int64_t _t);
+int                web100_log_manifest(char* _logname, u_int64_t _from, u_int64_t _to,
+                                       struct web100_log_segment** _segs);
+
+web100_log_merge*  web100_log_merge_open(char** _lognames, int _nlogs, int _maxopen);
+int                web100_log_merge_close(web100_log_merge* _merge);
+int                web100_log_merge_read(web100_log_merge* _merge, web100_snapshot* _snap);
+
+int                web100_columns_export(web100_log_merge* _merge, char* _filename, int _flags);
+web100_columns*    web100_columns_open(char* _filename);
+int                web100_columns_close(web100_columns* _cols);
+const void*        web100_columns_get(web100_columns* _cols, const char* _name, int* _type);
 
 web100_agent*      web100_get_log_agent(web100_log* _log);
 web100_group*      web100_get_log_group(web100_log* _log);
 web100_connection* web100_get_log_connection(web100_log* _log);
 time_t             web100_get_log_time(web100_log* _log);
+u_int64_t          web100_get_log_dropped(web100_log* _log);
+int                web100_get_log_pending(web100_log* _log);
 int                web100_log_eof(web100_log* _log);
 
+web100_agent*      web100_get_log_merge_agent(web100_log_merge* _merge);
+web100_group*      web100_get_log_merge_group(web100_log_merge* _merge);
+int                web100_log_merge_eof(web100_log_merge* _merge);
+
+u_int64_t          web100_get_replay_time(web100_agent* _agent);
+
+u_int64_t          web100_get_columns_rows(web100_columns* _cols);
+int                web100_get_columns_count(web100_columns* _cols);
+const char*        web100_get_columns_name(web100_columns* _cols, int _index);
+int                web100_get_columns_conns(web100_columns* _cols, const struct web100_columns_conn** _conns);
+
+/*
+ * Typed snapshot accessors.  These do no checking at all: the snapshot must
+ * belong to acc->group and the accessor must have the matching width.
+ */
+#ifndef SWIG
+static __inline__ const void*
+web100_get_ptr(const web100_snapshot* snap, const web100_accessor* acc)
+{
+    return (const char *)snap->data + acc->offset;
+}
+
+static __inline__ u_int8_t
+web100_get_u8(const web100_snapshot* snap, const web100_accessor* acc)
+{
+    return *((const u_int8_t *)snap->data + acc->offset);
+}
+
+static __inline__ u_int16_t
+web100_get_u16(const web100_snapshot* snap, const web100_accessor* acc)
+{
+    u_int16_t val;
+    memcpy(&val, (const char *)snap->data + acc->offset, sizeof (val));
+    return val;
+}
+
+static __inline__ u_int32_t
+web100_get_u32(const web100_snapshot* snap, const web100_accessor* acc)
+{
+    u_int32_t val;
+    memcpy(&val, (const char *)snap->data + acc->offset, sizeof (val));
+    return val;
+}
+
+static __inline__ int32_t
+web100_get_s32(const web100_snapshot* snap, const web100_accessor* acc)
+{
+    int32_t val;
+    memcpy(&val, (const char *)snap->data + acc->offset, sizeof (val));
+    return val;
+}
+
+static __inline__ u_int64_t
+web100_get_u64(const web100_snapshot* snap, const web100_accessor* acc)
+{
+    u_int64_t val;
+    memcpy(&val, (const char *)snap->data + acc->offset, sizeof (val));
+    return val;
+}
+
+/* Any integer type, zero-extended to 64 bits according to acc->size. */
+static __inline__ u_int64_t
+web100_get_uint(const web100_snapshot* snap, const web100_accessor* acc)
+{
+    switch (acc->size) {
+    case 1: return web100_get_u8(snap, acc);
+    case 2: return web100_get_u16(snap, acc);
+    case 4: return web100_get_u32(snap, acc);
+    case 8: return web100_get_u64(snap, acc);
+    default: return 0;
+    }
+}
+#endif /* SWIG */
+
 #define DEF_GAUGE(name, type)\
 int web100_get_##name(web100_snapshot* a, void* buf) {\
  static web100_var* va;\
@@ -207,4 +453,8 @@ int web100_delta_##name(web100_snapshot* a, web100_snapshot* b, void* buf){\
  return web100_delta_any(va, a, b, buf);\
 }
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* _WEB100_H */
@@ -68,12 +68,10 @@ class Web100Agent:
 		self._tune_group = libweb100.web100_group_find(_agent, "tune")
 		if self._tune_group == None:
 			libweb100_err()
+		self._tune_list = self._group_vars(self._tune_group)
 		self.write_vars = {}
-		_cur = libweb100.web100_var_head(self._tune_group)
-		while _cur != None:
-			var = Web100Var(_cur, self._tune_group)
+		for var in self._tune_list:
 			self.write_vars[str(var)] = var
-			_cur = libweb100.web100_var_next(_cur)
 		
 		self.read_vars = {}
 		for (name, var) in self.write_vars.items():
@@ -82,17 +80,29 @@ class Web100Agent:
 		self._read_group = libweb100.web100_group_find(_agent, "read")
 		if self._read_group == None:
 			libweb100_err()
-		_cur = libweb100.web100_var_head(self._read_group)
-		while _cur != None:
-			var = Web100Var(_cur, self._read_group)
+		self._read_list = self._group_vars(self._read_group)
+		for var in self._read_list:
 			self.read_vars[str(var)] = var
-			_cur = libweb100.web100_var_next(_cur)
+		
+		# Everything readall() reports, in the order the snapshots hold it
+		self._readall_list = \
+			[(str(var), var) for var in self._read_list] + \
+			[(str(var), var) for var in self._tune_list
+			 if self.read_vars[str(var)] is var]
 		
 		self.bufp = libweb100.new_bufp()
 	
 	def __del__(self):
 		libweb100.delete_bufp(self.bufp)
 	
+	def _group_vars(self, _group):
+		"""The variables of a group, in order of offset."""
+		
+		vars = []
+		for i in range(libweb100.web100_get_group_nvars(_group)):
+			vars.append(Web100Var(libweb100.web100_var_at(_group, i), _group))
+		return vars
+	
 	def all_connections(self):
 		"""All current connections from this agent.
 		
@@ -214,7 +224,7 @@ class Web100Connection:
 		if libweb100.web100_snap(self._tunesnap) != libweb100.WEB100_ERR_SUCCESS:
 			libweb100_err()
 		snap = {}
-		for (name, var) in self.agent.read_vars.items():
+		for (name, var) in self.agent._readall_list:
 			if var._group == self.agent._read_group:
 				if libweb100.web100_snap_read(var._var, self._readsnap, self.agent.bufp) != \
 				   libweb100.WEB100_ERR_SUCCESS:
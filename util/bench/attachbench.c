@@ -0,0 +1,108 @@
+/*
+ * attachbench: measure the latency of web100_attach/web100_detach, which
+ *              dominates the runtime of short-lived tools like readvar.
+ *
+ * Usage: attachbench [-n iterations] [header file]
+ *
+ * With no header file, attaches to the local Web100 kernel.  Given a copy
+ * of a header, parses that instead, so the benchmark can run on machines
+ * without a Web100 kernel.
+ *
+ * Copyright (c) 2001
+ *      Carnegie Mellon University, The Board of Trustees of the University
+ *      of Illinois, and University Corporation for Atmospheric Research.
+ *      All rights reserved.  This software comes with NO WARRANTY.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "web100.h"
+
+static const char* argv0 = NULL;
+
+
+static void
+usage(void)
+{
+    fprintf(stderr, "Usage: %s [-n iterations] [header file]\n", argv0);
+}
+
+
+static double
+now_usec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+
+static int
+cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+
+int
+main(int argc, char *argv[])
+{
+    web100_agent* agent;
+    char* header = NULL;
+    double* lat;
+    double t0, sum = 0;
+    int iters = 10000;
+    int i, c;
+
+    argv0 = argv[0];
+
+    while ((c = getopt(argc, argv, "n:h")) != -1) {
+        switch (c) {
+        case 'n':
+            iters = atoi(optarg);
+            break;
+        default:
+            usage();
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (optind < argc)
+        header = argv[optind++];
+    if (optind != argc || iters <= 0) {
+        usage();
+        exit(EXIT_FAILURE);
+    }
+
+    if ((lat = malloc(iters * sizeof (double))) == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    for (i = 0; i < iters; i++) {
+        t0 = now_usec();
+        if ((agent = web100_attach(WEB100_AGENT_TYPE_LOCAL, header)) == NULL) {
+            web100_perror("web100_attach");
+            exit(EXIT_FAILURE);
+        }
+        web100_detach(agent);
+        lat[i] = now_usec() - t0;
+        sum += lat[i];
+    }
+
+    qsort(lat, iters, sizeof (double), cmp_double);
+
+    printf("attach+detach: %d iterations\n", iters);
+    printf("  mean %8.2f us\n", sum / iters);
+    printf("  min  %8.2f us\n", lat[0]);
+    printf("  p50  %8.2f us\n", lat[iters / 2]);
+    printf("  p99  %8.2f us\n", lat[(int)(iters * 0.99)]);
+    printf("  max  %8.2f us\n", lat[iters - 1]);
+
+    free(lat);
+    return 0;
+}
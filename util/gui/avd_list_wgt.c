@@ -164,6 +164,7 @@ static void avd_list_list_vars (Avd_list *avd_list)
   web100_group *gp;
   Web100Obj *web100obj;
   struct snapshot_data *snap;
+  web100_snapshot *dprior = NULL, *dset = NULL;
   char buf[256]; 
   char *text;
   int ii;
@@ -173,17 +174,34 @@ static void avd_list_list_vars (Avd_list *avd_list)
   gtk_clist_freeze(GTK_CLIST(avd_list->varlist));
   
   gp = web100_group_find(web100obj->agent, "read");
-  for (ii=0;ii<varlistsize;ii++) {
 
-    var = web100_var_find(gp, vname[ii]); 
+  snap = web100obj->snapshot_head;
 
-    snap = web100obj->snapshot_head;
+  while(snap) {
+    if(!strcmp(web100_get_group_name(snap->group), "read"))
+      break;
+    snap = snap->next;
+  }
 
-    while(snap) {
-      if(!strcmp(web100_get_group_name(snap->group), "read"))
-	break;
-      snap = snap->next;
+  /* All the counter deltas at once, rather than one var at a time */
+  if (snap->prior) {
+    if ((dprior = web100_snapshot_alloc(snap->group, web100obj->connection)) == NULL ||
+        web100_snapshot_delta(dprior, snap->last, snap->prior) < 0) {
+      web100_perror ("web100_snapshot_delta");
+      goto Cleanup;
     }
+  }
+  if (snap->set) {
+    if ((dset = web100_snapshot_alloc(snap->group, web100obj->connection)) == NULL ||
+        web100_snapshot_delta(dset, snap->last, snap->set) < 0) {
+      web100_perror ("web100_snapshot_delta");
+      goto Cleanup;
+    }
+  }
+
+  for (ii=0;ii<varlistsize;ii++) {
+
+    var = web100_var_find(gp, vname[ii]); 
 
     web100_snap_read (var, (snap->last), buf);
     strcpy(valtext, web100_value_to_text(web100_get_var_type(var), buf)); 
@@ -193,28 +211,26 @@ static void avd_list_list_vars (Avd_list *avd_list)
     if ((web100_get_var_type(var) == WEB100_TYPE_COUNTER32) ||
         (web100_get_var_type(var) == WEB100_TYPE_COUNTER64)) {
 
-      if (snap->prior) { 
-       	if (web100_delta_any(var, snap->last, snap->prior, buf) < 0) {
-	  web100_perror ("web100_delta_any");
-	  continue;
-	}
-	
+      if (dprior) { 
+       	web100_snap_read (var, dprior, buf);
        	strcpy(valtext, web100_value_to_text(web100_get_var_type(var), buf));
        	gtk_clist_set_text (GTK_CLIST (avd_list->varlist), ii, 2, valtext);
       }
 
-      if (snap->set) {
-       	if (web100_delta_any(var, snap->last, snap->set, buf) < 0) {
-	  web100_perror ("web100_delta_any");
-	  continue;
-       	}
-
+      if (dset) {
+       	web100_snap_read (var, dset, buf);
         strcpy(valtext, web100_value_to_text(web100_get_var_type(var), buf));
        	gtk_clist_set_text (GTK_CLIST (avd_list->varlist), ii, 3, valtext);
       }
     } 
   } 
 
+ Cleanup:
+  if (dprior)
+    web100_snapshot_free(dprior);
+  if (dset)
+    web100_snapshot_free(dset);
+
   gtk_clist_thaw(GTK_CLIST(avd_list->varlist));  
 }
 
@@ -88,7 +88,7 @@ void avd_table_set_web100obj (Avd_table *avd_table, Web100Obj *web100obj)
   static int varname_array_length, varname_array_size = VARNAME_ARRAY_SIZE_INIT;
 
   gchar *ntext[4] = { NULL, NULL, NULL, NULL };
-  int ii=0, jj=0;
+  int ii=0, jj=0, nvars;
 
   g_return_if_fail (avd_table != NULL);
   g_return_if_fail (IS_AVD_TABLE (avd_table)); 
@@ -111,35 +111,25 @@ void avd_table_set_web100obj (Avd_table *avd_table, Web100Obj *web100obj)
   varname_array_length = 0;
   snap = web100obj->snapshot_head; 
   while (snap) { 
-    if ((var = web100_var_head (snap->group)) == NULL &&
-       	web100_errno != WEB100_ERR_SUCCESS) {
-      web100_perror("web100_var_head");
-      return;
-    } 
+    nvars = web100_get_group_nvars (snap->group);
+
+    for (ii = 0; ii < nvars; ii++) { 
+      var = web100_var_at (snap->group, ii);
 
-    while (var) { 
       if (varname_array_length == varname_array_size) { 
        	varname_array_size *= 2;
        	varname = (char *) realloc(varname, WEB100_VARNAME_LEN_MAX*varname_array_size); 
       } 
-      if (strncmp(web100_get_var_name(var), "_", 1)) { 
-	strncpy ((char *) &varname[jj], web100_get_var_name(var), WEB100_VARNAME_LEN_MAX); 
-
-       	gtk_clist_insert (GTK_CLIST (avd_table->varlist), jj, ntext); 
-	gtk_clist_set_text (GTK_CLIST (avd_table->varlist), jj, 0, &varname[jj]);
+      strncpy ((char *) &varname[jj], web100_get_var_name(var), WEB100_VARNAME_LEN_MAX); 
 
-	gtk_clist_set_row_data_full (GTK_CLIST (avd_table->varlist), jj, var,
-	    (GtkDestroyNotify) row_destroy); 
+      gtk_clist_insert (GTK_CLIST (avd_table->varlist), jj, ntext); 
+      gtk_clist_set_text (GTK_CLIST (avd_table->varlist), jj, 0, &varname[jj]);
 
-	varname_array_length++;
-	jj++;
-      }
+      gtk_clist_set_row_data_full (GTK_CLIST (avd_table->varlist), jj, var,
+	  (GtkDestroyNotify) row_destroy); 
 
-      if ((var = web100_var_next(var)) == NULL &&
-	  web100_errno != WEB100_ERR_SUCCESS) {
-       	web100_perror("web100_var_next");
-       	return;
-      } 
+      varname_array_length++;
+      jj++;
     }
     snap = snap->next;
   }
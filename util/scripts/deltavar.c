@@ -2,6 +2,9 @@
  * deltavar: print a continuous list of the amount a web100 variable changes
  *           each second for one connection.
  *
+ * Usage: deltavar [-f text|csv|jsonl|binary] [-i seconds] [-c count]
+ *                 <connection id> <var name>
+ *
  * Copyright (c) 2001
  *      Carnegie Mellon University, The Board of Trustees of the University
  *      of Illinois, and University Corporation for Atmospheric Research.
@@ -17,18 +20,28 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <getopt.h>
 #include <sys/types.h>
 
 #include "web100.h"
+#include "output.h"
 
 static const char* argv0 = NULL;
 
+static const struct option long_options[] = {
+    { "format",   required_argument, NULL, 'f' },
+    { "interval", required_argument, NULL, 'i' },
+    { "count",    required_argument, NULL, 'c' },
+    { NULL, 0, NULL, 0 }
+};
+
 
 static void
 usage(void)
 {
     fprintf(stderr,
-            "Usage: %s <connection id> <var name>\n",
+            "Usage: %s [--format=text|csv|jsonl|binary] [--interval=seconds] [--count=n]\n"
+            "       <connection id> <var name>\n",
             argv0);
 }
 
@@ -42,17 +55,40 @@ main(int argc, char *argv[])
     web100_var* var;
     web100_snapshot* snapold;
     web100_snapshot* snapnew;
+    web100_accessor acc;
+    output* out = NULL;
+    const char* name;
     char buf[8];
-    int cid;
+    double interval = 1;
+    int format = OUTPUT_TEXT;
+    int count = 0, schema = 0;
+    int cid, sample, c;
 
     argv0 = argv[0];
 
-    if (argc != 3) {
+    while ((c = getopt_long(argc, argv, "f:i:c:", long_options, NULL)) != -1) {
+        switch (c) {
+        case 'f':
+            format = output_format(optarg);
+            break;
+        case 'i':
+            interval = atof(optarg);
+            break;
+        case 'c':
+            count = atoi(optarg);
+            break;
+        default:
+            usage();
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (argc - optind != 2 || format < 0 || interval <= 0 || count < 0) {
         usage();
         exit(EXIT_FAILURE);
     }
+    name = argv[optind + 1];
 
-    cid = atoi(argv[1]);
+    cid = atoi(argv[optind]);
     
     if ((agent = web100_attach(WEB100_AGENT_TYPE_LOCAL, NULL)) == NULL) {
         web100_perror("web100_attach");
@@ -64,7 +100,7 @@ main(int argc, char *argv[])
         exit(EXIT_FAILURE);
     }
     
-    if ((web100_agent_find_var_and_group(agent, argv[2], &group, &var)) != WEB100_ERR_SUCCESS) {
+    if ((web100_agent_find_var_and_group(agent, name, &group, &var)) != WEB100_ERR_SUCCESS) {
         web100_perror("web100_agent_find_var_and_group");
         exit(EXIT_FAILURE);
     }
@@ -94,10 +130,20 @@ main(int argc, char *argv[])
         exit(EXIT_FAILURE);
     }
 
-    printf("Initial value of %s: %s\n", argv[2], web100_value_to_text(web100_get_var_type(var), buf));
+    if (format == OUTPUT_TEXT) {
+        printf("Initial value of %s: %s\n", name, web100_value_to_text(web100_get_var_type(var), buf));
+        fflush(stdout);
+    } else {
+        /* One column, the change, read from the start of buf */
+        web100_accessor_init(&acc, var);
+        acc.offset = 0;
+        out = output_open(STDOUT_FILENO, format, agent);
+        schema = output_schema(out, web100_get_group_name(group), 1, &name, &acc, acc.size);
+        output_flush(out);
+    }
     
-    while (1) {
-        sleep(1);
+    for (sample = 0; count == 0 || sample < count; sample++) {
+        usleep((useconds_t)(interval * 1000000));
 
         /* throw out old, new->old, get new using web100_snap */
         
@@ -117,9 +163,22 @@ main(int argc, char *argv[])
             exit(EXIT_FAILURE);
         }
 
-        printf("Change in %s: %s\n", argv[2], web100_value_to_text(web100_get_var_type(var), buf));
+        if (out) {
+            /* Binary streams carry whole snapshots; the reader takes deltas */
+            if (format == OUTPUT_BINARY)
+                output_snapshot(out, snapnew);
+            else
+                output_record(out, schema, cid, snapnew->time_mono, snapnew->time_wall, buf);
+            output_flush(out);
+        } else {
+            printf("Change in %s: %s\n", name, web100_value_to_text(web100_get_var_type(var), buf));
+            fflush(stdout);
+        }
     }
 
+    if (out)
+        output_close(out);
+
     return 0;
 }
 
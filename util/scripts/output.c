@@ -0,0 +1,495 @@
+/*
+ * output.c: machine-readable output of snapshots for the command-line
+ *           tools (readall, readconn, deltavar).
+ *
+ * A schema names the columns of a record: a list of accessors into a
+ * block of data, usually a group's snapshot.  In CSV its header row is
+ * written the first time it is used, and as a file has only the one
+ * header, a stream may have only the one schema; after that each record
+ * is one line of CSV or one JSON object per line.  Binary output is the library's
+ * wire format (see web100_wire_encode(3)): the agent's schema frame, then
+ * a record frame per snapshot.  Records are built in a large buffer and
+ * written with write(2) only when it fills or is flushed.
+ *
+ * Copyright (c) 2001
+ *      Carnegie Mellon University, The Board of Trustees of the University
+ *      of Illinois, and University Corporation for Atmospheric Research.
+ *      All rights reserved.  This software comes with NO WARRANTY.
+ *
+ * $Id$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+
+#include "web100.h"
+#include "output.h"
+
+#define OUTPUT_BUFSIZE  (1 << 20)
+#define OUTPUT_SCHEMAS  256
+
+/* Room for any one value: text, quoted, or JSON-escaped */
+#define OUTPUT_VALUE_MAX  (6 * 32 + 2)
+
+struct output_schema {
+    web100_group*      group;       /* NULL if not a group's */
+    char*              name;
+    int                ncols;
+    char**             names;
+    web100_accessor*   accs;
+    char**             keys;        /* JSON: ,"name": */
+    int*               keylens;
+    int                size;
+    int                plain;       /* no column needs quoting in CSV */
+    size_t             max_record;
+};
+
+struct output {
+    int                   fd;
+    OUTPUT_FORMAT         format;
+    char*                 buf;
+    size_t                len;
+    size_t                alloc;
+    struct output_schema  schemas[OUTPUT_SCHEMAS];
+    int                   nschemas;
+};
+
+static const char* format_names[] = { "text", "csv", "jsonl", "binary" };
+
+
+static void
+output_die(const char* what)
+{
+    perror(what);
+    exit(EXIT_FAILURE);
+}
+
+
+/*
+ * output_room - Make sure n more bytes fit in the buffer, flushing it or
+ * growing it if need be.
+ */
+static void
+output_room(output* out, size_t n)
+{
+    if (out->alloc - out->len >= n)
+        return;
+    output_flush(out);
+    if (out->alloc >= n)
+        return;
+    if ((out->buf = realloc(out->buf, n)) == NULL)
+        output_die("realloc");
+    out->alloc = n;
+}
+
+
+static char*
+put_bytes(char* p, const void* src, size_t n)
+{
+    memcpy(p, src, n);
+    return p + n;
+}
+
+
+/* A JSON string body; names and STR32s are short, so byte at a time */
+static char*
+put_json(char* p, const char* s, size_t n)
+{
+    static const char hex[] = "0123456789abcdef";
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        unsigned char c = s[i];
+
+        if (c == '"' || c == '\\') {
+            *p++ = '\\';
+            *p++ = c;
+        } else if (c < 0x20) {
+            p = put_bytes(p, "\\u00", 4);
+            *p++ = hex[c >> 4];
+            *p++ = hex[c & 0xf];
+        } else {
+            *p++ = c;
+        }
+    }
+    return p;
+}
+
+
+/* A CSV field, quoted only if it must be */
+static char*
+put_csv(char* p, const char* s, size_t n)
+{
+    size_t i;
+
+    if (strcspn(s, ",\"\r\n") >= n)
+        return put_bytes(p, s, n);
+
+    *p++ = '"';
+    for (i = 0; i < n; i++) {
+        if (s[i] == '"')
+            *p++ = '"';
+        *p++ = s[i];
+    }
+    *p++ = '"';
+    return p;
+}
+
+
+/* seconds.nanoseconds */
+static char*
+put_time(char* p, u_int64_t t)
+{
+    u_int64_t sec = t / 1000000000;
+    u_int32_t ns = (u_int32_t)(t % 1000000000);
+    int i;
+
+    p += web100_value_to_textn(p, 21, WEB100_TYPE_COUNTER64, &sec);
+    *p++ = '.';
+    for (i = 8; i >= 0; i--) {
+        p[i] = '0' + ns % 10;
+        ns /= 10;
+    }
+    return p + 9;
+}
+
+
+static int
+is_quoted(int type)
+{
+    return type == WEB100_TYPE_INET_ADDRESS ||
+           type == WEB100_TYPE_INET_ADDRESS_IPV4 ||
+           type == WEB100_TYPE_INET_ADDRESS_IPV6 ||
+           type == WEB100_TYPE_STR32 ||
+           type == WEB100_TYPE_OCTET;
+}
+
+
+static void
+write_schema(output* out, struct output_schema* sch)
+{
+    char* p;
+    size_t n;
+    int i;
+
+    n = strlen(sch->name) + 16;
+    for (i = 0; i < sch->ncols; i++)
+        n += strlen(sch->names[i]) + 16;
+    output_room(out, 2 * n);
+    p = out->buf + out->len;
+
+    switch (out->format) {
+    case OUTPUT_CSV:
+        p = put_bytes(p, "group,cid,time", 14);
+        for (i = 0; i < sch->ncols; i++) {
+            *p++ = ',';
+            p = put_csv(p, sch->names[i], strlen(sch->names[i]));
+        }
+        *p++ = '\n';
+        break;
+    default:
+        /* JSON records name their own fields; wire records have a
+         * schema frame of their own */
+        break;
+    }
+
+    out->len = p - out->buf;
+}
+
+
+/*
+ * output_format - The format called name, or -1.
+ */
+int
+output_format(const char* name)
+{
+    int i;
+
+    for (i = 0; i < (int)(sizeof (format_names) / sizeof (format_names[0])); i++)
+        if (strcmp(name, format_names[i]) == 0)
+            return i;
+    return -1;
+}
+
+
+/*
+ * output_open - Start a stream of records on fd, of snapshots from agent.
+ */
+output*
+output_open(int fd, OUTPUT_FORMAT format, web100_agent* agent)
+{
+    output* out;
+    int n;
+
+    if ((out = calloc(1, sizeof (output))) == NULL ||
+        (out->buf = malloc(OUTPUT_BUFSIZE)) == NULL)
+        output_die("malloc");
+    out->fd = fd;
+    out->format = format;
+    out->alloc = OUTPUT_BUFSIZE;
+
+    if (format == OUTPUT_BINARY) {
+        n = web100_wire_encode_schema(agent, NULL, 0);
+        output_room(out, n);
+        out->len = web100_wire_encode_schema(agent, out->buf, out->alloc);
+    }
+
+    return out;
+}
+
+
+/*
+ * output_close - Flush and free a stream.  The descriptor is left open.
+ */
+void
+output_close(output* out)
+{
+    struct output_schema* sch;
+    int i, j;
+
+    output_flush(out);
+
+    for (i = 0; i < out->nschemas; i++) {
+        sch = &out->schemas[i];
+        for (j = 0; j < sch->ncols; j++) {
+            free(sch->names[j]);
+            free(sch->keys[j]);
+        }
+        free(sch->name);
+        free(sch->names);
+        free(sch->keys);
+        free(sch->keylens);
+        free(sch->accs);
+    }
+    free(out->buf);
+    free(out);
+}
+
+
+/*
+ * output_schema - Describe records of ncols columns, each read with an
+ * accessor from size bytes of data, and write the description out.
+ * Returns the schema's number for output_record().
+ */
+int
+output_schema(output* out, const char* name, int ncols,
+              const char** names, const web100_accessor* accs, int size)
+{
+    struct output_schema* sch;
+    char key[3 * 6 * 64];
+    int i;
+
+    if (out->nschemas == OUTPUT_SCHEMAS) {
+        fprintf(stderr, "output: too many schemas\n");
+        exit(EXIT_FAILURE);
+    }
+    if (out->format == OUTPUT_CSV && out->nschemas > 0) {
+        fprintf(stderr, "output: csv holds the records of one group only\n");
+        exit(EXIT_FAILURE);
+    }
+    sch = &out->schemas[out->nschemas];
+
+    if ((sch->name = strdup(name)) == NULL ||
+        (sch->names = calloc(ncols + 1, sizeof (char*))) == NULL ||
+        (sch->keys = calloc(ncols + 1, sizeof (char*))) == NULL ||
+        (sch->keylens = calloc(ncols + 1, sizeof (int))) == NULL ||
+        (sch->accs = malloc((ncols + 1) * sizeof (web100_accessor))) == NULL)
+        output_die("malloc");
+    memcpy(sch->accs, accs, ncols * sizeof (web100_accessor));
+    sch->ncols = ncols;
+    sch->size = size;
+    sch->plain = 1;
+    sch->max_record = 3 * strlen(name) + 128;
+
+    for (i = 0; i < ncols; i++) {
+        char* p = key;
+        size_t n = strlen(names[i]);
+
+        if (n > 64)
+            n = 64;
+        *p++ = ',';
+        *p++ = '"';
+        p = put_json(p, names[i], n);
+        *p++ = '"';
+        *p++ = ':';
+
+        if ((sch->names[i] = strdup(names[i])) == NULL ||
+            (sch->keys[i] = malloc(p - key)) == NULL)
+            output_die("malloc");
+        memcpy(sch->keys[i], key, p - key);
+        sch->keylens[i] = p - key;
+
+        if (accs[i].type == WEB100_TYPE_STR32)
+            sch->plain = 0;
+        sch->max_record += sch->keylens[i] + OUTPUT_VALUE_MAX + 2;
+    }
+    if (sch->max_record < (size_t)size + 32)
+        sch->max_record = size + 32;
+
+    write_schema(out, sch);
+    return out->nschemas++;
+}
+
+
+/*
+ * output_group - The schema of a group's snapshots: every variable, in the
+ * order of web100_var_at().  Made the first time the group is seen.
+ */
+int
+output_group(output* out, web100_group* group)
+{
+    web100_accessor* accs;
+    const char** names;
+    int nvars, i, id;
+
+    for (i = 0; i < out->nschemas; i++)
+        if (out->schemas[i].group == group)
+            return i;
+
+    nvars = web100_get_group_nvars(group);
+    if ((accs = malloc((nvars + 1) * sizeof (web100_accessor))) == NULL ||
+        (names = malloc((nvars + 1) * sizeof (char*))) == NULL)
+        output_die("malloc");
+    for (i = 0; i < nvars; i++) {
+        web100_var* var = web100_var_at(group, i);
+
+        web100_accessor_init(&accs[i], var);
+        names[i] = web100_get_var_name(var);
+    }
+
+    id = output_schema(out, web100_get_group_name(group), nvars, names, accs,
+                       web100_get_group_size(group));
+    out->schemas[id].group = group;
+
+    free(accs);
+    free(names);
+    return id;
+}
+
+
+/*
+ * output_record - Write one record of a schema.
+ */
+void
+output_record(output* out, int schema, int cid,
+              u_int64_t time_mono, u_int64_t time_wall, const void* data)
+{
+    struct output_schema* sch = &out->schemas[schema];
+    web100_snapshot snap;
+    char text[OUTPUT_VALUE_MAX];
+    char* p;
+    int32_t s32 = cid;
+    int i, n, type;
+
+    output_room(out, sch->max_record);
+    p = out->buf + out->len;
+
+    switch (out->format) {
+    case OUTPUT_CSV:
+        p = put_csv(p, sch->name, strlen(sch->name));
+        *p++ = ',';
+        p += web100_value_to_textn(p, 12, WEB100_TYPE_INTEGER32, &s32);
+        *p++ = ',';
+        p = put_time(p, time_wall);
+        *p++ = ',';
+        if (sch->plain) {
+            /* All at once; the room was made above */
+            snap.group = sch->group;
+            snap.connection = NULL;
+            snap.data = (void*)data;
+            p += web100_snapshot_format(&snap, sch->accs, sch->ncols, ',', p,
+                                        out->alloc - (p - out->buf));
+        } else {
+            for (i = 0; i < sch->ncols; i++) {
+                if (i > 0)
+                    *p++ = ',';
+                n = web100_value_to_textn(text, sizeof (text), sch->accs[i].type,
+                                          (char*)data + sch->accs[i].offset);
+                p = put_csv(p, text, n);
+            }
+        }
+        *p++ = '\n';
+        break;
+
+    case OUTPUT_JSONL:
+        p = put_bytes(p, "{\"group\":\"", 10);
+        p = put_json(p, sch->name, strlen(sch->name));
+        p = put_bytes(p, "\",\"cid\":", 8);
+        p += web100_value_to_textn(p, 12, WEB100_TYPE_INTEGER32, &s32);
+        p = put_bytes(p, ",\"time\":", 8);
+        p = put_time(p, time_wall);
+        for (i = 0; i < sch->ncols; i++) {
+            type = sch->accs[i].type;
+            p = put_bytes(p, sch->keys[i], sch->keylens[i]);
+            if (type == WEB100_TYPE_STR32) {
+                n = web100_value_to_textn(text, sizeof (text), type,
+                                          (char*)data + sch->accs[i].offset);
+                *p++ = '"';
+                p = put_json(p, text, n);
+                *p++ = '"';
+            } else if (is_quoted(type)) {
+                *p++ = '"';
+                p += web100_value_to_textn(p, OUTPUT_VALUE_MAX, type,
+                                           (char*)data + sch->accs[i].offset);
+                *p++ = '"';
+            } else {
+                p += web100_value_to_textn(p, OUTPUT_VALUE_MAX, type,
+                                           (char*)data + sch->accs[i].offset);
+            }
+        }
+        *p++ = '}';
+        *p++ = '\n';
+        break;
+
+    default:
+        /* Binary records are whole snapshots; see output_snapshot() */
+        break;
+    }
+
+    out->len = p - out->buf;
+}
+
+
+/*
+ * output_snapshot - Write a snapshot as a record of its group's schema.
+ */
+void
+output_snapshot(output* out, web100_snapshot* snap)
+{
+    int n;
+
+    if (out->format == OUTPUT_BINARY) {
+        n = web100_wire_size(web100_get_snap_group(snap));
+        output_room(out, n);
+        out->len += web100_wire_encode(snap, out->buf + out->len, n);
+        return;
+    }
+
+    output_record(out, output_group(out, web100_get_snap_group(snap)),
+                  web100_get_connection_cid(snap->connection),
+                  snap->time_mono, snap->time_wall, snap->data);
+}
+
+
+/*
+ * output_flush - Write out everything buffered.
+ */
+void
+output_flush(output* out)
+{
+    size_t done = 0;
+    ssize_t n;
+
+    while (done < out->len) {
+        if ((n = write(out->fd, out->buf + done, out->len - done)) < 0) {
+            if (errno == EINTR)
+                continue;
+            output_die("write");
+        }
+        done += n;
+    }
+    out->len = 0;
+}
@@ -0,0 +1,41 @@
+/*
+ * output.h: machine-readable output of snapshots for the command-line
+ *           tools (readall, readconn, deltavar).
+ *
+ * Copyright (c) 2001
+ *      Carnegie Mellon University, The Board of Trustees of the University
+ *      of Illinois, and University Corporation for Atmospheric Research.
+ *      All rights reserved.  This software comes with NO WARRANTY.
+ *
+ * $Id$
+ */
+#ifndef _OUTPUT_H
+#define _OUTPUT_H
+
+#include <sys/types.h>
+
+#include "web100.h"
+
+typedef enum {
+    OUTPUT_TEXT = 0,
+    OUTPUT_CSV,
+    OUTPUT_JSONL,
+    OUTPUT_BINARY,
+} OUTPUT_FORMAT;
+
+typedef struct output output;
+
+int      output_format(const char* _name);
+
+output*  output_open(int _fd, OUTPUT_FORMAT _format, web100_agent* _agent);
+void     output_close(output* _out);
+
+int      output_schema(output* _out, const char* _name, int _ncols,
+                       const char** _names, const web100_accessor* _accs, int _size);
+int      output_group(output* _out, web100_group* _group);
+void     output_record(output* _out, int _schema, int _cid,
+                       u_int64_t _time_mono, u_int64_t _time_wall, const void* _data);
+void     output_snapshot(output* _out, web100_snapshot* _snap);
+void     output_flush(output* _out);
+
+#endif /* _OUTPUT_H */
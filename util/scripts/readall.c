@@ -1,6 +1,9 @@
 /*
  * readall: read all variables from all connections and print them to stdout.
  *
+ * Usage: readall [-f text|csv|jsonl|binary] [-g group] [-i seconds [-c count]]
+ * Example: readall --format=csv --interval=1 | ...
+ *
  * Copyright (c) 2001
  *      Carnegie Mellon University, The Board of Trustees of the University
  *      of Illinois, and University Corporation for Atmospheric Research.
@@ -15,23 +18,61 @@
  */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/types.h>
 
 #include "web100.h"
+#include "output.h"
 
+static const char* argv0 = NULL;
 
-int main(int argc, char *argv[])
+static const struct option long_options[] = {
+    { "format",   required_argument, NULL, 'f' },
+    { "group",    required_argument, NULL, 'g' },
+    { "interval", required_argument, NULL, 'i' },
+    { "count",    required_argument, NULL, 'c' },
+    { NULL, 0, NULL, 0 }
+};
+
+
+static void
+usage(void)
+{
+    fprintf(stderr,
+            "Usage: %s [--format=text|csv|jsonl|binary] [--group=name]\n"
+            "       [--interval=seconds [--count=n]]\n",
+            argv0);
+}
+
+
+/* Every group of every connection, one record each, in cid order */
+static void
+write_all(output *out, web100_snapset **sets, int nsets)
+{
+    int i, j;
+
+    for (i = 0; i < nsets; i++) {
+        if (web100_snapset_take(sets[i]) != WEB100_ERR_SUCCESS) {
+            web100_perror("web100_snapset_take");
+            exit(EXIT_FAILURE);
+        }
+        for (j = 0; j < web100_get_snapset_count(sets[i]); j++)
+            output_snapshot(out, web100_snapset_at(sets[i], j));
+    }
+    output_flush(out);
+}
+
+
+static void
+print_all(web100_agent *agent, const char *grp_name)
 {
-    web100_agent *agent;
     web100_group *group;
     web100_group *read_grp;
     web100_var *addr_type, *laddr, *raddr, *lport, *rport;
     int old_kernel = 0;
 
-    if ((agent = web100_attach(WEB100_AGENT_TYPE_LOCAL, NULL)) == NULL) {
-        web100_perror("web100_attach");
-        exit(EXIT_FAILURE);
-    }
-
     if ((read_grp = web100_group_find(agent, "read")) == NULL) {
         web100_perror("web100_group_find: read");
         exit(EXIT_FAILURE);
@@ -57,7 +98,7 @@ int main(int argc, char *argv[])
         exit(EXIT_FAILURE);
     }
 
-    group = web100_group_head(agent);
+    group = grp_name ? web100_group_find(agent, grp_name) : web100_group_head(agent);
 
     while (group) {
         web100_connection *conn;
@@ -71,6 +112,7 @@ int main(int argc, char *argv[])
             web100_snapshot *snap;
             int type;
             int cid;
+            int nvars, i;
             char buf[256];
 
             cid = web100_get_connection_cid(conn);
@@ -118,15 +160,19 @@ int main(int argc, char *argv[])
             }
 
             if (web100_snap(snap)) {
-                perror("web100_snap");
-                if (web100_errno == WEB100_ERR_NOCONNECTION)
-                    continue;
-                exit(EXIT_FAILURE);
+                web100_perror("web100_snap");
+                if (web100_errno != WEB100_ERR_NOCONNECTION)
+                    exit(EXIT_FAILURE);
+                /* It closed; go on with the next one */
+                web100_snapshot_free(snap);
+                conn = web100_connection_next(conn);
+                continue;
             }
 
-            var = web100_var_head(group);
+            nvars = web100_get_group_nvars(group);
 
-            while (var) {
+            for (i = 0; i < nvars; i++) {
+                var = web100_var_at(group, i);
                 if (web100_snap_read(var, snap, buf)) {
                     web100_perror("web100_snap_read");
                     exit(EXIT_FAILURE);
@@ -136,8 +182,6 @@ int main(int argc, char *argv[])
                        web100_get_var_name(var),
                        web100_value_to_text(web100_get_var_type(var),
                                             buf));
-
-                var = web100_var_next(var);
             }
 
             web100_snapshot_free(snap);
@@ -148,11 +192,106 @@ int main(int argc, char *argv[])
                 printf("\n");
         }
 
+        if (grp_name)           // not looping through groups
+            break;
         group = web100_group_next(group);
 
         if (group)
             printf("\n");
     }
+}
+
+
+int main(int argc, char *argv[])
+{
+    web100_agent *agent;
+    web100_group *group;
+    web100_snapset **sets = NULL;
+    output *out = NULL;
+    const char *grp_name = NULL;
+    double interval = 0;
+    int format = OUTPUT_TEXT;
+    int count = -1, nsets = 0;
+    int sample, c;
+
+    argv0 = argv[0];
+
+    while ((c = getopt_long(argc, argv, "f:g:i:c:", long_options, NULL)) != -1) {
+        switch (c) {
+        case 'f':
+            format = output_format(optarg);
+            break;
+        case 'g':
+            grp_name = optarg;
+            break;
+        case 'i':
+            interval = atof(optarg);
+            break;
+        case 'c':
+            count = atoi(optarg);
+            break;
+        default:
+            usage();
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (optind != argc || format < 0 || interval < 0 ||
+        (count >= 0 && interval == 0)) {
+        usage();
+        exit(EXIT_FAILURE);
+    }
+    /* One sample, or with an interval, samples until count or killed */
+    if (interval == 0)
+        count = 1;
+    else if (count < 0)
+        count = 0;
+    /* A CSV file has one header row, so holds one group's records */
+    if (format == OUTPUT_CSV && grp_name == NULL)
+        grp_name = "read";
+
+    if ((agent = web100_attach(WEB100_AGENT_TYPE_LOCAL, NULL)) == NULL) {
+        web100_perror("web100_attach");
+        exit(EXIT_FAILURE);
+    }
+    if (grp_name && web100_group_find(agent, grp_name) == NULL) {
+        web100_perror(grp_name);
+        exit(EXIT_FAILURE);
+    }
+
+    if (format != OUTPUT_TEXT) {
+        out = output_open(STDOUT_FILENO, format, agent);
+        for (group = web100_group_head(agent); group; group = web100_group_next(group)) {
+            if (grp_name && strcmp(grp_name, web100_get_group_name(group)) != 0)
+                continue;
+            if ((sets = realloc(sets, (nsets + 1) * sizeof (*sets))) == NULL ||
+                (sets[nsets++] = web100_snapset_alloc(group)) == NULL) {
+                web100_perror("web100_snapset_alloc");
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+
+    for (sample = 0; count == 0 || sample < count; sample++) {
+        if (sample > 0)
+            usleep((useconds_t)(interval * 1000000));
+
+        if (out) {
+            write_all(out, sets, nsets);
+        } else {
+            if (sample > 0)
+                printf("\n");
+            print_all(agent, grp_name);
+            fflush(stdout);
+        }
+    }
+
+    if (out) {
+        output_close(out);
+        while (nsets > 0)
+            web100_snapset_free(sets[--nsets]);
+        free(sets);
+    }
+    web100_detach(agent);
 
     return 0;
 }
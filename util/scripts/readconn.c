@@ -3,6 +3,9 @@
  *           optionally, if a group name is given, print only variables from
  *           that group
  *
+ * Usage: readconn [-f text|csv|jsonl|binary] [-i seconds [-c count]]
+ *                 <connection id> [<grp name>]
+ *
  * Copyright (c) 2001
  *      Carnegie Mellon University, The Board of Trustees of the University
  *      of Illinois, and University Corporation for Atmospheric Research.
@@ -17,47 +20,42 @@
  */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/types.h>
 
-#include "web100/web100.h"
+#include "web100.h"
+#include "output.h"
 
 static const char *argv0 = NULL;
 
+static const struct option long_options[] = {
+    { "format",   required_argument, NULL, 'f' },
+    { "interval", required_argument, NULL, 'i' },
+    { "count",    required_argument, NULL, 'c' },
+    { NULL, 0, NULL, 0 }
+};
+
 static void usage(void)
 {
-    fprintf(stderr, "Usage: %s <connection id> [<grp name>]\n", argv0);
+    fprintf(stderr,
+            "Usage: %s [--format=text|csv|jsonl|binary] [--interval=seconds [--count=n]]\n"
+            "       <connection id> [<grp name>]\n", argv0);
 }
 
-int main(int argc, char *argv[])
+/* Returns 0 once the connection has closed */
+static int print_conn(web100_agent *agent, web100_connection *conn,
+                      const char *grp_name)
 {
-    web100_agent *agent;
     web100_group *group;
-    web100_connection *conn;
     web100_group *read_grp;
     web100_var *addr_type, *laddr, *raddr, *lport, *rport;
     int old_kernel = 0;
 
     char buf[64];
-    int cid;
     int type;
 
-    argv0 = argv[0];
-
-    if (argc != 2 && argc != 3) {
-        usage();
-        exit(EXIT_FAILURE);
-    }
-
-    if ((agent = web100_attach(WEB100_AGENT_TYPE_LOCAL, NULL)) == NULL) {
-        web100_perror("web100_attach");
-        exit(EXIT_FAILURE);
-    }
-
-    cid = atoi(argv[1]);
-    if ((conn = web100_connection_lookup(agent, cid)) == NULL) {
-        web100_perror("web100_connection_lookup");
-        exit(EXIT_FAILURE);
-    }
-
     if ((read_grp = web100_group_find(agent, "read")) == NULL) {
         web100_perror("web100_group_find: read");
         exit(EXIT_FAILURE);
@@ -117,10 +115,10 @@ int main(int argc, char *argv[])
     }
     printf("%s)\n", web100_value_to_text(WEB100_TYPE_INET_PORT_NUMBER, buf));
 
-    if (argc == 2) {            // loop through all groups
+    if (grp_name == NULL) {     // loop through all groups
         group = web100_group_head(agent);
     } else {                    // only interested in this group
-        group = web100_group_find(agent, argv[2]);
+        group = web100_group_find(agent, grp_name);
     }
     
     while (group) {
@@ -135,10 +133,11 @@ int main(int argc, char *argv[])
         }
 
         if (web100_snap(snap)) {
-            perror("web100_snap");
-            if (web100_errno == WEB100_ERR_NOCONNECTION)
-                continue;
-            exit(EXIT_FAILURE);
+            web100_perror("web100_snap");
+            if (web100_errno != WEB100_ERR_NOCONNECTION)
+                exit(EXIT_FAILURE);
+            web100_snapshot_free(snap);
+            return 0;
         }
 
         var = web100_var_head(group);
@@ -158,7 +157,7 @@ int main(int argc, char *argv[])
 
         web100_snapshot_free(snap);
 
-        if (argc == 3)          // not looping through groups
+        if (grp_name)           // not looping through groups
             break;
         group = web100_group_next(group);
 
@@ -166,5 +165,116 @@ int main(int argc, char *argv[])
             printf("\n");
     }
 
+    return 1;
+}
+
+int main(int argc, char *argv[])
+{
+    web100_agent *agent;
+    web100_group *group;
+    web100_connection *conn;
+    web100_snapshot **snaps = NULL;
+    output *out = NULL;
+    const char *grp_name;
+    double interval = 0;
+    int format = OUTPUT_TEXT;
+    int count = -1, nsnaps = 0;
+    int sample, cid, c, i;
+
+    argv0 = argv[0];
+
+    while ((c = getopt_long(argc, argv, "f:i:c:", long_options, NULL)) != -1) {
+        switch (c) {
+        case 'f':
+            format = output_format(optarg);
+            break;
+        case 'i':
+            interval = atof(optarg);
+            break;
+        case 'c':
+            count = atoi(optarg);
+            break;
+        default:
+            usage();
+            exit(EXIT_FAILURE);
+        }
+    }
+    if ((argc - optind != 1 && argc - optind != 2) || format < 0 ||
+        interval < 0 || (count >= 0 && interval == 0)) {
+        usage();
+        exit(EXIT_FAILURE);
+    }
+    if (interval == 0)
+        count = 1;
+    else if (count < 0)
+        count = 0;
+    grp_name = argc - optind == 2 ? argv[optind + 1] : NULL;
+    /* A CSV file has one header row, so holds one group's records */
+    if (format == OUTPUT_CSV && grp_name == NULL)
+        grp_name = "read";
+
+    if ((agent = web100_attach(WEB100_AGENT_TYPE_LOCAL, NULL)) == NULL) {
+        web100_perror("web100_attach");
+        exit(EXIT_FAILURE);
+    }
+
+    cid = atoi(argv[optind]);
+    if ((conn = web100_connection_lookup(agent, cid)) == NULL) {
+        web100_perror("web100_connection_lookup");
+        exit(EXIT_FAILURE);
+    }
+
+    if (format != OUTPUT_TEXT) {
+        if (grp_name && web100_group_find(agent, grp_name) == NULL) {
+            web100_perror(grp_name);
+            exit(EXIT_FAILURE);
+        }
+        out = output_open(STDOUT_FILENO, format, agent);
+        for (group = web100_group_head(agent); group; group = web100_group_next(group)) {
+            if (grp_name && strcmp(grp_name, web100_get_group_name(group)) != 0)
+                continue;
+            if ((snaps = realloc(snaps, (nsnaps + 1) * sizeof (*snaps))) == NULL ||
+                (snaps[nsnaps++] = web100_snapshot_alloc(group, conn)) == NULL) {
+                web100_perror("web100_snapshot_alloc");
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+
+    for (sample = 0; count == 0 || sample < count; sample++) {
+        if (sample > 0)
+            usleep((useconds_t)(interval * 1000000));
+
+        if (out == NULL) {
+            if (sample > 0)
+                printf("\n");
+            if (!print_conn(agent, conn, grp_name))
+                break;
+            fflush(stdout);
+            continue;
+        }
+
+        for (i = 0; i < nsnaps; i++) {
+            if (web100_snap(snaps[i]) != WEB100_ERR_SUCCESS) {
+                if (web100_errno == WEB100_ERR_NOCONNECTION)
+                    break;
+                web100_perror("web100_snap");
+                exit(EXIT_FAILURE);
+            }
+            output_snapshot(out, snaps[i]);
+        }
+        output_flush(out);
+        if (i < nsnaps)         // the connection has closed
+            break;
+    }
+
+    if (out) {
+        output_close(out);
+        while (nsnaps > 0)
+            web100_snapshot_free(snaps[--nsnaps]);
+        free(snaps);
+    }
+    web100_detach(agent);
+
     return 0;
 }
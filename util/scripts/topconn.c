@@ -0,0 +1,213 @@
+/*
+ * topconn: list the connections with the largest value, or the largest
+ *          per-second rate, of a web100 variable.
+ *
+ * Usage: topconn [-r] [-n count] [-i seconds] [-c sweeps] <var name>
+ * Example: topconn -r -n 20 -c 0 PktsRetrans
+ *
+ * Copyright (c) 2001
+ *      Carnegie Mellon University, The Board of Trustees of the University
+ *      of Illinois, and University Corporation for Atmospheric Research.
+ *      All rights reserved.  This software comes with NO WARRANTY.
+ *
+ * Since our code is currently under active development we prefer that
+ * everyone gets the it directly from us.  This will permit us to
+ * collaborate with all of the users.  So for the time being, please refer
+ * potential users to us instead of redistributing web100.
+ *
+ * $Id$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+
+#include "web100.h"
+
+static const char* argv0 = NULL;
+
+
+static void
+usage(void)
+{
+    fprintf(stderr,
+            "Usage: %s [-r] [-n count] [-i seconds] [-c sweeps] <var name>\n",
+            argv0);
+}
+
+
+/* Print "local port  remote port" of a connection */
+static void
+print_endpoints(web100_connection *conn)
+{
+    struct web100_connection_spec spec;
+    struct web100_connection_spec_v6 spec_v6;
+
+    if (web100_get_connection_addrtype(conn) == WEB100_ADDRTYPE_IPV4) {
+        web100_get_connection_spec(conn, &spec);
+        printf("  %s ", web100_value_to_text(WEB100_TYPE_INET_ADDRESS_IPV4, &spec.src_addr));
+        printf("%s  ", web100_value_to_text(WEB100_TYPE_INET_PORT_NUMBER, &spec.src_port));
+        printf("%s ", web100_value_to_text(WEB100_TYPE_INET_ADDRESS_IPV4, &spec.dst_addr));
+        printf("%s", web100_value_to_text(WEB100_TYPE_INET_PORT_NUMBER, &spec.dst_port));
+    } else {
+        web100_get_connection_spec_v6(conn, &spec_v6);
+        printf("  %s ", web100_value_to_text(WEB100_TYPE_INET_ADDRESS_IPV6, spec_v6.src_addr));
+        printf("%s  ", web100_value_to_text(WEB100_TYPE_INET_PORT_NUMBER, &spec_v6.src_port));
+        printf("%s ", web100_value_to_text(WEB100_TYPE_INET_ADDRESS_IPV6, spec_v6.dst_addr));
+        printf("%s", web100_value_to_text(WEB100_TYPE_INET_PORT_NUMBER, &spec_v6.dst_port));
+    }
+}
+
+
+int
+main(int argc, char *argv[])
+{
+    web100_agent* agent;
+    web100_group* group;
+    web100_var* var;
+    web100_accessor acc;
+    web100_snapset* last;
+    web100_snapset* prior;
+    web100_snapset* tmp;
+    web100_topk* topk;
+    double* rates = NULL;
+    int* rate_cids = NULL;
+    double* values;
+    int* cids;
+    double interval = 1;
+    int count = 20, sweeps = 1, rate = 0;
+    int index = 0, nvars, alloc = 0;
+    int sweep, rows, n, i, c, type;
+
+    argv0 = argv[0];
+
+    while ((c = getopt(argc, argv, "rn:i:c:")) != -1) {
+        switch (c) {
+        case 'r':
+            rate = 1;
+            break;
+        case 'n':
+            count = atoi(optarg);
+            break;
+        case 'i':
+            interval = atof(optarg);
+            break;
+        case 'c':
+            sweeps = atoi(optarg);
+            break;
+        default:
+            usage();
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (argc - optind != 1 || count <= 0 || interval <= 0 || sweeps < 0) {
+        usage();
+        exit(EXIT_FAILURE);
+    }
+
+    if ((agent = web100_attach(WEB100_AGENT_TYPE_LOCAL, NULL)) == NULL) {
+        web100_perror("web100_attach");
+        exit(EXIT_FAILURE);
+    }
+    if (web100_agent_find_var_and_group(agent, argv[optind], &group, &var) !=
+        WEB100_ERR_SUCCESS) {
+        web100_perror(argv[optind]);
+        exit(EXIT_FAILURE);
+    }
+    web100_accessor_init(&acc, var);
+
+    type = web100_get_var_type(var);
+    if (rate && type != WEB100_TYPE_COUNTER32 && type != WEB100_TYPE_COUNTER64) {
+        fprintf(stderr, "%s: %s is not a counter\n", argv0, argv[optind]);
+        exit(EXIT_FAILURE);
+    }
+
+    /* Rates land at the variable's index in each row */
+    nvars = web100_get_group_nvars(group);
+    while (index < nvars && web100_var_at(group, index) != var)
+        index++;
+    if (rate && index == nvars) {
+        fprintf(stderr, "%s: %s is deprecated\n", argv0, argv[optind]);
+        exit(EXIT_FAILURE);
+    }
+
+    if ((topk = web100_topk_alloc(count)) == NULL ||
+        (values = malloc(count * sizeof (double))) == NULL ||
+        (cids = malloc(count * sizeof (int))) == NULL) {
+        web100_perror("web100_topk_alloc");
+        exit(EXIT_FAILURE);
+    }
+    if ((last = web100_snapset_alloc(group)) == NULL ||
+        (prior = web100_snapset_alloc(group)) == NULL) {
+        web100_perror("web100_snapset_alloc");
+        exit(EXIT_FAILURE);
+    }
+
+    if (rate) {
+        if (web100_snapset_take(last) != WEB100_ERR_SUCCESS) {
+            web100_perror("web100_snapset_take");
+            exit(EXIT_FAILURE);
+        }
+        usleep((useconds_t)(interval * 1000000));
+    }
+
+    for (sweep = 0; sweeps == 0 || sweep < sweeps; sweep++) {
+        if (sweep > 0)
+            usleep((useconds_t)(interval * 1000000));
+
+        tmp = prior;
+        prior = last;
+        last = tmp;
+        if (web100_snapset_take(last) != WEB100_ERR_SUCCESS) {
+            web100_perror("web100_snapset_take");
+            exit(EXIT_FAILURE);
+        }
+
+        web100_topk_reset(topk);
+        if (rate) {
+            if ((rows = web100_get_snapset_count(last)) > alloc) {
+                alloc = rows;
+                rates = realloc(rates, (size_t)alloc * nvars * sizeof (double));
+                rate_cids = realloc(rate_cids, alloc * sizeof (int));
+                if (rates == NULL || rate_cids == NULL) {
+                    fprintf(stderr, "%s: out of memory\n", argv0);
+                    exit(EXIT_FAILURE);
+                }
+            }
+            if ((rows = web100_snapset_rates(last, prior, rates, rate_cids)) < 0) {
+                web100_perror("web100_snapset_rates");
+                exit(EXIT_FAILURE);
+            }
+            web100_topk_add(topk, rates + index, rate_cids, rows, nvars);
+        } else {
+            web100_snapset_topk(last, &acc, topk);
+        }
+
+        n = web100_topk_sorted(topk, values, cids);
+        if (sweep > 0)
+            printf("\n");
+        printf("%d connections, top %d by %s%s\n", web100_get_snapset_count(last),
+               n, argv[optind], rate ? " per second" : "");
+        for (i = 0; i < n; i++) {
+            if (rate)
+                printf("%8d %16.2f", cids[i], values[i]);
+            else
+                printf("%8d %16.0f", cids[i], values[i]);
+            print_endpoints(web100_snapset_find(last, cids[i])->connection);
+            printf("\n");
+        }
+        fflush(stdout);
+    }
+
+    free(rates);
+    free(rate_cids);
+    free(values);
+    free(cids);
+    web100_topk_free(topk);
+    web100_snapset_free(last);
+    web100_snapset_free(prior);
+    web100_detach(agent);
+
+    return 0;
+}
@@ -0,0 +1,234 @@
+/*
+ * triageall: print what limited sending on every connection over an
+ *            interval: the sender, the network (congestion window) or
+ *            the receiver (receive window), with the connections most
+ *            limited by one of them.
+ *
+ * Usage: triageall [-i seconds] [-n count] [-l snd|cng|rcv]
+ * Example: triageall -i 5 -n 20 -l rcv
+ *
+ * Copyright (c) 2001
+ *      Carnegie Mellon University, The Board of Trustees of the University
+ *      of Illinois, and University Corporation for Atmospheric Research.
+ *      All rights reserved.  This software comes with NO WARRANTY.
+ *
+ * Since our code is currently under active development we prefer that
+ * everyone gets the it directly from us.  This will permit us to
+ * collaborate with all of the users.  So for the time being, please refer
+ * potential users to us instead of redistributing web100.
+ *
+ * $Id$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+
+#include "web100.h"
+
+static const char* argv0 = NULL;
+
+static const char* limit_names[WEB100_TRIAGE_N] = { "snd", "cng", "rcv" };
+static const char* limit_titles[WEB100_TRIAGE_N] = {
+    "sender", "congestion", "receiver"
+};
+
+/* For qsort: rows of fractions, ordered by column sort_col */
+static const float* sort_rows;
+static int sort_col;
+
+
+static void
+usage(void)
+{
+    fprintf(stderr, "Usage: %s [-i seconds] [-n count] [-l snd|cng|rcv]\n",
+            argv0);
+}
+
+
+static int
+row_cmp(const void *a, const void *b)
+{
+    float fa = sort_rows[WEB100_TRIAGE_N * *(const int *)a + sort_col];
+    float fb = sort_rows[WEB100_TRIAGE_N * *(const int *)b + sort_col];
+
+    return (fa < fb) - (fa > fb);
+}
+
+
+/*
+ * Print "local port  remote port" for a snapshot of the read group, or
+ * nothing if the header does not have the variables.
+ */
+static void
+print_endpoints(web100_snapshot *snap, web100_accessor acc[5])
+{
+    int type = WEB100_TYPE_INET_ADDRESS_IPV4;
+    int k;
+
+    for (k = 1; k < 5; k++)
+        if (acc[k].group == NULL)
+            return;
+    if (acc[0].group != NULL && web100_get_s32(snap, &acc[0]) != WEB100_ADDRTYPE_IPV4)
+        type = WEB100_TYPE_INET_ADDRESS_IPV6;
+
+    printf("  %s ", web100_value_to_text(type, (void *)web100_get_ptr(snap, &acc[1])));
+    printf("%s  ", web100_value_to_text(WEB100_TYPE_INET_PORT_NUMBER,
+                                        (void *)web100_get_ptr(snap, &acc[2])));
+    printf("%s ", web100_value_to_text(type, (void *)web100_get_ptr(snap, &acc[3])));
+    printf("%s", web100_value_to_text(WEB100_TYPE_INET_PORT_NUMBER,
+                                      (void *)web100_get_ptr(snap, &acc[4])));
+}
+
+
+int
+main(int argc, char *argv[])
+{
+    web100_agent* agent;
+    web100_group* group;
+    web100_snapset* prior;
+    web100_snapset* last;
+    web100_accessor acc[5];
+    static const char* acc_names[5] = {
+        "LocalAddressType", "LocalAddress", "LocalPort", "RemAddress", "RemPort"
+    };
+    float* fractions;
+    int* cids;
+    int* order;
+    double mean[WEB100_TRIAGE_N];
+    int limited[WEB100_TRIAGE_N];
+    double interval = 1;
+    int count = 10;
+    int rows, active, i, k, top, c;
+
+    argv0 = argv[0];
+    sort_col = WEB100_TRIAGE_CNG;
+
+    while ((c = getopt(argc, argv, "i:n:l:")) != -1) {
+        switch (c) {
+        case 'i':
+            interval = atof(optarg);
+            break;
+        case 'n':
+            count = atoi(optarg);
+            break;
+        case 'l':
+            for (k = 0; k < WEB100_TRIAGE_N; k++)
+                if (strcmp(optarg, limit_names[k]) == 0)
+                    break;
+            if (k == WEB100_TRIAGE_N) {
+                usage();
+                exit(EXIT_FAILURE);
+            }
+            sort_col = k;
+            break;
+        default:
+            usage();
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (optind != argc || interval <= 0 || count < 0) {
+        usage();
+        exit(EXIT_FAILURE);
+    }
+
+    if ((agent = web100_attach(WEB100_AGENT_TYPE_LOCAL, NULL)) == NULL) {
+        web100_perror("web100_attach");
+        exit(EXIT_FAILURE);
+    }
+    if ((group = web100_group_find(agent, "read")) == NULL) {
+        web100_perror("web100_group_find: read");
+        exit(EXIT_FAILURE);
+    }
+    for (k = 0; k < 5; k++)
+        if (web100_accessor_find(&acc[k], group, acc_names[k]) != WEB100_ERR_SUCCESS)
+            acc[k].group = NULL;
+
+    if ((prior = web100_snapset_alloc(group)) == NULL ||
+        (last = web100_snapset_alloc(group)) == NULL) {
+        web100_perror("web100_snapset_alloc");
+        exit(EXIT_FAILURE);
+    }
+    if (web100_snapset_take(prior) != WEB100_ERR_SUCCESS) {
+        web100_perror("web100_snapset_take");
+        exit(EXIT_FAILURE);
+    }
+    usleep((useconds_t)(interval * 1000000));
+    if (web100_snapset_take(last) != WEB100_ERR_SUCCESS) {
+        web100_perror("web100_snapset_take");
+        exit(EXIT_FAILURE);
+    }
+
+    rows = web100_get_snapset_count(last);
+    fractions = malloc((rows ? rows : 1) * WEB100_TRIAGE_N * sizeof (float));
+    cids = malloc((rows ? rows : 1) * sizeof (int));
+    order = malloc((rows ? rows : 1) * sizeof (int));
+    if (fractions == NULL || cids == NULL || order == NULL) {
+        fprintf(stderr, "%s: out of memory\n", argv0);
+        exit(EXIT_FAILURE);
+    }
+
+    if ((rows = web100_snapset_triage(last, prior, fractions, cids)) < 0) {
+        web100_perror("web100_snapset_triage");
+        exit(EXIT_FAILURE);
+    }
+
+    /* Connections that sent nothing have all-zero rows and are left out */
+    memset(mean, 0, sizeof (mean));
+    memset(limited, 0, sizeof (limited));
+    for (i = active = 0; i < rows; i++) {
+        const float *f = fractions + WEB100_TRIAGE_N * i;
+        int most = 0;
+
+        if (f[0] == 0 && f[1] == 0 && f[2] == 0)
+            continue;
+        for (k = 0; k < WEB100_TRIAGE_N; k++) {
+            mean[k] += f[k];
+            if (f[k] > f[most])
+                most = k;
+        }
+        limited[most]++;
+        order[active++] = i;
+    }
+
+    printf("%d connections over %g s, %d sending\n", rows, interval, active);
+    if (active == 0)
+        goto Done;
+
+    printf("\n%-10s %8s %8s %8s\n", "", "%Snd", "%Cng", "%Rcv");
+    printf("%-10s", "mean");
+    for (k = 0; k < WEB100_TRIAGE_N; k++)
+        printf(" %8.3f", 100 * mean[k] / active);
+    printf("\n%-10s", "mostly");
+    for (k = 0; k < WEB100_TRIAGE_N; k++)
+        printf(" %8d", limited[k]);
+    printf("\n");
+
+    sort_rows = fractions;
+    qsort(order, active, sizeof (int), row_cmp);
+    top = count < active ? count : active;
+    if (top == 0)
+        goto Done;
+
+    printf("\nMost %s limited:\n", limit_titles[sort_col]);
+    printf("%8s %8s %8s %8s\n", "cid", "%Snd", "%Cng", "%Rcv");
+    for (i = 0; i < top; i++) {
+        const float *f = fractions + WEB100_TRIAGE_N * order[i];
+
+        printf("%8d %8.3f %8.3f %8.3f", cids[order[i]],
+               100 * f[0], 100 * f[1], 100 * f[2]);
+        print_endpoints(web100_snapset_find(last, cids[order[i]]), acc);
+        printf("\n");
+    }
+
+ Done:
+    free(fractions);
+    free(cids);
+    free(order);
+    web100_snapset_free(prior);
+    web100_snapset_free(last);
+    web100_detach(agent);
+
+    return 0;
+}
@@ -0,0 +1,125 @@
+/*
+ * web100-logcolumns: write the records of logs as a columnar file, one
+ *                    array of each variable's values, for analysis.
+ *
+ * Usage: web100-logcolumns [-d] [-m maxopen] -o file [log ...]
+ * Example: find logs -name '*.log' | web100-logcolumns -d -o host.cols
+ *
+ * Copyright (c) 2001
+ *      Carnegie Mellon University, The Board of Trustees of the University
+ *      of Illinois, and University Corporation for Atmospheric Research.
+ *      All rights reserved.  This software comes with NO WARRANTY.
+ *
+ * Since our code is currently under active development we prefer that
+ * everyone gets the it directly from us.  This will permit us to
+ * collaborate with all of the users.  So for the time being, please refer
+ * potential users to us instead of redistributing web100.
+ *
+ * $Id$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+
+#include "web100.h"
+
+static const char* argv0 = NULL;
+
+
+static void
+usage(void)
+{
+    fprintf(stderr, "Usage: %s [-d] [-m maxopen] -o file [log ...]\n", argv0);
+}
+
+
+/* The names of the logs, one a line, when none are given as arguments */
+static char**
+read_names(FILE* fp, int* np)
+{
+    char** names = NULL;
+    char line[4096];
+    int n = 0, alloc = 0;
+    size_t len;
+
+    while (fgets(line, sizeof (line), fp) != NULL) {
+        len = strlen(line);
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+            line[--len] = '\0';
+        if (len == 0)
+            continue;
+        if (n == alloc) {
+            alloc = alloc ? 2 * alloc : 256;
+            if ((names = realloc(names, alloc * sizeof (char*))) == NULL) {
+                fprintf(stderr, "%s: out of memory\n", argv0);
+                exit(EXIT_FAILURE);
+            }
+        }
+        if ((names[n++] = strdup(line)) == NULL) {
+            fprintf(stderr, "%s: out of memory\n", argv0);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    *np = n;
+    return names;
+}
+
+
+int
+main(int argc, char *argv[])
+{
+    web100_log_merge* merge;
+    char** names;
+    char* file = NULL;
+    int flags = 0, maxopen = 0;
+    int nnames, c;
+
+    argv0 = argv[0];
+
+    while ((c = getopt(argc, argv, "dm:o:")) != -1) {
+        switch (c) {
+        case 'd':
+            flags |= WEB100_COLUMNS_DELTA;
+            break;
+        case 'm':
+            maxopen = atoi(optarg);
+            break;
+        case 'o':
+            file = optarg;
+            break;
+        default:
+            usage();
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (maxopen < 0 || file == NULL) {
+        usage();
+        exit(EXIT_FAILURE);
+    }
+
+    if (optind < argc) {
+        names = argv + optind;
+        nnames = argc - optind;
+    } else {
+        names = read_names(stdin, &nnames);
+    }
+    if (nnames == 0) {
+        usage();
+        exit(EXIT_FAILURE);
+    }
+
+    if ((merge = web100_log_merge_open(names, nnames, maxopen)) == NULL) {
+        web100_perror("web100_log_merge_open");
+        exit(EXIT_FAILURE);
+    }
+    if (web100_columns_export(merge, file, flags) != WEB100_ERR_SUCCESS) {
+        web100_perror(file);
+        exit(EXIT_FAILURE);
+    }
+    web100_log_merge_close(merge);
+
+    return 0;
+}
@@ -0,0 +1,177 @@
+/*
+ * web100-logmerge: merge the records of many logs into one stream in
+ *                  time order, written as a log of many connections or
+ *                  as text.
+ *
+ * Usage: web100-logmerge [-f log|csv|jsonl|binary] [-o file] [-k keyint]
+ *                        [-m maxopen] [log ...]
+ * Example: find logs -name '*.log' | web100-logmerge -o host.log
+ *
+ * Copyright (c) 2001
+ *      Carnegie Mellon University, The Board of Trustees of the University
+ *      of Illinois, and University Corporation for Atmospheric Research.
+ *      All rights reserved.  This software comes with NO WARRANTY.
+ *
+ * Since our code is currently under active development we prefer that
+ * everyone gets the it directly from us.  This will permit us to
+ * collaborate with all of the users.  So for the time being, please refer
+ * potential users to us instead of redistributing web100.
+ *
+ * $Id$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+
+#include "web100.h"
+#include "output.h"
+
+static const char* argv0 = NULL;
+
+
+static void
+usage(void)
+{
+    fprintf(stderr,
+            "Usage: %s [-f log|csv|jsonl|binary] [-o file] [-k keyint] [-m maxopen] [log ...]\n",
+            argv0);
+}
+
+
+/* The names of the logs, one a line, when none are given as arguments */
+static char**
+read_names(FILE* fp, int* np)
+{
+    char** names = NULL;
+    char line[4096];
+    int n = 0, alloc = 0;
+    size_t len;
+
+    while (fgets(line, sizeof (line), fp) != NULL) {
+        len = strlen(line);
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+            line[--len] = '\0';
+        if (len == 0)
+            continue;
+        if (n == alloc) {
+            alloc = alloc ? 2 * alloc : 256;
+            if ((names = realloc(names, alloc * sizeof (char*))) == NULL) {
+                fprintf(stderr, "%s: out of memory\n", argv0);
+                exit(EXIT_FAILURE);
+            }
+        }
+        if ((names[n++] = strdup(line)) == NULL) {
+            fprintf(stderr, "%s: out of memory\n", argv0);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    *np = n;
+    return names;
+}
+
+
+int
+main(int argc, char *argv[])
+{
+    web100_log_merge* merge;
+    web100_log* log = NULL;
+    web100_snapshot snap;
+    output* out = NULL;
+    char** names;
+    char* file = NULL;
+    int format = -1, keyint = 0, maxopen = 0;
+    int nnames, err, c;
+
+    argv0 = argv[0];
+
+    while ((c = getopt(argc, argv, "f:o:k:m:")) != -1) {
+        switch (c) {
+        case 'f':
+            if (strcmp(optarg, "log") == 0)
+                format = -1;
+            else if ((format = output_format(optarg)) < 0 || format == OUTPUT_TEXT) {
+                usage();
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'o':
+            file = optarg;
+            break;
+        case 'k':
+            keyint = atoi(optarg);
+            break;
+        case 'm':
+            maxopen = atoi(optarg);
+            break;
+        default:
+            usage();
+            exit(EXIT_FAILURE);
+        }
+    }
+    /* A log is written to a file; text, to one or to stdout */
+    if (keyint < 0 || maxopen < 0 || (format < 0 && file == NULL)) {
+        usage();
+        exit(EXIT_FAILURE);
+    }
+
+    if (optind < argc) {
+        names = argv + optind;
+        nnames = argc - optind;
+    } else {
+        names = read_names(stdin, &nnames);
+    }
+    if (nnames == 0) {
+        usage();
+        exit(EXIT_FAILURE);
+    }
+
+    if ((merge = web100_log_merge_open(names, nnames, maxopen)) == NULL) {
+        web100_perror("web100_log_merge_open");
+        exit(EXIT_FAILURE);
+    }
+
+    if (format < 0) {
+        if ((log = web100_log_open_write(file, NULL, web100_get_log_merge_group(merge))) == NULL) {
+            web100_perror(file);
+            exit(EXIT_FAILURE);
+        }
+        if (keyint > 1 && web100_log_set_delta(log, keyint) != WEB100_ERR_SUCCESS) {
+            web100_perror("web100_log_set_delta");
+            exit(EXIT_FAILURE);
+        }
+    } else {
+        if (file != NULL && freopen(file, "w", stdout) == NULL) {
+            perror(file);
+            exit(EXIT_FAILURE);
+        }
+        out = output_open(STDOUT_FILENO, format, web100_get_log_merge_agent(merge));
+    }
+
+    while ((err = web100_log_merge_read(merge, &snap)) == WEB100_ERR_SUCCESS) {
+        if (log) {
+            if (web100_log_write(log, &snap) != WEB100_ERR_SUCCESS) {
+                web100_perror("web100_log_write");
+                exit(EXIT_FAILURE);
+            }
+        } else {
+            output_snapshot(out, &snap);
+        }
+    }
+    if (err != EOF) {
+        web100_perror("web100_log_merge_read");
+        exit(EXIT_FAILURE);
+    }
+
+    if (log && web100_log_close_write(log) != WEB100_ERR_SUCCESS) {
+        web100_perror("web100_log_close_write");
+        exit(EXIT_FAILURE);
+    }
+    if (out)
+        output_close(out);
+    web100_log_merge_close(merge);
+
+    return 0;
+}
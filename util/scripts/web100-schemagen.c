@@ -0,0 +1,343 @@
+/*
+ * web100-schemagen: Writes a C++ header describing every variable of a
+ *          Web100 header, with offsets and types as compile-time
+ *          constants.
+ *
+ * Usage: web100-schemagen [-n namespace] [header file]
+ * Example: web100-schemagen -n fleet /proc/web100/header > fleet-schema.hpp
+ *
+ * Copyright (c) 2001
+ *      Carnegie Mellon University, The Board of Trustees of the University
+ *      of Illinois, and University Corporation for Atmospheric Research.
+ *      All rights reserved.  This software comes with NO WARRANTY.
+ *
+ * Since our code is currently under active development we prefer that
+ * everyone gets the it directly from us.  This will permit us to
+ * collaborate with all of the users.  So for the time being, please refer
+ * potential users to us instead of redistributing web100.
+ *
+ * $Id$
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <sys/types.h>
+
+#include "web100.h"
+
+static const char* argv0 = NULL;
+
+static const char* type_names[] = {
+    "WEB100_TYPE_INTEGER",
+    "WEB100_TYPE_INTEGER32",
+    "WEB100_TYPE_INET_ADDRESS_IPV4",
+    "WEB100_TYPE_COUNTER32",
+    "WEB100_TYPE_GAUGE32",
+    "WEB100_TYPE_UNSIGNED32",
+    "WEB100_TYPE_TIME_TICKS",
+    "WEB100_TYPE_COUNTER64",
+    "WEB100_TYPE_INET_PORT_NUMBER",
+    "WEB100_TYPE_INET_ADDRESS",
+    "WEB100_TYPE_INET_ADDRESS_IPV6",
+    "WEB100_TYPE_STR32",
+    "WEB100_TYPE_OCTET",
+};
+
+
+static const char*
+type_name(int type)
+{
+    static char buf[16];
+
+    if (type >= 0 && type < (int)(sizeof (type_names) / sizeof (type_names[0])))
+        return type_names[type];
+    sprintf(buf, "%d", type);
+    return buf;
+}
+
+
+static void
+usage(void)
+{
+    fprintf(stderr, "Usage: %s [-n namespace] [header file]\n", argv0);
+}
+
+
+/*
+ * The C++ type a variable is read as.  Addresses and strings have no
+ * scalar type and are handed out as a pointer into the snapshot.
+ */
+static const char*
+value_type(int type)
+{
+    switch (type) {
+    case WEB100_TYPE_INTEGER:
+    case WEB100_TYPE_INTEGER32:
+        return "std::int32_t";
+    case WEB100_TYPE_INET_ADDRESS_IPV4:
+    case WEB100_TYPE_COUNTER32:
+    case WEB100_TYPE_GAUGE32:
+    case WEB100_TYPE_UNSIGNED32:
+    case WEB100_TYPE_TIME_TICKS:
+        return "std::uint32_t";
+    case WEB100_TYPE_COUNTER64:
+        return "std::uint64_t";
+    case WEB100_TYPE_INET_PORT_NUMBER:
+        return "std::uint16_t";
+    default:
+        return "const unsigned char*";
+    }
+}
+
+
+/*
+ * Print name as a C++ identifier.  Anything but letters, digits and _
+ * becomes _, and a leading digit gets a _ in front.
+ */
+static void
+print_ident(const char *name)
+{
+    if (isdigit((unsigned char)*name))
+        putchar('_');
+    for (; *name; name++)
+        putchar(isalnum((unsigned char)*name) ? *name : '_');
+}
+
+
+static void
+print_prologue(const char *ns, const char *source, web100_agent *agent,
+               int nvars)
+{
+    const char *p;
+
+    printf("/*\n"
+           " * Generated by web100-schemagen from %s.  Do not edit.\n"
+           " */\n", source);
+    printf("#ifndef _");
+    for (p = ns; *p; p++)
+        putchar(toupper((unsigned char)*p));
+    printf("_HPP\n#define _");
+    for (p = ns; *p; p++)
+        putchar(toupper((unsigned char)*p));
+    printf("_HPP\n\n");
+
+    printf("#include <cstdint>\n"
+           "#include <cstring>\n"
+           "#include <type_traits>\n"
+           "#include <web100/web100.h>\n\n");
+
+    printf("namespace %s {\n\n", ns);
+
+    printf("constexpr std::uint64_t fingerprint = 0x%016llxULL;\n",
+           (unsigned long long)web100_get_agent_fingerprint(agent));
+    printf("constexpr const char version[] = \"%s\";\n",
+           web100_get_agent_version(agent));
+    printf("constexpr int nvars = %d;\n\n", nvars);
+}
+
+
+/*
+ * The table of all variables lets a binding resolve them at run time when
+ * the fingerprint does not match.
+ */
+static void
+print_table(web100_agent *agent)
+{
+    web100_group *gp;
+    web100_var *vp;
+    web100_accessor acc;
+
+    printf("struct var_desc {\n"
+           "    const char* group;\n"
+           "    const char* name;\n"
+           "    int offset;\n"
+           "    int type;\n"
+           "    int size;\n"
+           "};\n\n");
+
+    printf("constexpr var_desc vars[] = {\n");
+    for (gp = web100_group_head(agent); gp; gp = web100_group_next(gp)) {
+        for (vp = web100_var_head(gp); vp; vp = web100_var_next(vp)) {
+            web100_accessor_init(&acc, vp);
+            printf("    { \"%s\", \"%s\", %d, %s, %d },\n",
+                   web100_get_group_name(gp), web100_get_var_name(vp),
+                   acc.offset, type_name(acc.type), acc.size);
+        }
+    }
+    printf("};\n\n");
+}
+
+
+static void
+print_groups(web100_agent *agent)
+{
+    web100_group *gp;
+    web100_var *vp;
+    web100_accessor acc;
+    int index = 0;
+
+    for (gp = web100_group_head(agent); gp; gp = web100_group_next(gp)) {
+        printf("namespace ");
+        print_ident(web100_get_group_name(gp));
+        printf(" {\n\n");
+        printf("constexpr const char name[] = \"%s\";\n",
+               web100_get_group_name(gp));
+        printf("constexpr int size = %d;\n\n", web100_get_group_size(gp));
+
+        for (vp = web100_var_head(gp); vp; vp = web100_var_next(vp)) {
+            web100_accessor_init(&acc, vp);
+            printf("struct ");
+            print_ident(web100_get_var_name(vp));
+            printf(" {\n"
+                   "    typedef %s value_type;\n"
+                   "    static constexpr int index = %d;\n"
+                   "    static constexpr int offset = %d;\n"
+                   "    static constexpr int type = %s;\n"
+                   "    static constexpr int size = %d;\n"
+                   "};\n\n",
+                   value_type(acc.type), index++, acc.offset,
+                   type_name(acc.type), acc.size);
+        }
+
+        printf("} // namespace ");
+        print_ident(web100_get_group_name(gp));
+        printf("\n\n");
+    }
+}
+
+
+/*
+ * The getters.  get<V>() on a binding whose agent matched the fingerprint
+ * reads at V::offset, which the compiler folds into the load; otherwise it
+ * goes through the accessor resolved when the binding was made.  Loops that
+ * want no branch at all can test fast() once and use get_static<V>().
+ */
+static void
+print_getters(const char *ns)
+{
+    printf("namespace detail {\n\n"
+           "template <class T>\n"
+           "inline T load(const void* data, int offset, std::true_type)\n"
+           "{\n"
+           "    T val;\n"
+           "    std::memcpy(&val, (const char*)data + offset, sizeof (val));\n"
+           "    return val;\n"
+           "}\n\n"
+           "template <class T>\n"
+           "inline T load(const void* data, int offset, std::false_type)\n"
+           "{\n"
+           "    return (const unsigned char*)data + offset;\n"
+           "}\n\n"
+           "template <class V>\n"
+           "struct is_scalar : std::is_arithmetic<typename V::value_type> {};\n\n"
+           "} // namespace detail\n\n");
+
+    printf("template <class V>\n"
+           "inline typename V::value_type get_static(const void* data)\n"
+           "{\n"
+           "    return detail::load<typename V::value_type>(data, V::offset,\n"
+           "                                                detail::is_scalar<V>());\n"
+           "}\n\n");
+
+    printf("class binding {\n"
+           "public:\n"
+           "    explicit binding(web100_agent* agent)\n"
+           "        : fast_(web100_get_agent_fingerprint(agent) == fingerprint)\n"
+           "    {\n"
+           "        web100_group* group;\n"
+           "        int i;\n\n"
+           "        if (fast_)\n"
+           "            return;\n"
+           "        std::memset(acc_, 0, sizeof (acc_));\n"
+           "        for (i = 0; i < nvars; i++) {\n"
+           "            if ((group = web100_group_find(agent, vars[i].group)) != NULL)\n"
+           "                web100_accessor_find(&acc_[i], group, vars[i].name);\n"
+           "        }\n"
+           "    }\n\n"
+           "    /* true if the agent's header is the one this was generated from */\n"
+           "    bool fast() const { return fast_; }\n\n"
+           "    template <class V>\n"
+           "    bool has() const { return fast_ || acc_[V::index].group != NULL; }\n\n"
+           "    /* The snapshot must be of V's group.  Missing variables read as 0. */\n"
+           "    template <class V>\n"
+           "    typename V::value_type get(const web100_snapshot* snap) const\n"
+           "    {\n"
+           "        if (fast_)\n"
+           "            return get_static<V>(snap->data);\n"
+           "        return slow<V>(snap, detail::is_scalar<V>());\n"
+           "    }\n\n"
+           "private:\n"
+           "    template <class V>\n"
+           "    typename V::value_type slow(const web100_snapshot* snap, std::true_type) const\n"
+           "    {\n"
+           "        return (typename V::value_type)web100_get_uint(snap, &acc_[V::index]);\n"
+           "    }\n\n"
+           "    template <class V>\n"
+           "    typename V::value_type slow(const web100_snapshot* snap, std::false_type) const\n"
+           "    {\n"
+           "        if (acc_[V::index].group == NULL)\n"
+           "            return NULL;\n"
+           "        return (typename V::value_type)web100_get_ptr(snap, &acc_[V::index]);\n"
+           "    }\n\n"
+           "    bool fast_;\n"
+           "    web100_accessor acc_[nvars];\n"
+           "};\n\n");
+
+    printf("} // namespace %s\n\n#endif\n", ns);
+}
+
+
+int
+main(int argc, char *argv[])
+{
+    web100_agent* agent;
+    web100_group* gp;
+    web100_var* vp;
+    const char* ns = "web100_schema";
+    const char* path = NULL;
+    int nvars = 0;
+    int c;
+
+    argv0 = argv[0];
+
+    while ((c = getopt(argc, argv, "n:")) != -1) {
+        switch (c) {
+        case 'n':
+            ns = optarg;
+            break;
+        default:
+            usage();
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (argc - optind > 1) {
+        usage();
+        exit(EXIT_FAILURE);
+    }
+    if (optind < argc)
+        path = argv[optind];
+
+    if ((agent = web100_attach(WEB100_AGENT_TYPE_LOCAL, (void *)path)) == NULL) {
+        web100_perror(path ? path : "web100_attach");
+        exit(EXIT_FAILURE);
+    }
+
+    for (gp = web100_group_head(agent); gp; gp = web100_group_next(gp))
+        for (vp = web100_var_head(gp); vp; vp = web100_var_next(vp))
+            nvars++;
+    if (nvars == 0) {
+        fprintf(stderr, "%s: header has no variables\n", argv0);
+        exit(EXIT_FAILURE);
+    }
+
+    print_prologue(ns, path ? path : "the running kernel", agent, nvars);
+    print_table(agent);
+    print_groups(agent);
+    print_getters(ns);
+
+    web100_detach(agent);
+
+    return 0;
+}